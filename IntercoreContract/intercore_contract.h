@@ -1,10 +1,15 @@
 #pragma once
 
+#include <stdint.h>
+
 typedef enum
 {
 	IC_UNKNOWN,
 	IC_READ_SENSOR,
-	IC_TARGET_TEMPERATURE
+	IC_TARGET_TEMPERATURE,
+	IC_TRACE_CHUNK,
+	IC_RT_STATS,
+	IC_SAMPLE_RATE
 } INTERCORE_CMD;
 
 typedef enum
@@ -21,5 +26,59 @@ typedef struct
 	int temperature;
 	int pressure;
 	int humidity;
-	HVAC_OPERATING_MODE operating_mode;	
+	HVAC_OPERATING_MODE operating_mode;
+	uint32_t timestamp_ms;	// real-time core monotonic milliseconds when the sensors were read
+	uint32_t reply_ms;		// real-time core monotonic milliseconds when the reply was sent, for clock offset tracking
 } INTERCORE_BLOCK;
+
+// Number of trace buffer bytes carried in each IC_TRACE_CHUNK reply
+#define IC_TRACE_CHUNK_BYTES 512
+
+// The high-level app requests a chunk by sending the header only (cmd and offset).
+// The real-time app replies with the chunk at that offset, total_size is zero when tracing is not enabled.
+typedef struct
+{
+	INTERCORE_CMD cmd;
+	uint32_t offset;
+	uint32_t length;
+	uint32_t total_size;
+	uint8_t data[IC_TRACE_CHUNK_BYTES];
+} INTERCORE_TRACE_BLOCK;
+
+#define IC_TRACE_REQUEST_LENGTH (sizeof(INTERCORE_TRACE_BLOCK) - IC_TRACE_CHUNK_BYTES)
+
+// Periodic tasks reported in each IC_RT_STATS reply, and the longest task name including the terminator
+#define IC_RT_STATS_TASKS 4
+#define IC_RT_STATS_NAME_BYTES 12
+
+// The high-level app requests the stats by sending the cmd only.
+// The real-time app replies with the worst case timing of each periodic task since it started.
+typedef struct
+{
+	char name[IC_RT_STATS_NAME_BYTES];
+	uint32_t releases;
+	uint32_t deadline_overruns;
+	uint32_t missed_releases;
+	uint32_t exec_us_max;
+	uint32_t lateness_us_max;		// release to start
+	uint32_t response_us_max;		// release to completion
+} INTERCORE_TASK_STATS;
+
+typedef struct
+{
+	INTERCORE_CMD cmd;
+	uint32_t uptime_ms;
+	uint32_t task_count;
+	INTERCORE_TASK_STATS tasks[IC_RT_STATS_TASKS];
+} INTERCORE_STATS_BLOCK;
+
+// Sensor read periods the real-time app accepts in an IC_SAMPLE_RATE request, others are ignored
+#define IC_SAMPLE_RATE_MIN_MS 100
+#define IC_SAMPLE_RATE_MAX_MS 3600000
+
+// The high-level app sets the period of the real-time sensor read task, there is no reply
+typedef struct
+{
+	INTERCORE_CMD cmd;
+	uint32_t read_period_ms;
+} INTERCORE_RATE_BLOCK;
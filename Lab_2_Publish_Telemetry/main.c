@@ -42,58 +42,112 @@
  **********************************************************************************************************/
 
 /// <summary>
-/// Publish HVAC telemetry
+/// Send callback for the telemetry batch, the readings are kept for the next attempt when not connected. Each message
+/// is tracked until IoT Hub confirms it, the outcome and confirmation latency drive the adaptive publish rate.
+/// </summary>
+static bool publish_telemetry_batch(const void *message, size_t length, unsigned flags)
+{
+    // Publish telemetry message to IoT Hub/Central
+    return telemetry_publish(&telemetry_health, flags & TELEMETRY_SEND_BACKFILL, message, length, messageProperties,
+                             NELEMS(messageProperties), flags & TELEMETRY_SEND_GZIP ? &gzipContentProperties : &contentProperties);
+}
+
+/// <summary>
+/// Change the publish period when publishes fail or slow down, after an anomaly, or to drain the backlog
+/// </summary>
+static void adapt_publish_rate(void)
+{
+    if (telemetry_rate_update(&telemetry_rate, telemetry_store.count))
+    {
+        // One backfill message per publish while draining, rate limited otherwise
+        telemetry_store.backfill_interval_seconds = telemetry_rate.reason == TELEMETRY_RATE_BACKLOG ? 0 : TELEMETRY_BACKFILL_INTERVAL_SECONDS;
+        dx_timerChange(&tmr_publish_telemetry, &(struct timespec){telemetry_rate.period_seconds, 0});
+        dx_Log_Debug("Telemetry publish period %d seconds, %s\n", telemetry_rate.period_seconds, telemetry_rate_reason(telemetry_rate.reason));
+    }
+}
+
+/// <summary>
+/// Queue the statistics of the readings since the last publish if the mean moved past the deadband or the heartbeat
+/// expired, a batch is published when full or when the oldest sample reaches its maximum age. The timer period then
+/// adapts to the link and the backlog.
 /// </summary>
 /// <param name="eventLoopTimer"></param>
 static void publish_telemetry_handler(EventLoopTimer *eventLoopTimer)
 {
-    static int msgId = 0;
-
     if (ConsumeEventLoopTimerEvent(eventLoopTimer) != 0)
     {
         dx_terminate(DX_ExitCode_ConsumeEventLoopTimeEvent);
         return;
     }
 
-    if (telemetry.valid && azure_connected)
+    // Any valid readings since the last publish
+    if (telemetry_window.temperature.count > 0)
     {
-        // clang-format off
-        // Serialize telemetry as JSON
-        if (dx_jsonSerialize(msgBuffer, sizeof(msgBuffer), 6,
-            DX_JSON_INT, "msgId", msgId++,
-            DX_JSON_INT, "temperature", telemetry.latest.temperature,
-            DX_JSON_INT, "pressure", telemetry.latest.pressure,
-            DX_JSON_INT, "humidity", telemetry.latest.humidity,
-            DX_JSON_INT, "peakUserMemoryKiB", (int)Applications_GetPeakUserModeMemoryUsageInKB(),
-            DX_JSON_INT, "totalMemoryKiB", (int)Applications_GetTotalMemoryUsageInKB()))
-        // clang-format on
+        if (telemetry_deadband_check(&telemetry_deadband, running_stats_mean(&telemetry_window.temperature),
+                                     running_stats_mean(&telemetry_window.pressure), running_stats_mean(&telemetry_window.humidity)))
         {
-            dx_Log_Debug("%s\n", msgBuffer);
+            telemetry_batch_add(&telemetry_batch, &telemetry_window);
+
+            if (telemetry_deadband.moved)
+            {
+                // Send the change now and publish faster for a while
+                telemetry_rate_anomaly(&telemetry_rate);
+                telemetry_batch_flush(&telemetry_batch);
+            }
 
-            // Publish telemetry message to IoT Hub/Central
-            dx_azurePublish(msgBuffer, strlen(msgBuffer), messageProperties, NELEMS(messageProperties), &contentProperties);
+            dx_Log_Debug("Telemetry deadband: %u%% of readings suppressed\n", telemetry_deadband_suppressed_percent(&telemetry_deadband));
         }
         else
         {
-            dx_Log_Debug("JSON Serialization failed: Buffer too small\n");
-            dx_terminate(APP_ExitCode_Telemetry_Buffer_Too_Small);
+            telemetry_batch_suppress(&telemetry_batch);
         }
+
+        telemetry_window_reset(&telemetry_window);
+    }
+
+    telemetry_batch_flush_if_due(&telemetry_batch);
+    adapt_publish_rate();
+}
+
+/// <summary>
+/// Publish the telemetry pipeline health for the last interval as a separate low rate message
+/// </summary>
+/// <param name="eventLoopTimer"></param>
+static void publish_health_handler(EventLoopTimer *eventLoopTimer)
+{
+    size_t length;
+
+    if (ConsumeEventLoopTimerEvent(eventLoopTimer) != 0)
+    {
+        dx_terminate(DX_ExitCode_ConsumeEventLoopTimeEvent);
+        return;
+    }
+
+    // Keep counting while offline, the next summary covers the whole outage
+    if (azure_connected && (length = telemetry_health_summary(&telemetry_health, healthBuffer, sizeof(healthBuffer))) > 0)
+    {
+        dx_Log_Debug("%s\n", healthBuffer);
+        // Not tracked, the summary does not count itself
+        dx_azurePublish(healthBuffer, length, healthMessageProperties, NELEMS(healthMessageProperties), &healthContentProperties);
     }
 }
 
 /// <summary>
-/// read_telemetry_handler callback handler called every 4 seconds
+/// read_telemetry_handler callback handler called every second, the readings are aggregated into the telemetry window
 /// Environment sensors read and HVAC operating mode LED updated
 /// </summary>
 /// <param name="eventLoopTimer"></param>
 static void read_telemetry_handler(EventLoopTimer *eventLoopTimer)
 {
+    struct timespec acquired, utc;
+
     if (ConsumeEventLoopTimerEvent(eventLoopTimer) != 0)
     {
         dx_terminate(DX_ExitCode_ConsumeEventLoopTimeEvent);
         return;
     }
     hvac_sensors_read(&telemetry.latest);
+    clock_gettime(CLOCK_MONOTONIC, &acquired);
 
     telemetry.updated = true;
 
@@ -103,6 +157,12 @@ static void read_telemetry_handler(EventLoopTimer *eventLoopTimer)
         IN_RANGE(telemetry.latest.pressure, 800, 1200) &&
         IN_RANGE(telemetry.latest.humidity, 0, 100);
     // clang-format on
+
+    if (telemetry.valid)
+    {
+        telemetry_clock_monotonic_to_utc(&acquired, &utc);
+        telemetry_window_add(&telemetry_window, &utc, telemetry.latest.temperature, telemetry.latest.pressure, telemetry.latest.humidity);
+    }
 }
 
 /***********************************************************************************************************
@@ -130,6 +190,7 @@ static void InitPeripheralsAndHandlers(void)
 {
     hvac_sensors_init();
     dx_Log_Debug_Init(Log_Debug_Time_buffer, sizeof(Log_Debug_Time_buffer));
+    telemetry_store_open(&telemetry_store);
     dx_azureConnect(&dx_config, NETWORK_INTERFACE, IOT_PLUG_AND_PLAY_MODEL_ID);
     dx_gpioSetOpen(gpio_bindings, NELEMS(gpio_bindings));
     dx_i2cSetOpen(i2c_bindings, NELEMS(i2c_bindings));
@@ -142,6 +203,10 @@ static void InitPeripheralsAndHandlers(void)
 /// </summary>
 static void ClosePeripheralsAndHandlers(void)
 {
+    // Best effort, the batch is queued with the IoT Hub client or moved to the store before it is torn down
+    telemetry_batch_flush(&telemetry_batch);
+    telemetry_store_close(&telemetry_store);
+
     dx_timerSetStop(timer_bindings, NELEMS(timer_bindings));
     dx_gpioSetClose(gpio_bindings, NELEMS(gpio_bindings));
     dx_i2cSetClose(i2c_bindings, NELEMS(i2c_bindings));
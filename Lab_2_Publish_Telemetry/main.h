@@ -19,6 +19,13 @@
 #include "app_exit_codes.h"                // application specific exit codes
 #include "hvac_sensors.h"
 #include "hvac_status.h"
+#include "telemetry_batch.h"
+#include "telemetry_clock.h"
+#include "telemetry_deadband.h"
+#include "telemetry_health.h"
+#include "telemetry_publish.h"
+#include "telemetry_rate.h"
+#include "telemetry_stats.h"
 
 #include <applibs/applications.h>
 #include <applibs/log.h>
@@ -30,14 +37,71 @@
 #define HVAC_FIRMWARE_VERSION "3.02"
 
 // Forward declarations
+static bool publish_telemetry_batch(const void *message, size_t length, unsigned flags);
+static void publish_health_handler(EventLoopTimer *eventLoopTimer);
 static void publish_telemetry_handler(EventLoopTimer *eventLoopTimer);
 static void read_telemetry_handler(EventLoopTimer *eventLoopTimer);
 void azure_status_led_off_handler(EventLoopTimer *eventLoopTimer);
 void azure_status_led_on_handler(EventLoopTimer *eventLoopTimer);
 
-// Number of bytes to allocate for the JSON telemetry message for IoT Hub/Central
-#define JSON_MESSAGE_BYTES 256
-static char msgBuffer[JSON_MESSAGE_BYTES] = {0};
+// Every valid reading between two publishes is summarised (count, mean, min, max, standard deviation) in constant memory
+static TELEMETRY_WINDOW telemetry_window;
+
+// A reading is only queued when a field moves past its deadband from the last reported value, or when nothing
+// has been reported for TELEMETRY_HEARTBEAT_SECONDS
+#define TELEMETRY_HEARTBEAT_SECONDS 300
+static TELEMETRY_DEADBAND telemetry_deadband = {.temperature = {.mode = DEADBAND_ABSOLUTE, .threshold = 1},
+                                                .pressure = {.mode = DEADBAND_ABSOLUTE, .threshold = 2},
+                                                .humidity = {.mode = DEADBAND_PERCENT, .threshold = 5},
+                                                .heartbeat_seconds = TELEMETRY_HEARTBEAT_SECONDS};
+
+// Telemetry readings are batched into one message, sent when the batch is full or the oldest reading reaches the maximum age
+#define TELEMETRY_BATCH_SIZE 12
+#define TELEMETRY_BATCH_MAX_AGE_SECONDS 60
+// Readings that cannot be sent are kept in mutable storage and backfilled once connected, oldest first, one message
+// every TELEMETRY_BACKFILL_INTERVAL_SECONDS. The store must fit the MutableStorage size in app_manifest.json.
+#define TELEMETRY_STORE_RECORDS 4096
+#define TELEMETRY_BACKFILL_INTERVAL_SECONDS 10
+#define MUTABLE_STORAGE_KB 64
+_Static_assert(TELEMETRY_STORE_BYTES(TELEMETRY_STORE_RECORDS) <= MUTABLE_STORAGE_KB * 1024, "Telemetry store larger than mutable storage");
+
+static TELEMETRY_STORE telemetry_store = {.capacity = TELEMETRY_STORE_RECORDS,
+                                          .order = TELEMETRY_BACKFILL_OLDEST_FIRST,
+                                          .backfill_interval_seconds = TELEMETRY_BACKFILL_INTERVAL_SECONDS,
+                                          .backfill_samples = TELEMETRY_BATCH_MAX_SAMPLES,
+                                          .fd = -1};
+
+// Built with the TELEMETRY_GZIP CMake option, messages of at least TELEMETRY_GZIP_MIN_BYTES are sent gzip compressed
+#define TELEMETRY_GZIP_MIN_BYTES 1024
+
+// The publish period adapts at runtime. It doubles with each failed publish up to TELEMETRY_MAX_PUBLISH_SECONDS, and
+// the period doubles (rate halves) while IoT Hub takes longer than TELEMETRY_PUBLISH_LATENCY_LIMIT_MS to confirm a
+// message. Otherwise it drops to TELEMETRY_FAST_PUBLISH_SECONDS for TELEMETRY_ANOMALY_HOLD_SECONDS after a reading
+// moves past its deadband and while the backlog drains. The period and the reason are sent with each message.
+#define TELEMETRY_PUBLISH_SECONDS 5
+#define TELEMETRY_FAST_PUBLISH_SECONDS 2
+#define TELEMETRY_MAX_PUBLISH_SECONDS 60
+#define TELEMETRY_ANOMALY_HOLD_SECONDS 60
+#define TELEMETRY_PUBLISH_LATENCY_LIMIT_MS 2000
+static TELEMETRY_RATE telemetry_rate = {.normal_seconds = TELEMETRY_PUBLISH_SECONDS,
+                                        .fast_seconds = TELEMETRY_FAST_PUBLISH_SECONDS,
+                                        .max_seconds = TELEMETRY_MAX_PUBLISH_SECONDS,
+                                        .anomaly_hold_seconds = TELEMETRY_ANOMALY_HOLD_SECONDS,
+                                        .latency_limit_ms = TELEMETRY_PUBLISH_LATENCY_LIMIT_MS};
+
+// Every telemetry message is tracked from enqueue to confirmation. Outcomes, retries, queue depth and latency
+// percentiles are published every TELEMETRY_HEALTH_SECONDS.
+#define TELEMETRY_HEALTH_SECONDS 300
+static TELEMETRY_HEALTH telemetry_health = {.rate = &telemetry_rate};
+static char healthBuffer[TELEMETRY_HEALTH_JSON_BYTES];
+
+static TELEMETRY_BATCH telemetry_batch = {.max_samples = TELEMETRY_BATCH_SIZE,
+                                          .max_age_seconds = TELEMETRY_BATCH_MAX_AGE_SECONDS,
+                                          .send = publish_telemetry_batch,
+                                          .gzip_min_bytes = TELEMETRY_GZIP_MIN_BYTES,
+                                          .store = &telemetry_store,
+                                          .rate = &telemetry_rate};
+
 DX_USER_CONFIG dx_config;
 bool azure_connected = false;
 ENVIRONMENT telemetry;
@@ -51,12 +115,25 @@ static char Log_Debug_Time_buffer[128];
 /// </summary>
 static DX_MESSAGE_PROPERTY *messageProperties[] = {&(DX_MESSAGE_PROPERTY){.key = "appid", .value = "hvac"},
                                                    &(DX_MESSAGE_PROPERTY){.key = "type", .value = "telemetry"},
-                                                   &(DX_MESSAGE_PROPERTY){.key = "schema", .value = "1"}};
+                                                   &(DX_MESSAGE_PROPERTY){.key = "schema", .value = "2"}};
 
 /// <summary>
 /// Common content properties for publish messages to IoT Hub/Central
 /// </summary>
-static DX_MESSAGE_CONTENT_PROPERTIES contentProperties = {.contentEncoding = "utf-8", .contentType = "application/json"};
+static DX_MESSAGE_CONTENT_PROPERTIES contentProperties = {.contentEncoding = TELEMETRY_CONTENT_ENCODING, .contentType = TELEMETRY_CONTENT_TYPE};
+
+/// <summary>
+/// Content properties for gzip compressed telemetry, the body is binary so IoT Hub message routing cannot query it
+/// </summary>
+static DX_MESSAGE_CONTENT_PROPERTIES gzipContentProperties = {.contentEncoding = "gzip", .contentType = TELEMETRY_CONTENT_TYPE};
+
+/// <summary>
+/// Telemetry pipeline health summaries are routed apart from the readings
+/// </summary>
+static DX_MESSAGE_PROPERTY *healthMessageProperties[] = {&(DX_MESSAGE_PROPERTY){.key = "appid", .value = "hvac"},
+                                                         &(DX_MESSAGE_PROPERTY){.key = "type", .value = "health"},
+                                                         &(DX_MESSAGE_PROPERTY){.key = "schema", .value = "1"}};
+static DX_MESSAGE_CONTENT_PROPERTIES healthContentProperties = {.contentEncoding = "utf-8", .contentType = "application/json"};
 
 // declare gpio bindings
 static DX_GPIO_BINDING gpio_operating_led = {
@@ -70,12 +147,14 @@ DX_I2C_BINDING i2c_onboard_sensors = {.interfaceId = I2cMaster2, .speedInHz = I2
 // declare timer bindings
 DX_TIMER_BINDING tmr_azure_status_led_off = {.name = "tmr_azure_status_led_off", .handler = azure_status_led_off_handler};
 DX_TIMER_BINDING tmr_azure_status_led_on = {.period = {0, 500 * ONE_MS}, .name = "tmr_azure_status_led_on", .handler = azure_status_led_on_handler};
-static DX_TIMER_BINDING tmr_read_telemetry = {.period = {4, 0}, .name = "tmr_read_telemetry", .handler = read_telemetry_handler};
-static DX_TIMER_BINDING tmr_publish_telemetry = {.period = {5, 0}, .name = "tmr_publish_telemetry", .handler = publish_telemetry_handler};
+static DX_TIMER_BINDING tmr_read_telemetry = {.period = {1, 0}, .name = "tmr_read_telemetry", .handler = read_telemetry_handler};
+static DX_TIMER_BINDING tmr_publish_health = {.period = {TELEMETRY_HEALTH_SECONDS, 0}, .name = "tmr_publish_health", .handler = publish_health_handler};
+static DX_TIMER_BINDING tmr_publish_telemetry = {.period = {TELEMETRY_PUBLISH_SECONDS, 0}, .name = "tmr_publish_telemetry", .handler = publish_telemetry_handler};
 
 // All bindings referenced in the following binding sets are initialised in the InitPeripheralsAndHandlers function
 DX_DEVICE_TWIN_BINDING *device_twin_bindings[] = {};
 DX_DIRECT_METHOD_BINDING *direct_method_binding_sets[] = {};
 DX_GPIO_BINDING *gpio_bindings[] = {&gpio_network_led, &gpio_operating_led};
-DX_TIMER_BINDING *timer_bindings[] = {&tmr_publish_telemetry, &tmr_read_telemetry, &tmr_azure_status_led_off, &tmr_azure_status_led_on};
+DX_TIMER_BINDING *timer_bindings[] = {&tmr_publish_health, &tmr_publish_telemetry, &tmr_read_telemetry, &tmr_azure_status_led_off,
+                                      &tmr_azure_status_led_on};
 DX_I2C_BINDING *i2c_bindings[] = {&i2c_onboard_sensors};
@@ -0,0 +1,66 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+#pragma once
+
+#include "telemetry_encode.h"
+#include "telemetry_rate.h"
+#include "telemetry_stats.h"
+#include "telemetry_store.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <time.h>
+
+typedef enum
+{
+    TELEMETRY_SEND_GZIP = 1 << 0,    // the message is gzip compressed
+    TELEMETRY_SEND_BACKFILL = 1 << 1 // the message carries stored readings that failed to send before
+} TELEMETRY_SEND_FLAGS;
+
+/// <summary>
+/// Publish a serialized batch, return false if it could not be sent (for example not connected) to keep the samples.
+/// flags is a combination of TELEMETRY_SEND_FLAGS.
+/// </summary>
+typedef bool (*TELEMETRY_BATCH_SEND)(const void *message, size_t length, unsigned flags);
+
+typedef struct
+{
+    size_t max_samples;  // flush when this many samples are queued
+    int max_age_seconds; // flush when the oldest queued sample is this old
+    TELEMETRY_BATCH_SEND send;
+    size_t gzip_min_bytes;      // built with TELEMETRY_GZIP, messages at least this long are sent compressed, zero never compresses
+    TELEMETRY_STORE *store;     // optional store and forward queue, a due batch that cannot be sent is moved here
+    const TELEMETRY_RATE *rate; // optional adaptive publish rate, the period and reason are sent with each message
+    TELEMETRY_SAMPLE samples[TELEMETRY_BATCH_MAX_SAMPLES];
+    size_t head;
+    size_t count;
+    time_t oldest_monotonic;
+    int msgId;
+    unsigned samples_dropped;
+    unsigned samples_suppressed;
+} TELEMETRY_BATCH;
+
+/// <summary>
+/// Queue the statistics of a publish window, timestamped with the acquisition time of its latest reading. When the queue
+/// is full the oldest sample is dropped.
+/// </summary>
+void telemetry_batch_add(TELEMETRY_BATCH *batch, const TELEMETRY_WINDOW *window);
+
+/// <summary>
+/// Count a reading that was not queued because nothing changed, reported with the next batch
+/// </summary>
+void telemetry_batch_suppress(TELEMETRY_BATCH *batch);
+
+/// <summary>
+/// Send the queued readings if the batch is full or the oldest reading is older than max_age_seconds, then backfill
+/// from the store and forward queue at its rate limit
+/// </summary>
+/// <returns>true if a message was sent</returns>
+bool telemetry_batch_flush_if_due(TELEMETRY_BATCH *batch);
+
+/// <summary>
+/// Send the queued readings now, used on shutdown. If they cannot be sent they are moved to the store.
+/// </summary>
+/// <returns>true if a batch was sent</returns>
+bool telemetry_batch_flush(TELEMETRY_BATCH *batch);
@@ -0,0 +1,224 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+#include "telemetry_gzip.h"
+
+#include <stdbool.h>
+#include <string.h>
+
+#define MIN_MATCH 3
+#define MAX_MATCH 258
+#define MAX_DISTANCE 32768
+#define END_OF_BLOCK 256
+
+// RFC 1951 section 3.2.5
+static const uint16_t length_base[] = {3,  4,  5,  6,  7,  8,  9,  10, 11,  13,  15,  17,  19,  23, 27,
+                                       31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+static const uint8_t length_extra[] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+static const uint16_t distance_base[] = {1,   2,   3,   4,   5,   7,    9,    13,   17,   25,   33,   49,   65,    97,    129,
+                                         193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+static const uint8_t distance_extra[] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+// CRC-32 (reflected, polynomial 0xEDB88320) four bits at a time, a 64 byte table instead of 1 KB
+static const uint32_t crc_nibble[] = {0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+                                      0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C};
+
+typedef struct
+{
+    uint8_t *data;
+    size_t size;
+    size_t offset;
+    uint32_t bits; // pending bits, least significant first
+    int count;
+    bool overflow;
+} BIT_WRITER;
+
+static uint32_t crc32(const uint8_t *data, size_t length)
+{
+    uint32_t crc = 0xFFFFFFFF;
+
+    for (size_t i = 0; i < length; i++)
+    {
+        crc ^= data[i];
+        crc = (crc >> 4) ^ crc_nibble[crc & 0x0F];
+        crc = (crc >> 4) ^ crc_nibble[crc & 0x0F];
+    }
+    return ~crc;
+}
+
+static void put_byte(BIT_WRITER *writer, uint8_t value)
+{
+    if (writer->offset < writer->size)
+    {
+        writer->data[writer->offset++] = value;
+    }
+    else
+    {
+        writer->overflow = true;
+    }
+}
+
+static void put_u32(BIT_WRITER *writer, uint32_t value)
+{
+    for (int i = 0; i < 4; i++)
+    {
+        put_byte(writer, (uint8_t)(value >> (8 * i)));
+    }
+}
+
+static void put_bits(BIT_WRITER *writer, uint32_t value, int count)
+{
+    writer->bits |= value << writer->count;
+    writer->count += count;
+
+    while (writer->count >= 8)
+    {
+        put_byte(writer, (uint8_t)writer->bits);
+        writer->bits >>= 8;
+        writer->count -= 8;
+    }
+}
+
+static void flush_bits(BIT_WRITER *writer)
+{
+    if (writer->count > 0)
+    {
+        put_byte(writer, (uint8_t)writer->bits);
+        writer->bits = 0;
+        writer->count = 0;
+    }
+}
+
+/// <summary>
+/// Huffman codes are packed most significant bit first
+/// </summary>
+static void put_code(BIT_WRITER *writer, uint32_t code, int length)
+{
+    uint32_t reversed = 0;
+
+    for (int i = 0; i < length; i++)
+    {
+        reversed = (reversed << 1) | ((code >> i) & 1);
+    }
+    put_bits(writer, reversed, length);
+}
+
+/// <summary>
+/// Fixed literal/length code, RFC 1951 section 3.2.6
+/// </summary>
+static void put_symbol(BIT_WRITER *writer, unsigned symbol)
+{
+    if (symbol < 144)
+    {
+        put_code(writer, 0x30 + symbol, 8);
+    }
+    else if (symbol < 256)
+    {
+        put_code(writer, 0x190 + symbol - 144, 9);
+    }
+    else if (symbol < 280)
+    {
+        put_code(writer, symbol - 256, 7);
+    }
+    else
+    {
+        put_code(writer, 0xC0 + symbol - 280, 8);
+    }
+}
+
+static void put_match(BIT_WRITER *writer, unsigned length, unsigned distance)
+{
+    unsigned code = sizeof(length_base) / sizeof(length_base[0]) - 1;
+
+    while (length_base[code] > length)
+    {
+        code--;
+    }
+    put_symbol(writer, 257 + code);
+    put_bits(writer, length - length_base[code], length_extra[code]);
+
+    code = sizeof(distance_base) / sizeof(distance_base[0]) - 1;
+    while (distance_base[code] > distance)
+    {
+        code--;
+    }
+    put_code(writer, code, 5);
+    put_bits(writer, distance - distance_base[code], distance_extra[code]);
+}
+
+static unsigned hash(const uint8_t *data)
+{
+    uint32_t key = (uint32_t)data[0] | (uint32_t)data[1] << 8 | (uint32_t)data[2] << 16;
+    return (key * 2654435761u) >> (32 - TELEMETRY_GZIP_HASH_BITS);
+}
+
+size_t telemetry_gzip(TELEMETRY_GZIP_STATE *state, const uint8_t *in, size_t in_length, uint8_t *out, size_t out_size)
+{
+    // magic, deflate, no flags, no modification time, no extra flags, unknown OS
+    static const uint8_t gzip_header[] = {0x1F, 0x8B, 8, 0, 0, 0, 0, 0, 0, 0xFF};
+    BIT_WRITER writer = {.data = out, .size = out_size};
+    size_t position = 0;
+
+    if (in_length > TELEMETRY_GZIP_MAX_INPUT)
+    {
+        return 0;
+    }
+
+    memset(state->head, 0, sizeof(state->head));
+
+    for (size_t i = 0; i < sizeof(gzip_header); i++)
+    {
+        put_byte(&writer, gzip_header[i]);
+    }
+
+    // one final block with fixed codes
+    put_bits(&writer, 1, 1);
+    put_bits(&writer, 1, 2);
+
+    while (position < in_length && !writer.overflow)
+    {
+        size_t match_length = 0;
+        size_t candidate = 0;
+
+        if (in_length - position >= MIN_MATCH)
+        {
+            unsigned key = hash(&in[position]);
+            candidate = state->head[key];
+            state->head[key] = (uint16_t)(position + 1);
+
+            if (candidate-- > 0 && position - candidate <= MAX_DISTANCE)
+            {
+                size_t limit = in_length - position < MAX_MATCH ? in_length - position : MAX_MATCH;
+                while (match_length < limit && in[candidate + match_length] == in[position + match_length])
+                {
+                    match_length++;
+                }
+            }
+        }
+
+        if (match_length >= MIN_MATCH)
+        {
+            put_match(&writer, (unsigned)match_length, (unsigned)(position - candidate));
+
+            // index the positions inside the match so later repeats can refer to them
+            for (size_t end = position + match_length, next = position + 1; next < end && in_length - next >= MIN_MATCH; next++)
+            {
+                state->head[hash(&in[next])] = (uint16_t)(next + 1);
+            }
+            position += match_length;
+        }
+        else
+        {
+            put_symbol(&writer, in[position]);
+            position++;
+        }
+    }
+
+    put_symbol(&writer, END_OF_BLOCK);
+    flush_bits(&writer);
+
+    put_u32(&writer, crc32(in, in_length));
+    put_u32(&writer, (uint32_t)in_length);
+
+    return writer.overflow ? 0 : writer.offset;
+}
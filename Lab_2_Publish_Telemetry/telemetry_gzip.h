@@ -0,0 +1,24 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Match finder hash table, two bytes per entry. The whole message is the LZ77 window, so nothing else is kept.
+#define TELEMETRY_GZIP_HASH_BITS 12
+// Longest message, hash table positions are 16 bit
+#define TELEMETRY_GZIP_MAX_INPUT 65534
+
+typedef struct
+{
+    uint16_t head[1 << TELEMETRY_GZIP_HASH_BITS]; // most recent position + 1 of each 3 byte hash, zero if none
+} TELEMETRY_GZIP_STATE;
+
+/// <summary>
+/// Compress a whole message into a gzip member (RFC 1952) with one fixed Huffman DEFLATE block (RFC 1951). Greedy
+/// matching with a single candidate per position, no allocation.
+/// </summary>
+/// <returns>Compressed length, zero if the input is too long or the result does not fit in out_size</returns>
+size_t telemetry_gzip(TELEMETRY_GZIP_STATE *state, const uint8_t *in, size_t in_length, uint8_t *out, size_t out_size);
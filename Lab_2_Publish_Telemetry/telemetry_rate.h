@@ -0,0 +1,49 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+typedef enum
+{
+    TELEMETRY_RATE_NORMAL,  // healthy link, nothing to catch up
+    TELEMETRY_RATE_FAILURE, // publishes failed, backing off
+    TELEMETRY_RATE_LATENCY, // publishes are slow, backing off
+    TELEMETRY_RATE_ANOMALY, // a reading moved past its deadband, publishing fast for a while
+    TELEMETRY_RATE_BACKLOG  // draining the store and forward queue
+} TELEMETRY_RATE_REASON;
+
+typedef struct
+{
+    int normal_seconds;        // period when the link is healthy and there is nothing to catch up
+    int fast_seconds;          // period after an anomaly and while draining the backlog
+    int max_seconds;           // backoff limit, the period doubles with each consecutive failure up to this
+    int anomaly_hold_seconds;  // how long to publish fast after an anomaly
+    uint32_t latency_limit_ms; // a slower confirmation halves the rate, zero ignores latency
+    int period_seconds;        // current period, zero until the first update
+    TELEMETRY_RATE_REASON reason;
+    unsigned failures; // consecutive failed publishes
+    uint32_t latency_ms;
+    time_t anomaly_until_monotonic;
+} TELEMETRY_RATE;
+
+/// <summary>
+/// Record the outcome of a publish and how long it took to be confirmed
+/// </summary>
+void telemetry_rate_sent(TELEMETRY_RATE *rate, bool sent, uint32_t latency_ms);
+
+/// <summary>
+/// Publish at the fast period for anomaly_hold_seconds, unless backing off
+/// </summary>
+void telemetry_rate_anomaly(TELEMETRY_RATE *rate);
+
+/// <summary>
+/// Choose the period. Backing off on failure or latency comes first, then a recent anomaly, then draining the backlog.
+/// </summary>
+/// <returns>true if the period or the reason changed</returns>
+bool telemetry_rate_update(TELEMETRY_RATE *rate, uint32_t backlog);
+
+const char *telemetry_rate_reason(TELEMETRY_RATE_REASON reason);
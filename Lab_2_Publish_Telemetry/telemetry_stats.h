@@ -0,0 +1,45 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+#pragma once
+
+#include <stdint.h>
+#include <time.h>
+
+/// <summary>
+/// Running count, mean, variance (Welford), min and max in constant memory
+/// </summary>
+typedef struct
+{
+    uint32_t count;
+    double mean;
+    double m2; // sum of squared differences from the mean
+    int min;
+    int max;
+} RUNNING_STATS;
+
+/// <summary>
+/// All readings between two publishes
+/// </summary>
+typedef struct
+{
+    RUNNING_STATS temperature;
+    RUNNING_STATS pressure;
+    RUNNING_STATS humidity;
+    struct timespec timestamp; // UTC acquisition time of the latest reading
+} TELEMETRY_WINDOW;
+
+void running_stats_add(RUNNING_STATS *stats, int value);
+
+/// <summary>
+/// Mean rounded to the nearest integer
+/// </summary>
+int running_stats_mean(const RUNNING_STATS *stats);
+
+/// <summary>
+/// Sample standard deviation, zero for fewer than two readings
+/// </summary>
+double running_stats_stddev(const RUNNING_STATS *stats);
+
+void telemetry_window_add(TELEMETRY_WINDOW *window, const struct timespec *acquired, int temperature, int pressure, int humidity);
+void telemetry_window_reset(TELEMETRY_WINDOW *window);
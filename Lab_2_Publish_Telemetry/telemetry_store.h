@@ -0,0 +1,62 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+#pragma once
+
+#include "telemetry_encode.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+// Mutable storage holds the store header plus capacity records of this size, see telemetry_store.c for the layout
+#define TELEMETRY_STORE_RECORD_BYTES 12
+#define TELEMETRY_STORE_HEADER_BYTES 24
+#define TELEMETRY_STORE_BYTES(records) (TELEMETRY_STORE_HEADER_BYTES + (records)*TELEMETRY_STORE_RECORD_BYTES)
+
+typedef enum
+{
+    TELEMETRY_BACKFILL_OLDEST_FIRST,
+    TELEMETRY_BACKFILL_NEWEST_FIRST
+} TELEMETRY_BACKFILL_ORDER;
+
+typedef struct
+{
+    uint32_t capacity;              // records kept in mutable storage, the oldest is dropped when full
+    TELEMETRY_BACKFILL_ORDER order; // which end of the backlog is sent first once connected
+    int backfill_interval_seconds;  // rate limit, at most one backfill message per interval
+    size_t backfill_samples;        // readings per backfill message, up to TELEMETRY_BATCH_MAX_SAMPLES
+    int fd;
+    uint32_t head; // oldest record
+    uint32_t count;
+    uint32_t dropped_total; // records lost to a full store or a corrupt record, kept across restarts
+    time_t last_backfill_monotonic;
+} TELEMETRY_STORE;
+
+/// <summary>
+/// Open the store in the app mutable storage, the backlog left by a previous run is kept
+/// </summary>
+/// <returns>false if mutable storage is not available, the store then drops everything pushed to it</returns>
+bool telemetry_store_open(TELEMETRY_STORE *store);
+
+void telemetry_store_close(TELEMETRY_STORE *store);
+
+/// <summary>
+/// Append readings, oldest first. When the store is full the oldest records are overwritten.
+/// </summary>
+/// <returns>Number of readings lost, overwritten records or readings that could not be written</returns>
+size_t telemetry_store_push(TELEMETRY_STORE *store, const TELEMETRY_SAMPLE *samples, size_t count);
+
+/// <summary>
+/// Read up to max_count readings from the end selected by the backfill order, in time order. Records that fail the
+/// integrity check are skipped and counted as dropped.
+/// </summary>
+/// <param name="records_read">Set to the number of records covered, pass to telemetry_store_consume once sent</param>
+/// <returns>Number of readings copied to samples</returns>
+size_t telemetry_store_peek(TELEMETRY_STORE *store, TELEMETRY_SAMPLE *samples, size_t max_count, uint32_t *records_read);
+
+/// <summary>
+/// Remove records returned by telemetry_store_peek after they were sent
+/// </summary>
+void telemetry_store_consume(TELEMETRY_STORE *store, uint32_t records_read);
@@ -26,7 +26,6 @@ typedef enum { HVAC_MODE_UNKNOWN, HVAC_MODE_HEATING, HVAC_MODE_GREEN, HVAC_MODE_
 
 typedef struct {
     SENSOR latest;
-    SENSOR previous;
     bool updated;
     bool valid;
     HVAC_OPERATING_MODE latest_operating_mode;
@@ -44,22 +44,22 @@
  **********************************************************************************************************/
 
 /// <summary>
-/// Determine if telemetry value changed. If so, update it's device twin
+/// Determine if telemetry value moved past its hysteresis band and its minimum report interval has passed. If so,
+/// queue it for the next device twin patch
 /// </summary>
-/// <param name="new_value"></param>
-/// <param name="previous_value"></param>
-/// <param name="device_twin"></param>
-static void device_twin_update(int *latest_value, int *previous_value, DX_DEVICE_TWIN_BINDING *device_twin)
+/// <param name="latest_value"></param>
+/// <param name="hysteresis"></param>
+static void device_twin_update(int *latest_value, TWIN_HYSTERESIS *hysteresis)
 {
-    if (*latest_value != *previous_value)
+    if (twin_hysteresis_check(hysteresis, *latest_value))
     {
-        *previous_value = *latest_value;
-        dx_deviceTwinReportValue(device_twin, latest_value);
+        twin_batch_add(&twin_batch, hysteresis->binding, latest_value);
     }
 }
 
 /// <summary>
-/// Only update device twins if data changed to minimize network and cloud costs
+/// Only update device twins if data changed to minimize network and cloud costs. All the changes, including operating
+/// mode changes queued since the last cycle, are sent as one reported properties patch.
 /// </summary>
 /// <param name="temperature"></param>
 /// <param name="pressure"></param>
@@ -73,9 +73,11 @@ static void update_device_twins(EventLoopTimer *eventLoopTimer)
 
     if (telemetry.valid && azure_connected)
     {
-        device_twin_update(&telemetry.latest.temperature, &telemetry.previous.temperature, &dt_hvac_temperature);
-        device_twin_update(&telemetry.latest.pressure, &telemetry.previous.pressure, &dt_hvac_pressure);
-        device_twin_update(&telemetry.latest.humidity, &telemetry.previous.humidity, &dt_hvac_humidity);
+        device_twin_update(&telemetry.latest.temperature, &report_temperature);
+        device_twin_update(&telemetry.latest.pressure, &report_pressure);
+        device_twin_update(&telemetry.latest.humidity, &report_humidity);
+
+        twin_batch_send(&twin_batch);
     }
 }
 
@@ -87,10 +89,8 @@ static void update_device_twins(EventLoopTimer *eventLoopTimer)
 /// </summary>
 void set_hvac_operating_mode(void)
 {
-    if (dt_hvac_target_temperature.propertyUpdated && telemetry.updated)
+    if (target_temperature_applied && telemetry.updated)
     {
-        int target_temperature = *(int *)dt_hvac_target_temperature.propertyValue;
-
         telemetry.latest_operating_mode = telemetry.latest.temperature == target_temperature  ? HVAC_MODE_GREEN
                                           : telemetry.latest.temperature > target_temperature ? HVAC_MODE_COOLING
                                                                                               : HVAC_MODE_HEATING;
@@ -103,8 +103,8 @@ void set_hvac_operating_mode(void)
                 dx_gpioOff(gpio_ledRgb[telemetry.previous_operating_mode - 1]);
             }
             telemetry.previous_operating_mode = telemetry.latest_operating_mode;
-            // Update HVAC operating mode device twin
-            dx_deviceTwinReportValue(&dt_hvac_operating_mode, hvac_state[telemetry.latest_operating_mode]);
+            // Update HVAC operating mode device twin with the next patch
+            twin_batch_add(&twin_batch, &dt_hvac_operating_mode, hvac_state[telemetry.latest_operating_mode]);
         }
 
         // minus one as first item is HVAC_MODE_UNKNOWN
@@ -113,58 +113,112 @@ void set_hvac_operating_mode(void)
 }
 
 /// <summary>
-/// Publish HVAC telemetry
+/// Send callback for the telemetry batch, the readings are kept for the next attempt when not connected. Each message
+/// is tracked until IoT Hub confirms it, the outcome and confirmation latency drive the adaptive publish rate.
+/// </summary>
+static bool publish_telemetry_batch(const void *message, size_t length, unsigned flags)
+{
+    // Publish telemetry message to IoT Hub/Central
+    return telemetry_publish(&telemetry_health, flags & TELEMETRY_SEND_BACKFILL, message, length, messageProperties,
+                             NELEMS(messageProperties), flags & TELEMETRY_SEND_GZIP ? &gzipContentProperties : &contentProperties);
+}
+
+/// <summary>
+/// Change the publish period when publishes fail or slow down, after an anomaly, or to drain the backlog
+/// </summary>
+static void adapt_publish_rate(void)
+{
+    if (telemetry_rate_update(&telemetry_rate, telemetry_store.count))
+    {
+        // One backfill message per publish while draining, rate limited otherwise
+        telemetry_store.backfill_interval_seconds = telemetry_rate.reason == TELEMETRY_RATE_BACKLOG ? 0 : TELEMETRY_BACKFILL_INTERVAL_SECONDS;
+        dx_timerChange(&tmr_publish_telemetry, &(struct timespec){telemetry_rate.period_seconds, 0});
+        dx_Log_Debug("Telemetry publish period %d seconds, %s\n", telemetry_rate.period_seconds, telemetry_rate_reason(telemetry_rate.reason));
+    }
+}
+
+/// <summary>
+/// Queue the statistics of the readings since the last publish if the mean moved past the deadband or the heartbeat
+/// expired, a batch is published when full or when the oldest sample reaches its maximum age. The timer period then
+/// adapts to the link and the backlog.
 /// </summary>
 /// <param name="eventLoopTimer"></param>
 static void publish_telemetry_handler(EventLoopTimer *eventLoopTimer)
 {
-    static int msgId = 0;
-
     if (ConsumeEventLoopTimerEvent(eventLoopTimer) != 0)
     {
         dx_terminate(DX_ExitCode_ConsumeEventLoopTimeEvent);
         return;
     }
 
-    if (telemetry.valid && azure_connected)
+    // Any valid readings since the last publish
+    if (telemetry_window.temperature.count > 0)
     {
-        // clang-format off
-        // Serialize telemetry as JSON
-        if (dx_jsonSerialize(msgBuffer, sizeof(msgBuffer), 6,
-            DX_JSON_INT, "msgId", msgId++,
-            DX_JSON_INT, "temperature", telemetry.latest.temperature,
-            DX_JSON_INT, "pressure", telemetry.latest.pressure,
-            DX_JSON_INT, "humidity", telemetry.latest.humidity,
-            DX_JSON_INT, "peakUserMemoryKiB", (int)Applications_GetPeakUserModeMemoryUsageInKB(),
-            DX_JSON_INT, "totalMemoryKiB", (int)Applications_GetTotalMemoryUsageInKB()))
-        // clang-format on
+        if (telemetry_deadband_check(&telemetry_deadband, running_stats_mean(&telemetry_window.temperature),
+                                     running_stats_mean(&telemetry_window.pressure), running_stats_mean(&telemetry_window.humidity)))
         {
-            dx_Log_Debug("%s\n", msgBuffer);
+            telemetry_batch_add(&telemetry_batch, &telemetry_window);
+
+            if (telemetry_deadband.moved)
+            {
+                // Send the change now and publish faster for a while
+                telemetry_rate_anomaly(&telemetry_rate);
+                telemetry_batch_flush(&telemetry_batch);
+            }
 
-            // Publish telemetry message to IoT Hub/Central
-            dx_azurePublish(msgBuffer, strlen(msgBuffer), messageProperties, NELEMS(messageProperties), &contentProperties);
+            dx_Log_Debug("Telemetry deadband: %u%% of readings suppressed\n", telemetry_deadband_suppressed_percent(&telemetry_deadband));
         }
         else
         {
-            dx_Log_Debug("JSON Serialization failed: Buffer too small\n");
-            dx_terminate(APP_ExitCode_Telemetry_Buffer_Too_Small);
+            telemetry_batch_suppress(&telemetry_batch);
         }
+
+        telemetry_window_reset(&telemetry_window);
     }
+
+    telemetry_batch_flush_if_due(&telemetry_batch);
+    adapt_publish_rate();
 }
 
 /// <summary>
-/// read_telemetry_handler callback handler called every 4 seconds
+/// Publish the telemetry pipeline health for the last interval as a separate low rate message
+/// </summary>
+/// <param name="eventLoopTimer"></param>
+static void publish_health_handler(EventLoopTimer *eventLoopTimer)
+{
+    size_t length;
+
+    if (ConsumeEventLoopTimerEvent(eventLoopTimer) != 0)
+    {
+        dx_terminate(DX_ExitCode_ConsumeEventLoopTimeEvent);
+        return;
+    }
+
+    // Keep counting while offline, the next summary covers the whole outage
+    if (azure_connected && (length = telemetry_health_summary(&telemetry_health, healthBuffer, sizeof(healthBuffer))) > 0)
+    {
+        dx_Log_Debug("%s\n", healthBuffer);
+        // Not tracked, the summary does not count itself
+        dx_azurePublish(healthBuffer, length, healthMessageProperties, NELEMS(healthMessageProperties), &healthContentProperties);
+    }
+}
+
+/// <summary>
+/// read_telemetry_handler callback handler called every second, the readings are aggregated into the telemetry window
 /// Environment sensors read and HVAC operating mode LED updated
 /// </summary>
 /// <param name="eventLoopTimer"></param>
 static void read_telemetry_handler(EventLoopTimer *eventLoopTimer)
 {
+    struct timespec acquired, utc;
+
     if (ConsumeEventLoopTimerEvent(eventLoopTimer) != 0)
     {
         dx_terminate(DX_ExitCode_ConsumeEventLoopTimeEvent);
         return;
     }
     hvac_sensors_read(&telemetry.latest);
+    clock_gettime(CLOCK_MONOTONIC, &acquired);
 
     telemetry.updated = true;
 
@@ -175,6 +229,12 @@ static void read_telemetry_handler(EventLoopTimer *eventLoopTimer)
         IN_RANGE(telemetry.latest.humidity, 0, 100);
     // clang-format on
 
+    if (telemetry.valid)
+    {
+        telemetry_clock_monotonic_to_utc(&acquired, &utc);
+        telemetry_window_add(&telemetry_window, &utc, telemetry.latest.temperature, telemetry.latest.pressure, telemetry.latest.humidity);
+    }
+
     // Set the HVAC Operating mode color
     set_hvac_operating_mode();
 }
@@ -185,6 +245,28 @@ static void read_telemetry_handler(EventLoopTimer *eventLoopTimer)
  * Set target HVAC temperature
  **********************************************************************************************************/
 
+/// <summary>
+/// Binding handler for the debounced desired properties, the value is applied once it stops changing
+/// </summary>
+static void dt_debounce_handler(DX_DEVICE_TWIN_BINDING *deviceTwinBinding)
+{
+    twin_debounce_update(&twin_debounce, deviceTwinBinding);
+}
+
+/// <summary>
+/// Quiet period over, apply the latest desired values
+/// </summary>
+static void twin_debounce_handler(EventLoopTimer *eventLoopTimer)
+{
+    if (ConsumeEventLoopTimerEvent(eventLoopTimer) != 0)
+    {
+        dx_terminate(DX_ExitCode_ConsumeEventLoopTimeEvent);
+        return;
+    }
+
+    twin_debounce_timer(&twin_debounce);
+}
+
 /// <summary>
 /// dt_set_target_temperature_handler callback handler is called when TargetTemperature device twin
 /// message received HVAC operating mode LED updated and IoT Plug and Play device twin acknowledged
@@ -194,6 +276,9 @@ static void dt_set_target_temperature_handler(DX_DEVICE_TWIN_BINDING *deviceTwin
 {
     if (IN_RANGE(*(int *)deviceTwinBinding->propertyValue, 0, 50))
     {
+        target_temperature = *(int *)deviceTwinBinding->propertyValue;
+        target_temperature_applied = true;
+
         // Set the HVAC Operating mode color
         set_hvac_operating_mode();
         dx_deviceTwinAckDesiredValue(deviceTwinBinding, deviceTwinBinding->propertyValue, DX_DEVICE_TWIN_RESPONSE_COMPLETED);
@@ -217,8 +302,9 @@ static void dt_set_target_temperature_handler(DX_DEVICE_TWIN_BINDING *deviceTwin
 static void hvac_startup_report(bool connected)
 {
     snprintf(msgBuffer, sizeof(msgBuffer), "HVAC firmware: %s, DevX version: %s", HVAC_FIRMWARE_VERSION, AZURE_SPHERE_DEVX_VERSION);
-    dx_deviceTwinReportValue(&dt_hvac_sw_version, msgBuffer);                                     // DX_TYPE_STRING
-    dx_deviceTwinReportValue(&dt_hvac_start_utc, dx_getCurrentUtc(msgBuffer, sizeof(msgBuffer))); // DX_TYPE_STRING
+    twin_batch_add(&twin_batch, &dt_hvac_sw_version, msgBuffer);                                     // DX_TYPE_STRING
+    twin_batch_add(&twin_batch, &dt_hvac_start_utc, dx_getCurrentUtc(msgBuffer, sizeof(msgBuffer))); // DX_TYPE_STRING
+    twin_batch_send(&twin_batch);
 
     dx_azureUnregisterConnectionChangedNotification(hvac_startup_report);
 }
@@ -248,6 +334,7 @@ static void InitPeripheralsAndHandlers(void)
 {
     hvac_sensors_init();
     dx_Log_Debug_Init(Log_Debug_Time_buffer, sizeof(Log_Debug_Time_buffer));
+    telemetry_store_open(&telemetry_store);
     dx_azureConnect(&dx_config, NETWORK_INTERFACE, IOT_PLUG_AND_PLAY_MODEL_ID);
     dx_gpioSetOpen(gpio_bindings, NELEMS(gpio_bindings));
     dx_gpioSetOpen(gpio_ledRgb, NELEMS(gpio_ledRgb));
@@ -258,9 +345,6 @@ static void InitPeripheralsAndHandlers(void)
 
     dx_azureRegisterConnectionChangedNotification(azure_connection_state);
     dx_azureRegisterConnectionChangedNotification(hvac_startup_report);
-
-    // initialize previous environment sensor variables
-    telemetry.previous.temperature = telemetry.previous.pressure = telemetry.previous.humidity = INT32_MAX;
 }
 
 /// <summary>
@@ -268,6 +352,10 @@ static void InitPeripheralsAndHandlers(void)
 /// </summary>
 static void ClosePeripheralsAndHandlers(void)
 {
+    // Best effort, the batch is queued with the IoT Hub client or moved to the store before it is torn down
+    telemetry_batch_flush(&telemetry_batch);
+    telemetry_store_close(&telemetry_store);
+
     dx_timerSetStop(timer_bindings, NELEMS(timer_bindings));
     dx_deviceTwinUnsubscribe();
     dx_directMethodUnsubscribe();
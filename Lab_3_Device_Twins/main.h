@@ -19,6 +19,16 @@
 #include "app_exit_codes.h"                // application specific exit codes
 #include "hvac_sensors.h"
 #include "hvac_status.h"
+#include "telemetry_batch.h"
+#include "telemetry_clock.h"
+#include "telemetry_deadband.h"
+#include "telemetry_health.h"
+#include "telemetry_publish.h"
+#include "telemetry_rate.h"
+#include "telemetry_stats.h"
+#include "twin_batch.h"
+#include "twin_debounce.h"
+#include "twin_hysteresis.h"
 
 #include <applibs/applications.h>
 #include <applibs/log.h>
@@ -30,9 +40,13 @@
 #define HVAC_FIRMWARE_VERSION "3.02"
 
 // Forward declarations
+static void dt_debounce_handler(DX_DEVICE_TWIN_BINDING *deviceTwinBinding);
 static void dt_set_target_temperature_handler(DX_DEVICE_TWIN_BINDING *deviceTwinBinding);
+static bool publish_telemetry_batch(const void *message, size_t length, unsigned flags);
+static void publish_health_handler(EventLoopTimer *eventLoopTimer);
 static void publish_telemetry_handler(EventLoopTimer *eventLoopTimer);
 static void read_telemetry_handler(EventLoopTimer *eventLoopTimer);
+static void twin_debounce_handler(EventLoopTimer *eventLoopTimer);
 static void update_device_twins(EventLoopTimer *eventLoopTimer);
 void azure_status_led_off_handler(EventLoopTimer *eventLoopTimer);
 void azure_status_led_on_handler(EventLoopTimer *eventLoopTimer);
@@ -41,6 +55,65 @@ void azure_status_led_on_handler(EventLoopTimer *eventLoopTimer);
 // Hub/Central
 #define JSON_MESSAGE_BYTES 256
 static char msgBuffer[JSON_MESSAGE_BYTES] = {0};
+
+// Every valid reading between two publishes is summarised (count, mean, min, max, standard deviation) in constant memory
+static TELEMETRY_WINDOW telemetry_window;
+
+// A reading is only queued when a field moves past its deadband from the last reported value, or when nothing
+// has been reported for TELEMETRY_HEARTBEAT_SECONDS
+#define TELEMETRY_HEARTBEAT_SECONDS 300
+static TELEMETRY_DEADBAND telemetry_deadband = {.temperature = {.mode = DEADBAND_ABSOLUTE, .threshold = 1},
+                                                .pressure = {.mode = DEADBAND_ABSOLUTE, .threshold = 2},
+                                                .humidity = {.mode = DEADBAND_PERCENT, .threshold = 5},
+                                                .heartbeat_seconds = TELEMETRY_HEARTBEAT_SECONDS};
+
+// Telemetry readings are batched into one message, sent when the batch is full or the oldest reading reaches the maximum age
+#define TELEMETRY_BATCH_SIZE 12
+#define TELEMETRY_BATCH_MAX_AGE_SECONDS 60
+// Readings that cannot be sent are kept in mutable storage and backfilled once connected, oldest first, one message
+// every TELEMETRY_BACKFILL_INTERVAL_SECONDS. The store must fit the MutableStorage size in app_manifest.json.
+#define TELEMETRY_STORE_RECORDS 4096
+#define TELEMETRY_BACKFILL_INTERVAL_SECONDS 10
+#define MUTABLE_STORAGE_KB 64
+_Static_assert(TELEMETRY_STORE_BYTES(TELEMETRY_STORE_RECORDS) <= MUTABLE_STORAGE_KB * 1024, "Telemetry store larger than mutable storage");
+
+static TELEMETRY_STORE telemetry_store = {.capacity = TELEMETRY_STORE_RECORDS,
+                                          .order = TELEMETRY_BACKFILL_OLDEST_FIRST,
+                                          .backfill_interval_seconds = TELEMETRY_BACKFILL_INTERVAL_SECONDS,
+                                          .backfill_samples = TELEMETRY_BATCH_MAX_SAMPLES,
+                                          .fd = -1};
+
+// Built with the TELEMETRY_GZIP CMake option, messages of at least TELEMETRY_GZIP_MIN_BYTES are sent gzip compressed
+#define TELEMETRY_GZIP_MIN_BYTES 1024
+
+// The publish period adapts at runtime. It doubles with each failed publish up to TELEMETRY_MAX_PUBLISH_SECONDS, and
+// the period doubles (rate halves) while IoT Hub takes longer than TELEMETRY_PUBLISH_LATENCY_LIMIT_MS to confirm a
+// message. Otherwise it drops to TELEMETRY_FAST_PUBLISH_SECONDS for TELEMETRY_ANOMALY_HOLD_SECONDS after a reading
+// moves past its deadband and while the backlog drains. The period and the reason are sent with each message.
+#define TELEMETRY_PUBLISH_SECONDS 5
+#define TELEMETRY_FAST_PUBLISH_SECONDS 2
+#define TELEMETRY_MAX_PUBLISH_SECONDS 60
+#define TELEMETRY_ANOMALY_HOLD_SECONDS 60
+#define TELEMETRY_PUBLISH_LATENCY_LIMIT_MS 2000
+static TELEMETRY_RATE telemetry_rate = {.normal_seconds = TELEMETRY_PUBLISH_SECONDS,
+                                        .fast_seconds = TELEMETRY_FAST_PUBLISH_SECONDS,
+                                        .max_seconds = TELEMETRY_MAX_PUBLISH_SECONDS,
+                                        .anomaly_hold_seconds = TELEMETRY_ANOMALY_HOLD_SECONDS,
+                                        .latency_limit_ms = TELEMETRY_PUBLISH_LATENCY_LIMIT_MS};
+
+// Every telemetry message is tracked from enqueue to confirmation. Outcomes, retries, queue depth and latency
+// percentiles are published every TELEMETRY_HEALTH_SECONDS.
+#define TELEMETRY_HEALTH_SECONDS 300
+static TELEMETRY_HEALTH telemetry_health = {.rate = &telemetry_rate};
+static char healthBuffer[TELEMETRY_HEALTH_JSON_BYTES];
+
+static TELEMETRY_BATCH telemetry_batch = {.max_samples = TELEMETRY_BATCH_SIZE,
+                                          .max_age_seconds = TELEMETRY_BATCH_MAX_AGE_SECONDS,
+                                          .send = publish_telemetry_batch,
+                                          .gzip_min_bytes = TELEMETRY_GZIP_MIN_BYTES,
+                                          .store = &telemetry_store,
+                                          .rate = &telemetry_rate};
+
 DX_USER_CONFIG dx_config;
 bool azure_connected = false;
 ENVIRONMENT telemetry;
@@ -57,12 +130,37 @@ static char Log_Debug_Time_buffer[128];
 /// </summary>
 static DX_MESSAGE_PROPERTY *messageProperties[] = {&(DX_MESSAGE_PROPERTY){.key = "appid", .value = "hvac"},
                                                    &(DX_MESSAGE_PROPERTY){.key = "type", .value = "telemetry"},
-                                                   &(DX_MESSAGE_PROPERTY){.key = "schema", .value = "1"}};
+                                                   &(DX_MESSAGE_PROPERTY){.key = "schema", .value = "2"}};
 
 /// <summary>
 /// Common content properties for publish messages to IoT Hub/Central
 /// </summary>
-static DX_MESSAGE_CONTENT_PROPERTIES contentProperties = {.contentEncoding = "utf-8", .contentType = "application/json"};
+static DX_MESSAGE_CONTENT_PROPERTIES contentProperties = {.contentEncoding = TELEMETRY_CONTENT_ENCODING, .contentType = TELEMETRY_CONTENT_TYPE};
+
+/// <summary>
+/// Content properties for gzip compressed telemetry, the body is binary so IoT Hub message routing cannot query it
+/// </summary>
+static DX_MESSAGE_CONTENT_PROPERTIES gzipContentProperties = {.contentEncoding = "gzip", .contentType = TELEMETRY_CONTENT_TYPE};
+
+/// <summary>
+/// Telemetry pipeline health summaries are routed apart from the readings
+/// </summary>
+static DX_MESSAGE_PROPERTY *healthMessageProperties[] = {&(DX_MESSAGE_PROPERTY){.key = "appid", .value = "hvac"},
+                                                         &(DX_MESSAGE_PROPERTY){.key = "type", .value = "health"},
+                                                         &(DX_MESSAGE_PROPERTY){.key = "schema", .value = "1"}};
+static DX_MESSAGE_CONTENT_PROPERTIES healthContentProperties = {.contentEncoding = "utf-8", .contentType = "application/json"};
+
+// Reported properties changed in one update cycle are sent as a single patch
+static TWIN_BATCH twin_batch;
+
+// A burst of desired property updates, a slider dragged in IoT Central for example, is applied once the value has been
+// stable for the quiet period. Zero applies each update as it arrives.
+#define TARGET_TEMPERATURE_QUIET_MS 750
+
+// The target temperature the operating mode follows, only set by the debounced handler once the value is validated. The
+// binding value changes with every update of a burst.
+static bool target_temperature_applied = false;
+static int target_temperature;
 
 // declare device twin bindings
 static DX_DEVICE_TWIN_BINDING dt_hvac_humidity = {.propertyName = "HvacHumidity", .twinType = DX_DEVICE_TWIN_INT};
@@ -71,9 +169,17 @@ static DX_DEVICE_TWIN_BINDING dt_hvac_pressure = {.propertyName = "HvacPressure"
 static DX_DEVICE_TWIN_BINDING dt_hvac_start_utc = {.propertyName = "HvacStartupUtc", .twinType = DX_DEVICE_TWIN_STRING};
 static DX_DEVICE_TWIN_BINDING dt_hvac_sw_version = {.propertyName = "HvacSoftwareVersion", .twinType = DX_DEVICE_TWIN_STRING};
 static DX_DEVICE_TWIN_BINDING dt_hvac_target_temperature = {
-    .propertyName = "HvacTargetTemperature", .twinType = DX_DEVICE_TWIN_INT, .handler = dt_set_target_temperature_handler};
+    .propertyName = "HvacTargetTemperature", .twinType = DX_DEVICE_TWIN_INT, .handler = dt_debounce_handler};
 static DX_DEVICE_TWIN_BINDING dt_hvac_temperature = {.propertyName = "HvacTemperature", .twinType = DX_DEVICE_TWIN_INT};
 
+// Reported sensor properties are only written when they move past their band or hold a smaller change for the minimum
+// interval, and no more often than the minimum interval, so twin writes stay bounded however noisy the sensor
+#define TWIN_REPORT_MIN_INTERVAL_SECONDS 60
+static TWIN_HYSTERESIS report_temperature = {
+    .binding = &dt_hvac_temperature, .band = 1, .min_interval_seconds = TWIN_REPORT_MIN_INTERVAL_SECONDS};
+static TWIN_HYSTERESIS report_pressure = {.binding = &dt_hvac_pressure, .band = 2, .min_interval_seconds = TWIN_REPORT_MIN_INTERVAL_SECONDS};
+static TWIN_HYSTERESIS report_humidity = {.binding = &dt_hvac_humidity, .band = 2, .min_interval_seconds = TWIN_REPORT_MIN_INTERVAL_SECONDS};
+
 // declare gpio bindings
 DX_GPIO_BINDING gpio_network_led = {
     .pin = NETWORK_CONNECTED_LED, .name = "network_led", .direction = DX_OUTPUT, .initialState = GPIO_Value_Low, .invertPin = true};
@@ -90,10 +196,18 @@ static DX_GPIO_BINDING *gpio_ledRgb[] = {
 // declare timer bindings
 DX_TIMER_BINDING tmr_azure_status_led_off = {.name = "tmr_azure_status_led_off", .handler = azure_status_led_off_handler};
 DX_TIMER_BINDING tmr_azure_status_led_on = {.period = {0, 500 * ONE_MS}, .name = "tmr_azure_status_led_on", .handler = azure_status_led_on_handler};
-static DX_TIMER_BINDING tmr_publish_telemetry = {.period = {5, 0}, .name = "tmr_publish_telemetry", .handler = publish_telemetry_handler};
-static DX_TIMER_BINDING tmr_read_telemetry = {.period = {4, 0}, .name = "tmr_read_telemetry", .handler = read_telemetry_handler};
+static DX_TIMER_BINDING tmr_publish_health = {.period = {TELEMETRY_HEALTH_SECONDS, 0}, .name = "tmr_publish_health", .handler = publish_health_handler};
+static DX_TIMER_BINDING tmr_publish_telemetry = {.period = {TELEMETRY_PUBLISH_SECONDS, 0}, .name = "tmr_publish_telemetry", .handler = publish_telemetry_handler};
+static DX_TIMER_BINDING tmr_read_telemetry = {.period = {1, 0}, .name = "tmr_read_telemetry", .handler = read_telemetry_handler};
+static DX_TIMER_BINDING tmr_twin_debounce = {.name = "tmr_twin_debounce", .handler = twin_debounce_handler};
 static DX_TIMER_BINDING tmr_update_device_twins = {.period = {10, 0}, .name = "tmr_update_device_twins", .handler = update_device_twins};
 
+// Debounced desired properties, the binding handler is dt_debounce_handler
+static TWIN_DEBOUNCE debounce_target_temperature = {
+    .binding = &dt_hvac_target_temperature, .handler = dt_set_target_temperature_handler, .quiet_ms = TARGET_TEMPERATURE_QUIET_MS};
+static TWIN_DEBOUNCE_SET twin_debounce = {
+    .items = (TWIN_DEBOUNCE *[]){&debounce_target_temperature}, .count = 1, .timer = &tmr_twin_debounce};
+
 // All bindings referenced in the following binding sets are initialised in the
 // InitPeripheralsAndHandlers function
 DX_DEVICE_TWIN_BINDING *device_twin_bindings[] = {&dt_hvac_temperature,        &dt_hvac_pressure,   &dt_hvac_humidity, &dt_hvac_operating_mode,
@@ -101,6 +215,6 @@ DX_DEVICE_TWIN_BINDING *device_twin_bindings[] = {&dt_hvac_temperature,        &
 
 DX_DIRECT_METHOD_BINDING *direct_method_bindings[] = {};
 DX_GPIO_BINDING *gpio_bindings[] = {&gpio_network_led};
-DX_TIMER_BINDING *timer_bindings[] = {&tmr_publish_telemetry, &tmr_read_telemetry, &tmr_update_device_twins, &tmr_azure_status_led_off,
-                                      &tmr_azure_status_led_on};
+DX_TIMER_BINDING *timer_bindings[] = {&tmr_publish_health,       &tmr_publish_telemetry,  &tmr_read_telemetry, &tmr_update_device_twins,
+                                      &tmr_azure_status_led_off, &tmr_azure_status_led_on, &tmr_twin_debounce};
 DX_I2C_BINDING *i2c_bindings[] = {&i2c_onboard_sensors};
@@ -0,0 +1,242 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+#include "telemetry_batch.h"
+
+#include "dx_utilities.h"
+#include "telemetry_gzip.h"
+
+#include <applibs/applications.h>
+#include <math.h>
+
+// Worst case encoded size of a full batch, so encoding cannot run out of buffer
+static uint8_t batch_buffer[TELEMETRY_MAX_BYTES(TELEMETRY_BATCH_MAX_SAMPLES)];
+
+#ifdef TELEMETRY_GZIP
+// Compressor state and output are allocated once, about 8 KB plus one message
+static TELEMETRY_GZIP_STATE gzip_state;
+static uint8_t gzip_buffer[sizeof(batch_buffer)];
+#endif
+
+static time_t monotonic_seconds(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec;
+}
+
+static size_t batch_capacity(const TELEMETRY_BATCH *batch)
+{
+    return batch->max_samples > 0 && batch->max_samples < TELEMETRY_BATCH_MAX_SAMPLES ? batch->max_samples : TELEMETRY_BATCH_MAX_SAMPLES;
+}
+
+/// <summary>
+/// Encode readings in the configured wire format. The dropped and suppressed counts go with the live batch only, so
+/// backfill messages do not count them twice.
+/// </summary>
+static size_t encode_batch(TELEMETRY_BATCH *batch, const TELEMETRY_SAMPLE *samples, size_t head, size_t count, unsigned backlog, bool live)
+{
+    TELEMETRY_PAYLOAD payload = {.msgId = batch->msgId,
+                                 .peakUserMemoryKiB = (int)Applications_GetPeakUserModeMemoryUsageInKB(),
+                                 .totalMemoryKiB = (int)Applications_GetTotalMemoryUsageInKB(),
+                                 .samplesDropped = live ? batch->samples_dropped : 0,
+                                 .samplesSuppressed = live ? batch->samples_suppressed : 0,
+                                 .backlog = backlog,
+                                 .backlogDropped = batch->store ? batch->store->dropped_total : 0,
+                                 .publishPeriod = batch->rate ? (unsigned)batch->rate->period_seconds : 0,
+                                 .publishReason = batch->rate ? telemetry_rate_reason(batch->rate->reason) : "fixed",
+                                 .samples = samples,
+                                 .head = head,
+                                 .count = count};
+
+#ifdef TELEMETRY_CBOR
+    return telemetry_encode_cbor(&payload, batch_buffer, sizeof(batch_buffer));
+#else
+    return telemetry_encode_json(&payload, (char *)batch_buffer, sizeof(batch_buffer));
+#endif
+}
+
+static void log_message(TELEMETRY_BATCH *batch, size_t count, size_t length)
+{
+    dx_Log_Debug("Telemetry batch %d: %zu samples, %zu bytes\n", batch->msgId, count, length);
+#ifndef TELEMETRY_CBOR
+    dx_Log_Debug("%.*s\n", (int)length, (const char *)batch_buffer);
+#endif
+}
+
+/// <summary>
+/// Send an encoded message, gzip compressed when built with TELEMETRY_GZIP and the message is at least gzip_min_bytes.
+/// A message that does not get smaller is sent as is.
+/// </summary>
+static bool send_message(TELEMETRY_BATCH *batch, size_t length, unsigned flags)
+{
+#ifdef TELEMETRY_GZIP
+    if (batch->gzip_min_bytes > 0 && length >= batch->gzip_min_bytes)
+    {
+        struct timespec start, end;
+
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &start);
+        size_t compressed = telemetry_gzip(&gzip_state, batch_buffer, length, gzip_buffer, length - 1);
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &end);
+
+        long cpu_us = (long)(end.tv_sec - start.tv_sec) * 1000000 + (end.tv_nsec - start.tv_nsec) / 1000;
+
+        if (compressed > 0)
+        {
+            dx_Log_Debug("Telemetry gzip: %zu to %zu bytes, ratio %.2f, %ld us CPU\n", length, compressed, (double)length / compressed, cpu_us);
+            return batch->send(gzip_buffer, compressed, flags | TELEMETRY_SEND_GZIP);
+        }
+
+        dx_Log_Debug("Telemetry gzip: %zu bytes not smaller compressed, %ld us CPU\n", length, cpu_us);
+    }
+#endif
+
+    return batch->send(batch_buffer, length, flags);
+}
+
+/// <summary>
+/// Move the queued readings to the store and forward queue in one write
+/// </summary>
+static void move_to_store(TELEMETRY_BATCH *batch)
+{
+    TELEMETRY_SAMPLE samples[TELEMETRY_BATCH_MAX_SAMPLES];
+
+    for (size_t i = 0; i < batch->count; i++)
+    {
+        samples[i] = batch->samples[(batch->head + i) % TELEMETRY_BATCH_MAX_SAMPLES];
+    }
+
+    size_t lost = telemetry_store_push(batch->store, samples, batch->count);
+    dx_Log_Debug("Telemetry not sent, %zu readings stored, %zu lost, backlog %u\n", batch->count - lost, lost, batch->store->count);
+
+    batch->head = 0;
+    batch->count = 0;
+}
+
+/// <summary>
+/// Send one message of stored readings, at most one per backfill interval
+/// </summary>
+static bool backfill(TELEMETRY_BATCH *batch)
+{
+    TELEMETRY_STORE *store = batch->store;
+    TELEMETRY_SAMPLE samples[TELEMETRY_BATCH_MAX_SAMPLES];
+    size_t max_count = store && store->backfill_samples > 0 && store->backfill_samples < TELEMETRY_BATCH_MAX_SAMPLES ? store->backfill_samples
+                                                                                                                    : TELEMETRY_BATCH_MAX_SAMPLES;
+    uint32_t records_read;
+    size_t count, length;
+
+    if (store == NULL || store->count == 0 || monotonic_seconds() - store->last_backfill_monotonic < store->backfill_interval_seconds)
+    {
+        return false;
+    }
+
+    store->last_backfill_monotonic = monotonic_seconds();
+
+    if ((count = telemetry_store_peek(store, samples, max_count, &records_read)) == 0)
+    {
+        // nothing readable, drop the corrupt records
+        telemetry_store_consume(store, records_read);
+        return false;
+    }
+
+    if ((length = encode_batch(batch, samples, 0, count, store->count - records_read, false)) == 0 ||
+        !send_message(batch, length, TELEMETRY_SEND_BACKFILL))
+    {
+        return false;
+    }
+
+    telemetry_store_consume(store, records_read);
+    log_message(batch, count, length);
+    batch->msgId++;
+
+    return true;
+}
+
+static int field_stats(const RUNNING_STATS *stats, TELEMETRY_FIELD_STATS *field)
+{
+    field->mean_x100 = (int32_t)lround(stats->mean * 100);
+    field->min = stats->min;
+    field->max = stats->max;
+    field->stddev_x100 = (uint32_t)lround(running_stats_stddev(stats) * 100);
+
+    return running_stats_mean(stats);
+}
+
+void telemetry_batch_add(TELEMETRY_BATCH *batch, const TELEMETRY_WINDOW *window)
+{
+    if (batch->count == batch_capacity(batch))
+    {
+        // Not able to send, keep the most recent readings
+        batch->head = (batch->head + 1) % TELEMETRY_BATCH_MAX_SAMPLES;
+        batch->count--;
+        batch->samples_dropped++;
+    }
+
+    if (batch->count == 0)
+    {
+        batch->oldest_monotonic = monotonic_seconds();
+    }
+
+    TELEMETRY_SAMPLE *sample = &batch->samples[(batch->head + batch->count) % TELEMETRY_BATCH_MAX_SAMPLES];
+    sample->timestamp = window->timestamp;
+    sample->count = window->temperature.count;
+    sample->temperature = field_stats(&window->temperature, &sample->temperature_stats);
+    sample->pressure = field_stats(&window->pressure, &sample->pressure_stats);
+    sample->humidity = field_stats(&window->humidity, &sample->humidity_stats);
+
+    batch->count++;
+}
+
+void telemetry_batch_suppress(TELEMETRY_BATCH *batch)
+{
+    batch->samples_suppressed++;
+}
+
+bool telemetry_batch_flush(TELEMETRY_BATCH *batch)
+{
+    size_t length;
+
+    if (batch->count == 0)
+    {
+        return false;
+    }
+
+    // batch_buffer holds the worst case full batch, so this only fails on a corrupt batch
+    if ((length = encode_batch(batch, batch->samples, batch->head, batch->count, batch->store ? batch->store->count : 0, true)) == 0)
+    {
+        dx_Log_Debug("Telemetry serialization failed\n");
+        return false;
+    }
+
+    if (!send_message(batch, length, 0))
+    {
+        if (batch->store)
+        {
+            move_to_store(batch);
+        }
+        return false;
+    }
+
+    log_message(batch, batch->count, length);
+
+    batch->msgId++;
+    batch->head = 0;
+    batch->count = 0;
+    batch->samples_dropped = 0;
+    batch->samples_suppressed = 0;
+
+    return true;
+}
+
+bool telemetry_batch_flush_if_due(TELEMETRY_BATCH *batch)
+{
+    bool sent = false;
+
+    if (batch->count > 0 &&
+        (batch->count >= batch_capacity(batch) || monotonic_seconds() - batch->oldest_monotonic >= batch->max_age_seconds))
+    {
+        sent = telemetry_batch_flush(batch);
+    }
+
+    return backfill(batch) || sent;
+}
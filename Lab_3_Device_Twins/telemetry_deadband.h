@@ -0,0 +1,48 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+typedef enum
+{
+    DEADBAND_ABSOLUTE, // threshold in the units of the field
+    DEADBAND_PERCENT   // threshold in percent of the last reported value
+} DEADBAND_MODE;
+
+typedef struct
+{
+    DEADBAND_MODE mode;
+    double threshold; // zero reports every change
+} FIELD_DEADBAND;
+
+typedef struct
+{
+    FIELD_DEADBAND temperature;
+    FIELD_DEADBAND pressure;
+    FIELD_DEADBAND humidity;
+    int heartbeat_seconds; // longest silence, a reading is reported when this expires even if nothing moved
+    bool reported_valid;
+    int reported_temperature;
+    int reported_pressure;
+    int reported_humidity;
+    time_t reported_monotonic;
+    uint32_t readings; // readings checked
+    uint32_t reports;  // readings that crossed a deadband or the heartbeat
+    bool moved;        // the last reading crossed a deadband, false for the first reading and heartbeats
+} TELEMETRY_DEADBAND;
+
+/// <summary>
+/// Decide if a reading is reported. A field is compared with its last reported value, not the previous reading, so a
+/// slow drift is reported once it adds up to the deadband.
+/// </summary>
+/// <returns>true if a field crossed its deadband or the heartbeat expired, the reading is then the new reference</returns>
+bool telemetry_deadband_check(TELEMETRY_DEADBAND *deadband, int temperature, int pressure, int humidity);
+
+/// <summary>
+/// Percentage of readings suppressed since start
+/// </summary>
+unsigned telemetry_deadband_suppressed_percent(const TELEMETRY_DEADBAND *deadband);
@@ -0,0 +1,57 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+#pragma once
+
+#include "dx_device_twins.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Reported properties one patch can carry
+#define TWIN_BATCH_MAX_PROPERTIES 8
+// Longest string property value, including the terminator
+#define TWIN_BATCH_STRING_BYTES 64
+// Largest reported properties patch
+#define TWIN_BATCH_JSON_BYTES 512
+
+typedef struct
+{
+    DX_DEVICE_TWIN_BINDING *binding;
+    union
+    {
+        bool b;
+        int i;
+        double d; // float and double
+        char s[TWIN_BATCH_STRING_BYTES];
+    } value;
+} TWIN_BATCH_PROPERTY;
+
+/// <summary>
+/// Reported properties changed during one update cycle, sent as a single JSON patch rather than one report each
+/// </summary>
+typedef struct
+{
+    TWIN_BATCH_PROPERTY properties[TWIN_BATCH_MAX_PROPERTIES];
+    size_t count;
+    // Since start
+    unsigned patches_sent;
+    unsigned patches_acked;
+    unsigned patches_failed;
+    unsigned properties_sent;
+    unsigned properties_coalesced; // replaced by a newer value before they were sent
+    unsigned long bytes_sent;
+} TWIN_BATCH;
+
+/// <summary>
+/// Queue a reported property. value points to the type the binding declares, as for dx_deviceTwinReportValue.
+/// A newer value for a binding already queued replaces the old one.
+/// </summary>
+/// <returns>false if the type is not supported, the string is too long or the batch is full</returns>
+bool twin_batch_add(TWIN_BATCH *batch, DX_DEVICE_TWIN_BINDING *binding, const void *value);
+
+/// <summary>
+/// Send the queued properties as one reported properties patch, they stay queued if it cannot be sent
+/// </summary>
+/// <returns>true if there was nothing to send or the patch was handed to the SDK</returns>
+bool twin_batch_send(TWIN_BATCH *batch);
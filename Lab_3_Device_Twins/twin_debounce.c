@@ -0,0 +1,102 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+#include "twin_debounce.h"
+
+#include "dx_utilities.h"
+
+#define NS_PER_SECOND 1000000000L
+
+static bool reached(const struct timespec *now, const struct timespec *when)
+{
+    return now->tv_sec > when->tv_sec || (now->tv_sec == when->tv_sec && now->tv_nsec >= when->tv_nsec);
+}
+
+static void apply(TWIN_DEBOUNCE *item)
+{
+    item->pending = false;
+    item->applied++;
+    item->superseded += item->updates - 1;
+
+    if (item->updates > 1)
+    {
+        dx_Log_Debug("%s: applied version %d, %u updates superseded\n", item->binding->propertyName, item->binding->propertyVersion,
+                     item->updates - 1);
+    }
+
+    item->updates = 0;
+    item->handler(item->binding);
+}
+
+/// <summary>
+/// One shot to the earliest pending quiet period
+/// </summary>
+static void arm_timer(TWIN_DEBOUNCE_SET *set, const struct timespec *now)
+{
+    const struct timespec *next = NULL;
+
+    for (size_t i = 0; i < set->count; i++)
+    {
+        if (set->items[i]->pending && (next == NULL || reached(next, &set->items[i]->apply_at)))
+        {
+            next = &set->items[i]->apply_at;
+        }
+    }
+
+    if (next != NULL)
+    {
+        long ns = (long)(next->tv_sec - now->tv_sec) * NS_PER_SECOND + (next->tv_nsec - now->tv_nsec);
+        ns = ns > 0 ? ns : 1;
+        dx_timerOneShotSet(set->timer, &(struct timespec){ns / NS_PER_SECOND, ns % NS_PER_SECOND});
+    }
+}
+
+void twin_debounce_update(TWIN_DEBOUNCE_SET *set, DX_DEVICE_TWIN_BINDING *binding)
+{
+    struct timespec now;
+
+    for (size_t i = 0; i < set->count; i++)
+    {
+        TWIN_DEBOUNCE *item = set->items[i];
+
+        if (item->binding != binding)
+        {
+            continue;
+        }
+
+        item->updates++;
+
+        if (item->quiet_ms == 0)
+        {
+            apply(item);
+            return;
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &now);
+
+        long ns = now.tv_nsec + (long)(item->quiet_ms % 1000) * 1000000;
+        item->apply_at.tv_sec = now.tv_sec + (time_t)(item->quiet_ms / 1000) + ns / NS_PER_SECOND;
+        item->apply_at.tv_nsec = ns % NS_PER_SECOND;
+        item->pending = true;
+
+        arm_timer(set, &now);
+        return;
+    }
+}
+
+void twin_debounce_timer(TWIN_DEBOUNCE_SET *set)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    for (size_t i = 0; i < set->count; i++)
+    {
+        if (set->items[i]->pending && reached(&now, &set->items[i]->apply_at))
+        {
+            apply(set->items[i]);
+        }
+    }
+
+    arm_timer(set, &now);
+}
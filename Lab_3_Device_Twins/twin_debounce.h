@@ -0,0 +1,47 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+#pragma once
+
+#include "dx_device_twins.h"
+#include "dx_timer.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <time.h>
+
+typedef void (*TWIN_DEBOUNCE_HANDLER)(DX_DEVICE_TWIN_BINDING *deviceTwinBinding);
+
+/// <summary>
+/// A desired property applied once its value has been stable for quiet_ms. DevX keeps the latest value and version in
+/// the binding, so the handler applies and acknowledges only the final value, and that one acknowledgement covers the
+/// versions it superseded.
+/// </summary>
+typedef struct
+{
+    DX_DEVICE_TWIN_BINDING *binding;
+    TWIN_DEBOUNCE_HANDLER handler;
+    unsigned quiet_ms; // zero applies every update straight away
+    bool pending;
+    struct timespec apply_at; // CLOCK_MONOTONIC
+    unsigned updates;         // received since the last apply
+    unsigned applied;
+    unsigned superseded;
+} TWIN_DEBOUNCE;
+
+typedef struct
+{
+    TWIN_DEBOUNCE **items;
+    size_t count;
+    DX_TIMER_BINDING *timer; // one shot, its handler calls twin_debounce_timer
+} TWIN_DEBOUNCE_SET;
+
+/// <summary>
+/// Device twin binding handler for the debounced bindings, starts or restarts the quiet period
+/// </summary>
+void twin_debounce_update(TWIN_DEBOUNCE_SET *set, DX_DEVICE_TWIN_BINDING *binding);
+
+/// <summary>
+/// Apply the bindings whose quiet period has passed, then arm the timer for the next one
+/// </summary>
+void twin_debounce_timer(TWIN_DEBOUNCE_SET *set);
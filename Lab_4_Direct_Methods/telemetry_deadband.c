@@ -0,0 +1,60 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+#include "telemetry_deadband.h"
+
+#include <stdlib.h>
+
+static time_t monotonic_seconds(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec;
+}
+
+static bool crossed(const FIELD_DEADBAND *deadband, int reported, int value)
+{
+    double change = abs(value - reported);
+
+    if (value == reported)
+    {
+        return false;
+    }
+
+    if (deadband->mode == DEADBAND_PERCENT)
+    {
+        // any change from a zero reference is reported
+        return reported == 0 || change * 100.0 >= deadband->threshold * abs(reported);
+    }
+
+    return change >= deadband->threshold;
+}
+
+bool telemetry_deadband_check(TELEMETRY_DEADBAND *deadband, int temperature, int pressure, int humidity)
+{
+    time_t now = monotonic_seconds();
+
+    deadband->readings++;
+    deadband->moved = deadband->reported_valid && (crossed(&deadband->temperature, deadband->reported_temperature, temperature) ||
+                                                   crossed(&deadband->pressure, deadband->reported_pressure, pressure) ||
+                                                   crossed(&deadband->humidity, deadband->reported_humidity, humidity));
+
+    if (deadband->reported_valid && !deadband->moved && now - deadband->reported_monotonic < deadband->heartbeat_seconds)
+    {
+        return false;
+    }
+
+    deadband->reported_valid = true;
+    deadband->reported_temperature = temperature;
+    deadband->reported_pressure = pressure;
+    deadband->reported_humidity = humidity;
+    deadband->reported_monotonic = now;
+    deadband->reports++;
+
+    return true;
+}
+
+unsigned telemetry_deadband_suppressed_percent(const TELEMETRY_DEADBAND *deadband)
+{
+    return deadband->readings ? (unsigned)((uint64_t)(deadband->readings - deadband->reports) * 100 / deadband->readings) : 0;
+}
@@ -0,0 +1,429 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+#include "telemetry_encode.h"
+
+#include <string.h>
+
+// CBOR major types, RFC 8949 section 3.1
+#define CBOR_UNSIGNED 0
+#define CBOR_NEGATIVE 1
+#define CBOR_TEXT 3
+#define CBOR_ARRAY 4
+#define CBOR_MAP 5
+#define CBOR_TAG 6
+
+#define CBOR_TAG_EPOCH_TIME 1
+#define CBOR_FLOAT64 0xFB
+
+typedef struct
+{
+    uint8_t *data;
+    size_t size;
+    size_t offset;
+    bool overflow;
+} CBOR_WRITER;
+
+/// <summary>
+/// Length of an identifier string, cut at TELEMETRY_TEXT_MAX characters, zero for NULL
+/// </summary>
+static size_t text_length(const char *text)
+{
+    size_t length = 0;
+
+    while (text && length < TELEMETRY_TEXT_MAX && text[length] != '\0')
+    {
+        length++;
+    }
+    return length;
+}
+
+static inline const TELEMETRY_SAMPLE *payload_sample(const TELEMETRY_PAYLOAD *payload, size_t i)
+{
+    return &payload->samples[(payload->head + i) % TELEMETRY_BATCH_MAX_SAMPLES];
+}
+
+// Two digits per division for the integer to text conversion
+static const char digit_pairs[] = "00010203040506070809"
+                                  "10111213141516171819"
+                                  "20212223242526272829"
+                                  "30313233343536373839"
+                                  "40414243444546474849"
+                                  "50515253545556575859"
+                                  "60616263646566676869"
+                                  "70717273747576777879"
+                                  "80818283848586878889"
+                                  "90919293949596979899";
+
+#define WRITE_LITERAL(out, text) (memcpy((out), (text), sizeof(text) - 1), (out) + sizeof(text) - 1)
+
+static char *write_uint(char *out, uint32_t value)
+{
+    char digits[10];
+    char *first = digits + sizeof(digits);
+
+    while (value >= 100)
+    {
+        const char *pair = &digit_pairs[(value % 100) * 2];
+        value /= 100;
+        *--first = pair[1];
+        *--first = pair[0];
+    }
+
+    if (value >= 10)
+    {
+        *--first = digit_pairs[value * 2 + 1];
+        *--first = digit_pairs[value * 2];
+    }
+    else
+    {
+        *--first = (char)('0' + value);
+    }
+
+    size_t length = (size_t)(digits + sizeof(digits) - first);
+    memcpy(out, first, length);
+    return out + length;
+}
+
+static char *write_int(char *out, int32_t value)
+{
+    if (value < 0)
+    {
+        *out++ = '-';
+        return write_uint(out, 0u - (uint32_t)value);
+    }
+    return write_uint(out, (uint32_t)value);
+}
+
+/// <summary>
+/// Zero padded, exactly width digits
+/// </summary>
+static char *write_fixed(char *out, uint32_t value, int width)
+{
+    for (int i = width - 1; i >= 0; i--)
+    {
+        out[i] = (char)('0' + value % 10);
+        value /= 10;
+    }
+    return out + width;
+}
+
+/// <summary>
+/// Value scaled by 100 as a decimal with two places
+/// </summary>
+static char *write_ufixed_point(char *out, uint32_t value_x100)
+{
+    out = write_uint(out, value_x100 / 100);
+    *out++ = '.';
+    return write_fixed(out, value_x100 % 100, 2);
+}
+
+static char *write_fixed_point(char *out, int32_t value_x100)
+{
+    if (value_x100 < 0)
+    {
+        *out++ = '-';
+        return write_ufixed_point(out, 0u - (uint32_t)value_x100);
+    }
+    return write_ufixed_point(out, (uint32_t)value_x100);
+}
+
+// ,"<field>Mean":n.nn,"<field>Min":n,"<field>Max":n,"<field>StdDev":n.nn
+#define WRITE_FIELD_STATS(out, field, stats)                                                                                               \
+    do                                                                                                                                     \
+    {                                                                                                                                      \
+        out = WRITE_LITERAL(out, ",\"" field TELEMETRY_JSON_MEAN);                                                                         \
+        out = write_fixed_point(out, (stats)->mean_x100);                                                                                  \
+        out = WRITE_LITERAL(out, ",\"" field TELEMETRY_JSON_MIN);                                                                          \
+        out = write_int(out, (stats)->min);                                                                                                \
+        out = WRITE_LITERAL(out, ",\"" field TELEMETRY_JSON_MAX);                                                                          \
+        out = write_int(out, (stats)->max);                                                                                                \
+        out = WRITE_LITERAL(out, ",\"" field TELEMETRY_JSON_STDDEV);                                                                       \
+        out = write_ufixed_point(out, (stats)->stddev_x100);                                                                               \
+    } while (0)
+
+/// <summary>
+/// Quoted, at most TELEMETRY_TEXT_MAX characters. Only used for identifiers, nothing is escaped.
+/// </summary>
+static char *write_text(char *out, const char *text)
+{
+    size_t length = text_length(text);
+
+    *out++ = '"';
+    for (size_t i = 0; i < length; i++)
+    {
+        *out++ = text[i];
+    }
+    *out++ = '"';
+
+    return out;
+}
+
+/// <summary>
+/// "2021-01-01T00:00:00.000Z"
+/// </summary>
+static char *write_timestamp(char *out, const struct timespec *timestamp)
+{
+    struct tm utc;
+    gmtime_r(&timestamp->tv_sec, &utc);
+
+    *out++ = '"';
+    out = write_fixed(out, (uint32_t)(utc.tm_year + 1900), 4);
+    *out++ = '-';
+    out = write_fixed(out, (uint32_t)(utc.tm_mon + 1), 2);
+    *out++ = '-';
+    out = write_fixed(out, (uint32_t)utc.tm_mday, 2);
+    *out++ = 'T';
+    out = write_fixed(out, (uint32_t)utc.tm_hour, 2);
+    *out++ = ':';
+    out = write_fixed(out, (uint32_t)utc.tm_min, 2);
+    *out++ = ':';
+    out = write_fixed(out, (uint32_t)utc.tm_sec, 2);
+    *out++ = '.';
+    out = write_fixed(out, (uint32_t)(timestamp->tv_nsec / 1000000), 3);
+    *out++ = 'Z';
+    *out++ = '"';
+
+    return out;
+}
+
+size_t telemetry_encode_json(const TELEMETRY_PAYLOAD *payload, char *buffer, size_t buffer_size)
+{
+    // One size check up front, the writes below are unchecked
+    if (payload->count > TELEMETRY_BATCH_MAX_SAMPLES || buffer_size < TELEMETRY_JSON_MAX_BYTES(payload->count))
+    {
+        return 0;
+    }
+
+    char *out = buffer;
+
+    out = WRITE_LITERAL(out, TELEMETRY_JSON_MSG_ID);
+    out = write_int(out, payload->msgId);
+    out = WRITE_LITERAL(out, TELEMETRY_JSON_PEAK_MEMORY);
+    out = write_int(out, payload->peakUserMemoryKiB);
+    out = WRITE_LITERAL(out, TELEMETRY_JSON_TOTAL_MEMORY);
+    out = write_int(out, payload->totalMemoryKiB);
+    out = WRITE_LITERAL(out, TELEMETRY_JSON_SAMPLES_DROPPED);
+    out = write_uint(out, payload->samplesDropped);
+    out = WRITE_LITERAL(out, TELEMETRY_JSON_SAMPLES_SUPPRESSED);
+    out = write_uint(out, payload->samplesSuppressed);
+    out = WRITE_LITERAL(out, TELEMETRY_JSON_BACKLOG);
+    out = write_uint(out, payload->backlog);
+    out = WRITE_LITERAL(out, TELEMETRY_JSON_BACKLOG_DROPPED);
+    out = write_uint(out, payload->backlogDropped);
+    out = WRITE_LITERAL(out, TELEMETRY_JSON_PUBLISH_PERIOD);
+    out = write_uint(out, payload->publishPeriod);
+    out = WRITE_LITERAL(out, TELEMETRY_JSON_PUBLISH_REASON);
+    out = write_text(out, payload->publishReason);
+    out = WRITE_LITERAL(out, TELEMETRY_JSON_SAMPLES);
+
+    for (size_t i = 0; i < payload->count; i++)
+    {
+        const TELEMETRY_SAMPLE *sample = payload_sample(payload, i);
+
+        if (i > 0)
+        {
+            *out++ = ',';
+        }
+
+        out = WRITE_LITERAL(out, TELEMETRY_JSON_TIMESTAMP);
+        out = write_timestamp(out, &sample->timestamp);
+        out = WRITE_LITERAL(out, TELEMETRY_JSON_TEMPERATURE);
+        out = write_int(out, sample->temperature);
+        out = WRITE_LITERAL(out, TELEMETRY_JSON_PRESSURE);
+        out = write_int(out, sample->pressure);
+        out = WRITE_LITERAL(out, TELEMETRY_JSON_HUMIDITY);
+        out = write_int(out, sample->humidity);
+
+        if (sample->count > 0)
+        {
+            out = WRITE_LITERAL(out, TELEMETRY_JSON_COUNT);
+            out = write_uint(out, sample->count);
+            WRITE_FIELD_STATS(out, "temperature", &sample->temperature_stats);
+            WRITE_FIELD_STATS(out, "pressure", &sample->pressure_stats);
+            WRITE_FIELD_STATS(out, "humidity", &sample->humidity_stats);
+        }
+
+        *out++ = '}';
+    }
+
+    out = WRITE_LITERAL(out, TELEMETRY_JSON_END);
+
+    return (size_t)(out - buffer);
+}
+
+static void cbor_put(CBOR_WRITER *writer, const uint8_t *bytes, size_t length)
+{
+    if (writer->overflow || length > writer->size - writer->offset)
+    {
+        writer->overflow = true;
+        return;
+    }
+
+    memcpy(writer->data + writer->offset, bytes, length);
+    writer->offset += length;
+}
+
+/// <summary>
+/// Initial byte plus the shortest argument encoding, RFC 8949 section 3
+/// </summary>
+static void cbor_head(CBOR_WRITER *writer, uint8_t major_type, uint64_t value)
+{
+    uint8_t head[9];
+    size_t argument_bytes;
+
+    if (value < 24)
+    {
+        head[0] = (uint8_t)(major_type << 5 | value);
+        cbor_put(writer, head, 1);
+        return;
+    }
+
+    if (value <= UINT8_MAX)
+    {
+        head[0] = (uint8_t)(major_type << 5 | 24);
+        argument_bytes = 1;
+    }
+    else if (value <= UINT16_MAX)
+    {
+        head[0] = (uint8_t)(major_type << 5 | 25);
+        argument_bytes = 2;
+    }
+    else if (value <= UINT32_MAX)
+    {
+        head[0] = (uint8_t)(major_type << 5 | 26);
+        argument_bytes = 4;
+    }
+    else
+    {
+        head[0] = (uint8_t)(major_type << 5 | 27);
+        argument_bytes = 8;
+    }
+
+    // network byte order
+    for (size_t i = 0; i < argument_bytes; i++)
+    {
+        head[argument_bytes - i] = (uint8_t)(value >> (8 * i));
+    }
+
+    cbor_put(writer, head, 1 + argument_bytes);
+}
+
+static void cbor_int(CBOR_WRITER *writer, int64_t value)
+{
+    if (value >= 0)
+    {
+        cbor_head(writer, CBOR_UNSIGNED, (uint64_t)value);
+    }
+    else
+    {
+        // negative integers are encoded as -1 - n
+        cbor_head(writer, CBOR_NEGATIVE, (uint64_t)(-(value + 1)));
+    }
+}
+
+static void cbor_text(CBOR_WRITER *writer, const char *text)
+{
+    size_t length = strlen(text);
+
+    cbor_head(writer, CBOR_TEXT, length);
+    cbor_put(writer, (const uint8_t *)text, length);
+}
+
+/// <summary>
+/// Text string cut at TELEMETRY_TEXT_MAX characters, an empty string for NULL
+/// </summary>
+static void cbor_identifier(CBOR_WRITER *writer, const char *text)
+{
+    size_t length = text_length(text);
+
+    cbor_head(writer, CBOR_TEXT, length);
+    if (length > 0)
+    {
+        cbor_put(writer, (const uint8_t *)text, length);
+    }
+}
+
+static void cbor_double(CBOR_WRITER *writer, double value)
+{
+    uint8_t encoded[9] = {CBOR_FLOAT64};
+    uint64_t bits;
+
+    memcpy(&bits, &value, sizeof(bits));
+    for (size_t i = 0; i < 8; i++)
+    {
+        encoded[8 - i] = (uint8_t)(bits >> (8 * i));
+    }
+
+    cbor_put(writer, encoded, sizeof(encoded));
+}
+
+static void cbor_field_stats(CBOR_WRITER *writer, const char *mean_key, const char *min_key, const char *max_key, const char *stddev_key,
+                             const TELEMETRY_FIELD_STATS *stats)
+{
+    cbor_text(writer, mean_key);
+    cbor_double(writer, stats->mean_x100 / 100.0);
+    cbor_text(writer, min_key);
+    cbor_int(writer, stats->min);
+    cbor_text(writer, max_key);
+    cbor_int(writer, stats->max);
+    cbor_text(writer, stddev_key);
+    cbor_double(writer, stats->stddev_x100 / 100.0);
+}
+
+size_t telemetry_encode_cbor(const TELEMETRY_PAYLOAD *payload, uint8_t *buffer, size_t buffer_size)
+{
+    CBOR_WRITER writer = {.data = buffer, .size = buffer_size};
+
+    cbor_head(&writer, CBOR_MAP, 10);
+    cbor_text(&writer, "msgId");
+    cbor_int(&writer, payload->msgId);
+    cbor_text(&writer, "peakUserMemoryKiB");
+    cbor_int(&writer, payload->peakUserMemoryKiB);
+    cbor_text(&writer, "totalMemoryKiB");
+    cbor_int(&writer, payload->totalMemoryKiB);
+    cbor_text(&writer, "samplesDropped");
+    cbor_int(&writer, payload->samplesDropped);
+    cbor_text(&writer, "samplesSuppressed");
+    cbor_int(&writer, payload->samplesSuppressed);
+    cbor_text(&writer, "backlog");
+    cbor_int(&writer, payload->backlog);
+    cbor_text(&writer, "backlogDropped");
+    cbor_int(&writer, payload->backlogDropped);
+    cbor_text(&writer, "publishPeriod");
+    cbor_int(&writer, payload->publishPeriod);
+    cbor_text(&writer, "publishReason");
+    cbor_identifier(&writer, payload->publishReason);
+
+    cbor_text(&writer, "samples");
+    cbor_head(&writer, CBOR_ARRAY, payload->count);
+
+    for (size_t i = 0; i < payload->count; i++)
+    {
+        const TELEMETRY_SAMPLE *sample = payload_sample(payload, i);
+
+        // the count and the four statistics of each field are only sent with window statistics
+        cbor_head(&writer, CBOR_MAP, sample->count > 0 ? 4 + 1 + 3 * 4 : 4);
+        cbor_text(&writer, "timestamp");
+        cbor_head(&writer, CBOR_TAG, CBOR_TAG_EPOCH_TIME);
+        cbor_double(&writer, (double)sample->timestamp.tv_sec + (double)(sample->timestamp.tv_nsec / 1000000) / 1000.0);
+        cbor_text(&writer, "temperature");
+        cbor_int(&writer, sample->temperature);
+        cbor_text(&writer, "pressure");
+        cbor_int(&writer, sample->pressure);
+        cbor_text(&writer, "humidity");
+        cbor_int(&writer, sample->humidity);
+
+        if (sample->count > 0)
+        {
+            cbor_text(&writer, "count");
+            cbor_int(&writer, sample->count);
+            cbor_field_stats(&writer, "temperatureMean", "temperatureMin", "temperatureMax", "temperatureStdDev",
+                             &sample->temperature_stats);
+            cbor_field_stats(&writer, "pressureMean", "pressureMin", "pressureMax", "pressureStdDev", &sample->pressure_stats);
+            cbor_field_stats(&writer, "humidityMean", "humidityMin", "humidityMax", "humidityStdDev", &sample->humidity_stats);
+        }
+    }
+
+    return writer.overflow ? 0 : writer.offset;
+}
@@ -0,0 +1,145 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+// Upper limit for TELEMETRY_BATCH.max_samples, a full batch of typical readings stays within one 4 KB IoT Hub metering unit
+#define TELEMETRY_BATCH_MAX_SAMPLES 32
+
+// Telemetry wire format, selected per deployment with the TELEMETRY_CBOR CMake option
+#ifdef TELEMETRY_CBOR
+#define TELEMETRY_CONTENT_TYPE "application/cbor"
+#define TELEMETRY_CONTENT_ENCODING NULL // binary body, IoT Hub message routing can only query utf-8 JSON bodies
+#else
+#define TELEMETRY_CONTENT_TYPE "application/json"
+#define TELEMETRY_CONTENT_ENCODING "utf-8"
+#endif
+
+// Spread of one field over a publish window, values scaled by 100 keep two decimals
+typedef struct
+{
+    int32_t mean_x100;
+    int min;
+    int max;
+    uint32_t stddev_x100;
+} TELEMETRY_FIELD_STATS;
+
+typedef struct
+{
+    struct timespec timestamp;
+    int temperature; // window mean, rounded
+    int pressure;
+    int humidity;
+    uint32_t count; // readings in the window, zero when only the mean is known (backfilled from the store)
+    TELEMETRY_FIELD_STATS temperature_stats;
+    TELEMETRY_FIELD_STATS pressure_stats;
+    TELEMETRY_FIELD_STATS humidity_stats;
+} TELEMETRY_SAMPLE;
+
+typedef struct
+{
+    int msgId;
+    int peakUserMemoryKiB;
+    int totalMemoryKiB;
+    unsigned samplesDropped;
+    unsigned samplesSuppressed;      // readings within their deadband since the previous message
+    unsigned backlog;                // readings waiting in the store and forward queue
+    unsigned backlogDropped;         // readings the store and forward queue has lost, total
+    unsigned publishPeriod;          // current publish timer period in seconds
+    const char *publishReason;       // why the publish period was last changed, up to TELEMETRY_TEXT_MAX characters
+    const TELEMETRY_SAMPLE *samples; // ring of TELEMETRY_BATCH_MAX_SAMPLES entries
+    size_t head;                     // index of the oldest sample
+    size_t count;
+} TELEMETRY_PAYLOAD;
+
+// JSON text between the values, the encoder copies these as is
+#define TELEMETRY_JSON_MSG_ID "{\"msgId\":"
+#define TELEMETRY_JSON_PEAK_MEMORY ",\"peakUserMemoryKiB\":"
+#define TELEMETRY_JSON_TOTAL_MEMORY ",\"totalMemoryKiB\":"
+#define TELEMETRY_JSON_SAMPLES_DROPPED ",\"samplesDropped\":"
+#define TELEMETRY_JSON_SAMPLES_SUPPRESSED ",\"samplesSuppressed\":"
+#define TELEMETRY_JSON_BACKLOG ",\"backlog\":"
+#define TELEMETRY_JSON_BACKLOG_DROPPED ",\"backlogDropped\":"
+#define TELEMETRY_JSON_PUBLISH_PERIOD ",\"publishPeriod\":"
+#define TELEMETRY_JSON_PUBLISH_REASON ",\"publishReason\":"
+#define TELEMETRY_JSON_SAMPLES ",\"samples\":["
+#define TELEMETRY_JSON_TIMESTAMP "{\"timestamp\":"
+#define TELEMETRY_JSON_TEMPERATURE ",\"temperature\":"
+#define TELEMETRY_JSON_PRESSURE ",\"pressure\":"
+#define TELEMETRY_JSON_HUMIDITY ",\"humidity\":"
+#define TELEMETRY_JSON_COUNT ",\"count\":"
+#define TELEMETRY_JSON_MEAN "Mean\":"
+#define TELEMETRY_JSON_MIN "Min\":"
+#define TELEMETRY_JSON_MAX "Max\":"
+#define TELEMETRY_JSON_STDDEV "StdDev\":"
+#define TELEMETRY_JSON_END "]}"
+
+// Worst case encoded sizes, used to size the message buffer at compile time
+#define TELEMETRY_LITERAL_BYTES(text) (sizeof(text) - 1)
+#define TELEMETRY_INT_TEXT_MAX TELEMETRY_LITERAL_BYTES("-2147483648")
+#define TELEMETRY_TEXT_MAX 15 // short identifier strings, copied without escaping and cut at this length
+#define TELEMETRY_FIXED_TEXT_MAX TELEMETRY_LITERAL_BYTES("-21474836.48")
+#define TELEMETRY_TIMESTAMP_TEXT_MAX TELEMETRY_LITERAL_BYTES("\"2021-01-01T00:00:00.000Z\"")
+
+#define TELEMETRY_JSON_HEADER_MAX                                                                                                          \
+    (TELEMETRY_LITERAL_BYTES(TELEMETRY_JSON_MSG_ID TELEMETRY_JSON_PEAK_MEMORY TELEMETRY_JSON_TOTAL_MEMORY TELEMETRY_JSON_SAMPLES_DROPPED   \
+                                 TELEMETRY_JSON_SAMPLES_SUPPRESSED TELEMETRY_JSON_BACKLOG TELEMETRY_JSON_BACKLOG_DROPPED                   \
+                                 TELEMETRY_JSON_PUBLISH_PERIOD TELEMETRY_JSON_PUBLISH_REASON TELEMETRY_JSON_SAMPLES TELEMETRY_JSON_END) +  \
+     8 * TELEMETRY_INT_TEXT_MAX + 2 + TELEMETRY_TEXT_MAX)
+// ,"temperatureMean":n,"temperatureMin":n,"temperatureMax":n,"temperatureStdDev":n
+#define TELEMETRY_JSON_FIELD_STATS_MAX(field)                                                                                              \
+    (TELEMETRY_LITERAL_BYTES(",\"" field TELEMETRY_JSON_MEAN ",\"" field TELEMETRY_JSON_MIN ",\"" field TELEMETRY_JSON_MAX ",\"" field     \
+                                 TELEMETRY_JSON_STDDEV) +                                                                                  \
+     2 * TELEMETRY_FIXED_TEXT_MAX + 2 * TELEMETRY_INT_TEXT_MAX)
+#define TELEMETRY_JSON_SAMPLE_MAX                                                                                                          \
+    (TELEMETRY_LITERAL_BYTES("," TELEMETRY_JSON_TIMESTAMP TELEMETRY_JSON_TEMPERATURE TELEMETRY_JSON_PRESSURE TELEMETRY_JSON_HUMIDITY       \
+                                 TELEMETRY_JSON_COUNT "}") +                                                                               \
+     TELEMETRY_TIMESTAMP_TEXT_MAX + 4 * TELEMETRY_INT_TEXT_MAX + TELEMETRY_JSON_FIELD_STATS_MAX("temperature") +                           \
+     TELEMETRY_JSON_FIELD_STATS_MAX("pressure") + TELEMETRY_JSON_FIELD_STATS_MAX("humidity"))
+#define TELEMETRY_JSON_MAX_BYTES(samples) (TELEMETRY_JSON_HEADER_MAX + (samples)*TELEMETRY_JSON_SAMPLE_MAX)
+
+// CBOR keys are short text strings (one byte head) and integers take at most five bytes (head plus 32 bit argument)
+#define TELEMETRY_CBOR_KEY_BYTES(key) sizeof(key)
+#define TELEMETRY_CBOR_INT_MAX 5
+#define TELEMETRY_CBOR_DOUBLE_BYTES 9
+#define TELEMETRY_CBOR_FIELD_STATS_MAX(field)                                                                                              \
+    (TELEMETRY_CBOR_KEY_BYTES(field "Mean") + TELEMETRY_CBOR_KEY_BYTES(field "Min") + TELEMETRY_CBOR_KEY_BYTES(field "Max") +              \
+     TELEMETRY_CBOR_KEY_BYTES(field "StdDev") + 2 * TELEMETRY_CBOR_DOUBLE_BYTES + 2 * TELEMETRY_CBOR_INT_MAX)
+#define TELEMETRY_CBOR_HEADER_MAX                                                                                                          \
+    (1 + TELEMETRY_CBOR_KEY_BYTES("msgId") + TELEMETRY_CBOR_KEY_BYTES("peakUserMemoryKiB") + TELEMETRY_CBOR_KEY_BYTES("totalMemoryKiB") +  \
+     TELEMETRY_CBOR_KEY_BYTES("samplesDropped") + TELEMETRY_CBOR_KEY_BYTES("samplesSuppressed") + TELEMETRY_CBOR_KEY_BYTES("backlog") +    \
+     TELEMETRY_CBOR_KEY_BYTES("backlogDropped") + TELEMETRY_CBOR_KEY_BYTES("publishPeriod") + TELEMETRY_CBOR_KEY_BYTES("publishReason") +  \
+     8 * TELEMETRY_CBOR_INT_MAX + 1 + TELEMETRY_TEXT_MAX + TELEMETRY_CBOR_KEY_BYTES("samples") + TELEMETRY_CBOR_INT_MAX)
+#define TELEMETRY_CBOR_SAMPLE_MAX                                                                                                          \
+    (1 + TELEMETRY_CBOR_KEY_BYTES("timestamp") + 1 + TELEMETRY_CBOR_DOUBLE_BYTES + TELEMETRY_CBOR_KEY_BYTES("temperature") +               \
+     TELEMETRY_CBOR_KEY_BYTES("pressure") + TELEMETRY_CBOR_KEY_BYTES("humidity") + TELEMETRY_CBOR_KEY_BYTES("count") +                     \
+     4 * TELEMETRY_CBOR_INT_MAX + TELEMETRY_CBOR_FIELD_STATS_MAX("temperature") + TELEMETRY_CBOR_FIELD_STATS_MAX("pressure") +             \
+     TELEMETRY_CBOR_FIELD_STATS_MAX("humidity"))
+#define TELEMETRY_CBOR_MAX_BYTES(samples) (TELEMETRY_CBOR_HEADER_MAX + (samples)*TELEMETRY_CBOR_SAMPLE_MAX)
+
+#ifdef TELEMETRY_CBOR
+#define TELEMETRY_MAX_BYTES(samples) TELEMETRY_CBOR_MAX_BYTES(samples)
+#else
+#define TELEMETRY_MAX_BYTES(samples) TELEMETRY_JSON_MAX_BYTES(samples)
+#endif
+
+/// <summary>
+/// Encode as JSON
+/// {"msgId":1,"peakUserMemoryKiB":n,"totalMemoryKiB":n,"samplesDropped":n,"samplesSuppressed":n,"backlog":n,"backlogDropped":n,"publishPeriod":n,"publishReason":"normal","samples":[{"timestamp":"2021-01-01T00:00:00.000Z","temperature":n,"pressure":n,"humidity":n,"count":n,
+/// "temperatureMean":n.nn,"temperatureMin":n,"temperatureMax":n,"temperatureStdDev":n.nn,...},...]}
+/// The count and window statistics are left out for samples with a zero count. Specialised to this layout, no format string parsing and no allocation.
+/// </summary>
+/// <returns>Encoded length, zero if the buffer is smaller than TELEMETRY_JSON_MAX_BYTES(count)</returns>
+size_t telemetry_encode_json(const TELEMETRY_PAYLOAD *payload, char *buffer, size_t buffer_size);
+
+/// <summary>
+/// Encode as CBOR (RFC 8949) with the same keys as the JSON layout. The timestamp is tagged epoch time (tag 1) as a
+/// double with millisecond resolution, the window mean and standard deviation are doubles.
+/// </summary>
+/// <returns>Encoded length, zero if the buffer is too small</returns>
+size_t telemetry_encode_cbor(const TELEMETRY_PAYLOAD *payload, uint8_t *buffer, size_t buffer_size);
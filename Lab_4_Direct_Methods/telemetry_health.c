@@ -0,0 +1,192 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+#include "telemetry_health.h"
+
+#include <stdio.h>
+#include <string.h>
+
+/// <summary>
+/// Exact below 4 ms, then four buckets per power of two
+/// </summary>
+static unsigned bucket_of(uint32_t ms)
+{
+    if (ms < 4)
+    {
+        return ms;
+    }
+
+    unsigned msb = 31u - (unsigned)__builtin_clz(ms);
+    unsigned bucket = 4 * (msb - 1) + ((ms >> (msb - 2)) & 3);
+
+    return bucket < TELEMETRY_HEALTH_BUCKETS ? bucket : TELEMETRY_HEALTH_BUCKETS - 1;
+}
+
+static uint32_t bucket_upper_ms(unsigned bucket)
+{
+    if (bucket < 4)
+    {
+        return bucket;
+    }
+
+    unsigned msb = bucket / 4 + 1;
+    return ((4u + bucket % 4) << (msb - 2)) + (1u << (msb - 2)) - 1;
+}
+
+TELEMETRY_HEALTH_MESSAGE *telemetry_health_enqueued(TELEMETRY_HEALTH *health, bool retry)
+{
+    health->retries += retry;
+    health->queue_depth++;
+    health->queue_depth_max = health->queue_depth > health->queue_depth_max ? health->queue_depth : health->queue_depth_max;
+
+    for (size_t i = 0; i < TELEMETRY_HEALTH_IN_FLIGHT; i++)
+    {
+        if (!health->in_flight[i].in_use)
+        {
+            health->in_flight[i].in_use = true;
+            clock_gettime(CLOCK_MONOTONIC, &health->in_flight[i].enqueued);
+            return &health->in_flight[i];
+        }
+    }
+
+    return NULL;
+}
+
+uint32_t telemetry_health_confirmed(TELEMETRY_HEALTH *health, TELEMETRY_HEALTH_MESSAGE *message, TELEMETRY_OUTCOME outcome)
+{
+    uint32_t latency_ms = 0;
+    bool timed = false;
+
+    health->outcomes[outcome]++;
+    health->queue_depth -= health->queue_depth > 0;
+
+    if (message && message->in_use && outcome != TELEMETRY_OUTCOME_NOT_SENT)
+    {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+
+        latency_ms = (uint32_t)((now.tv_sec - message->enqueued.tv_sec) * 1000 + (now.tv_nsec - message->enqueued.tv_nsec) / 1000000);
+        message->in_use = false;
+        timed = true;
+
+        health->histogram[bucket_of(latency_ms)]++;
+        health->latency_max_ms = latency_ms > health->latency_max_ms ? latency_ms : health->latency_max_ms;
+    }
+    else if (message)
+    {
+        message->in_use = false;
+    }
+
+    // A delivery that was not timed says nothing of the latency, it must not clear a latency backoff
+    if (health->rate && (timed || outcome != TELEMETRY_OUTCOME_DELIVERED))
+    {
+        telemetry_rate_sent(health->rate, outcome == TELEMETRY_OUTCOME_DELIVERED, latency_ms);
+    }
+
+    return latency_ms;
+}
+
+void telemetry_health_not_sent(TELEMETRY_HEALTH *health, bool retry)
+{
+    health->retries += retry;
+    health->outcomes[TELEMETRY_OUTCOME_NOT_SENT]++;
+
+    if (health->rate)
+    {
+        telemetry_rate_sent(health->rate, false, 0);
+    }
+}
+
+uint32_t telemetry_health_percentile_ms(const TELEMETRY_HEALTH *health, unsigned percentile)
+{
+    uint64_t total = 0, seen = 0;
+
+    for (unsigned i = 0; i < TELEMETRY_HEALTH_BUCKETS; i++)
+    {
+        total += health->histogram[i];
+    }
+
+    for (unsigned i = 0; i < TELEMETRY_HEALTH_BUCKETS && total > 0; i++)
+    {
+        seen += health->histogram[i];
+        if (seen * 100 >= total * percentile)
+        {
+            // the bucket bound can overshoot, the real maximum cannot
+            uint32_t upper = bucket_upper_ms(i);
+            return upper < health->latency_max_ms ? upper : health->latency_max_ms;
+        }
+    }
+
+    return 0;
+}
+
+size_t telemetry_health_summary(TELEMETRY_HEALTH *health, char *buffer, size_t buffer_size)
+{
+    unsigned messages = 0;
+
+    for (size_t i = 0; i < sizeof(health->outcomes) / sizeof(health->outcomes[0]); i++)
+    {
+        messages += health->outcomes[i];
+    }
+
+    int length = snprintf(buffer, buffer_size,
+                          "{\"msgId\":%d,\"messages\":%u,\"delivered\":%u,\"timeouts\":%u,\"failed\":%u,\"notSent\":%u,\"retries\":%u,"
+                          "\"queueDepth\":%u,\"queueDepthMax\":%u,\"latencyP50Ms\":%u,\"latencyP99Ms\":%u,\"latencyMaxMs\":%u}",
+                          health->msgId, messages, health->outcomes[TELEMETRY_OUTCOME_DELIVERED],
+                          health->outcomes[TELEMETRY_OUTCOME_TIMEOUT], health->outcomes[TELEMETRY_OUTCOME_FAILED],
+                          health->outcomes[TELEMETRY_OUTCOME_NOT_SENT], health->retries,
+                          health->queue_depth, health->queue_depth_max, telemetry_health_percentile_ms(health, 50),
+                          telemetry_health_percentile_ms(health, 99), health->latency_max_ms);
+
+    if (length < 0 || (size_t)length >= buffer_size)
+    {
+        return 0;
+    }
+
+    health->msgId++;
+    health->queue_depth_max = health->queue_depth;
+    health->retries = 0;
+    health->latency_max_ms = 0;
+    memset(health->outcomes, 0, sizeof(health->outcomes));
+    memset(health->histogram, 0, sizeof(health->histogram));
+
+    return (size_t)length;
+}
+
+size_t telemetry_health_histogram(const TELEMETRY_HEALTH *health, char *buffer, size_t buffer_size)
+{
+    size_t length = 0;
+
+    if (buffer_size < 3)
+    {
+        return 0;
+    }
+
+    buffer[length++] = '[';
+
+    for (unsigned i = 0; i < TELEMETRY_HEALTH_BUCKETS; i++)
+    {
+        if (health->histogram[i] == 0)
+        {
+            continue;
+        }
+
+        int written = snprintf(buffer + length, buffer_size - length, "%s[%u,%u]", length > 1 ? "," : "", bucket_upper_ms(i),
+                               health->histogram[i]);
+
+        if (written < 0 || (length += (size_t)written) >= buffer_size)
+        {
+            return 0;
+        }
+    }
+
+    if (length + 1 >= buffer_size)
+    {
+        return 0;
+    }
+
+    buffer[length++] = ']';
+    buffer[length] = '\0';
+
+    return length;
+}
@@ -0,0 +1,84 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+#pragma once
+
+#include "telemetry_rate.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+// Messages tracked between enqueue and confirmation, more in flight are counted but not timed
+#define TELEMETRY_HEALTH_IN_FLIGHT 16
+// Latency histogram, four buckets per power of two milliseconds (within 25%), the last bucket holds everything from 115 s
+#define TELEMETRY_HEALTH_BUCKETS 64
+// Largest health summary message
+#define TELEMETRY_HEALTH_JSON_BYTES 384
+
+typedef enum
+{
+    TELEMETRY_OUTCOME_DELIVERED, // confirmed by IoT Hub
+    TELEMETRY_OUTCOME_TIMEOUT,   // the SDK gave up waiting for a confirmation
+    TELEMETRY_OUTCOME_FAILED,    // confirmed with an error, or the client was destroyed with the message queued
+    TELEMETRY_OUTCOME_NOT_SENT   // not connected or the SDK refused to queue it
+} TELEMETRY_OUTCOME;
+
+typedef struct
+{
+    bool in_use;
+    struct timespec enqueued;
+} TELEMETRY_HEALTH_MESSAGE;
+
+typedef struct
+{
+    TELEMETRY_RATE *rate; // optional, told the outcome and latency of every message
+    TELEMETRY_HEALTH_MESSAGE in_flight[TELEMETRY_HEALTH_IN_FLIGHT];
+    unsigned queue_depth; // messages enqueued and not yet confirmed
+    // Counters and histogram of the current summary interval
+    unsigned queue_depth_max;
+    unsigned outcomes[TELEMETRY_OUTCOME_NOT_SENT + 1];
+    unsigned retries; // messages of readings that failed to send before
+    uint32_t latency_max_ms;
+    uint32_t histogram[TELEMETRY_HEALTH_BUCKETS];
+    int msgId;
+} TELEMETRY_HEALTH;
+
+/// <summary>
+/// Start timing a message handed to the SDK
+/// </summary>
+/// <returns>Context to pass to telemetry_health_confirmed, NULL when all tracking slots are busy</returns>
+TELEMETRY_HEALTH_MESSAGE *telemetry_health_enqueued(TELEMETRY_HEALTH *health, bool retry);
+
+/// <summary>
+/// Record the outcome of every message counted by telemetry_health_enqueued, message is its context (may be NULL).
+/// Use TELEMETRY_OUTCOME_NOT_SENT when the SDK refused to queue it.
+/// </summary>
+/// <returns>Milliseconds from enqueue to the outcome, zero if the message was not timed</returns>
+uint32_t telemetry_health_confirmed(TELEMETRY_HEALTH *health, TELEMETRY_HEALTH_MESSAGE *message, TELEMETRY_OUTCOME outcome);
+
+/// <summary>
+/// Count a message that could not be handed to the SDK, for example when not connected
+/// </summary>
+void telemetry_health_not_sent(TELEMETRY_HEALTH *health, bool retry);
+
+/// <summary>
+/// Upper bound of the latency percentile in the current interval, from the histogram
+/// </summary>
+uint32_t telemetry_health_percentile_ms(const TELEMETRY_HEALTH *health, unsigned percentile);
+
+/// <summary>
+/// Serialize the current interval as JSON, then start a new interval. Messages still in flight carry over.
+/// {"msgId":1,"messages":n,"delivered":n,"timeouts":n,"failed":n,"notSent":n,"retries":n,"queueDepth":n,"queueDepthMax":n,
+/// "latencyP50Ms":n,"latencyP99Ms":n,"latencyMaxMs":n}
+/// </summary>
+/// <returns>Length written, zero if the buffer is too small</returns>
+size_t telemetry_health_summary(TELEMETRY_HEALTH *health, char *buffer, size_t buffer_size);
+
+/// <summary>
+/// Serialize the latency histogram of the current interval without starting a new one. Only buckets that are not empty
+/// are listed, each as [upper bound ms, messages]: [[11,3],[13,40],[15,2]]
+/// </summary>
+/// <returns>Length written, zero if the buffer is too small</returns>
+size_t telemetry_health_histogram(const TELEMETRY_HEALTH *health, char *buffer, size_t buffer_size);
@@ -0,0 +1,69 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+#include "telemetry_rate.h"
+
+static const char *reasons[] = {"normal", "failure", "latency", "anomaly", "backlog"};
+
+static time_t monotonic_seconds(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec;
+}
+
+void telemetry_rate_sent(TELEMETRY_RATE *rate, bool sent, uint32_t latency_ms)
+{
+    rate->failures = sent ? 0 : rate->failures + 1;
+    rate->latency_ms = sent ? latency_ms : rate->latency_ms;
+}
+
+void telemetry_rate_anomaly(TELEMETRY_RATE *rate)
+{
+    rate->anomaly_until_monotonic = monotonic_seconds() + rate->anomaly_hold_seconds;
+}
+
+bool telemetry_rate_update(TELEMETRY_RATE *rate, uint32_t backlog)
+{
+    TELEMETRY_RATE_REASON reason = TELEMETRY_RATE_NORMAL;
+    int period = rate->normal_seconds;
+
+    if (rate->failures > 0)
+    {
+        // exponential backoff, the shift is bounded so it cannot overflow
+        reason = TELEMETRY_RATE_FAILURE;
+        period = rate->normal_seconds << (rate->failures < 8 ? rate->failures : 8);
+    }
+    else if (rate->latency_limit_ms > 0 && rate->latency_ms > rate->latency_limit_ms)
+    {
+        reason = TELEMETRY_RATE_LATENCY;
+        period = rate->normal_seconds * 2;
+    }
+    else if (monotonic_seconds() < rate->anomaly_until_monotonic)
+    {
+        reason = TELEMETRY_RATE_ANOMALY;
+        period = rate->fast_seconds;
+    }
+    else if (backlog > 0)
+    {
+        reason = TELEMETRY_RATE_BACKLOG;
+        period = rate->fast_seconds;
+    }
+
+    period = period > rate->max_seconds ? rate->max_seconds : period < 1 ? 1 : period;
+
+    if (period == rate->period_seconds && reason == rate->reason)
+    {
+        return false;
+    }
+
+    rate->period_seconds = period;
+    rate->reason = reason;
+
+    return true;
+}
+
+const char *telemetry_rate_reason(TELEMETRY_RATE_REASON reason)
+{
+    return (unsigned)reason < sizeof(reasons) / sizeof(reasons[0]) ? reasons[reason] : "unknown";
+}
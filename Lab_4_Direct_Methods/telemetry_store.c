@@ -0,0 +1,262 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+#include "telemetry_store.h"
+
+#include "dx_utilities.h"
+
+#include <applibs/storage.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+/*
+ * Mutable storage layout, little endian
+ *
+ *   header   magic u32, version u16, record bytes u16, capacity u32, head u32, count u32, dropped total u32
+ *   records  capacity x { seconds u32, milliseconds u16, temperature i16, pressure u16, humidity u8, crc8 u8 }
+ *
+ * Only the window mean of each field is kept, backfilled samples are sent without window statistics.
+ *
+ * A record is written before the header that covers it, and when the store is full the header drops the oldest records
+ * before their slots are overwritten, so a power loss mid update loses at most the records being written.
+ */
+#define STORE_MAGIC 0x54535452 // "TSTR"
+#define STORE_VERSION 1
+
+static uint8_t crc8(const uint8_t *data, size_t length)
+{
+    // CRC-8, polynomial 0x07
+    uint8_t crc = 0;
+    for (size_t i = 0; i < length; i++)
+    {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; bit++)
+        {
+            crc = (uint8_t)(crc & 0x80 ? (crc << 1) ^ 0x07 : crc << 1);
+        }
+    }
+    return crc;
+}
+
+static void put_u16(uint8_t *out, uint16_t value)
+{
+    out[0] = (uint8_t)value;
+    out[1] = (uint8_t)(value >> 8);
+}
+
+static void put_u32(uint8_t *out, uint32_t value)
+{
+    put_u16(out, (uint16_t)value);
+    put_u16(out + 2, (uint16_t)(value >> 16));
+}
+
+static uint16_t get_u16(const uint8_t *in)
+{
+    return (uint16_t)(in[0] | in[1] << 8);
+}
+
+static uint32_t get_u32(const uint8_t *in)
+{
+    return get_u16(in) | (uint32_t)get_u16(in + 2) << 16;
+}
+
+static int clamp(int value, int min, int max)
+{
+    return value < min ? min : value > max ? max : value;
+}
+
+static void encode_record(const TELEMETRY_SAMPLE *sample, uint8_t record[TELEMETRY_STORE_RECORD_BYTES])
+{
+    put_u32(&record[0], (uint32_t)sample->timestamp.tv_sec);
+    put_u16(&record[4], (uint16_t)(sample->timestamp.tv_nsec / 1000000));
+    put_u16(&record[6], (uint16_t)(int16_t)clamp(sample->temperature, INT16_MIN, INT16_MAX));
+    put_u16(&record[8], (uint16_t)clamp(sample->pressure, 0, UINT16_MAX));
+    record[10] = (uint8_t)clamp(sample->humidity, 0, UINT8_MAX);
+    record[11] = crc8(record, TELEMETRY_STORE_RECORD_BYTES - 1);
+}
+
+static bool decode_record(const uint8_t record[TELEMETRY_STORE_RECORD_BYTES], TELEMETRY_SAMPLE *sample)
+{
+    if (crc8(record, TELEMETRY_STORE_RECORD_BYTES - 1) != record[11])
+    {
+        return false;
+    }
+
+    // only the window mean is stored
+    memset(sample, 0, sizeof(*sample));
+    sample->timestamp.tv_sec = (time_t)get_u32(&record[0]);
+    sample->timestamp.tv_nsec = (long)get_u16(&record[4]) * 1000000;
+    sample->temperature = (int16_t)get_u16(&record[6]);
+    sample->pressure = get_u16(&record[8]);
+    sample->humidity = record[10];
+
+    return true;
+}
+
+static off_t record_offset(const TELEMETRY_STORE *store, uint32_t index)
+{
+    return TELEMETRY_STORE_HEADER_BYTES + (off_t)(index % store->capacity) * TELEMETRY_STORE_RECORD_BYTES;
+}
+
+static bool write_header(TELEMETRY_STORE *store)
+{
+    uint8_t header[TELEMETRY_STORE_HEADER_BYTES];
+
+    put_u32(&header[0], STORE_MAGIC);
+    put_u16(&header[4], STORE_VERSION);
+    put_u16(&header[6], TELEMETRY_STORE_RECORD_BYTES);
+    put_u32(&header[8], store->capacity);
+    put_u32(&header[12], store->head);
+    put_u32(&header[16], store->count);
+    put_u32(&header[20], store->dropped_total);
+
+    return pwrite(store->fd, header, sizeof(header), 0) == (ssize_t)sizeof(header) && fsync(store->fd) == 0;
+}
+
+bool telemetry_store_open(TELEMETRY_STORE *store)
+{
+    uint8_t header[TELEMETRY_STORE_HEADER_BYTES];
+
+    store->head = store->count = 0;
+
+    if (store->capacity == 0 || (store->fd = Storage_OpenMutableFile()) == -1)
+    {
+        store->fd = -1;
+        dx_Log_Debug("Telemetry store not available: %s\n", strerror(errno));
+        return false;
+    }
+
+    // Keep the backlog of a previous run when the layout matches, otherwise start empty
+    if (pread(store->fd, header, sizeof(header), 0) == (ssize_t)sizeof(header) && get_u32(&header[0]) == STORE_MAGIC &&
+        get_u16(&header[4]) == STORE_VERSION && get_u16(&header[6]) == TELEMETRY_STORE_RECORD_BYTES && get_u32(&header[8]) == store->capacity &&
+        get_u32(&header[16]) <= store->capacity)
+    {
+        store->head = get_u32(&header[12]) % store->capacity;
+        store->count = get_u32(&header[16]);
+        store->dropped_total = get_u32(&header[20]);
+    }
+    else if (!write_header(store))
+    {
+        telemetry_store_close(store);
+        return false;
+    }
+
+    dx_Log_Debug("Telemetry store: %u of %u records in backlog, %u dropped\n", store->count, store->capacity, store->dropped_total);
+
+    return true;
+}
+
+void telemetry_store_close(TELEMETRY_STORE *store)
+{
+    if (store->fd != -1)
+    {
+        close(store->fd);
+        store->fd = -1;
+    }
+}
+
+size_t telemetry_store_push(TELEMETRY_STORE *store, const TELEMETRY_SAMPLE *samples, size_t count)
+{
+    uint8_t record[TELEMETRY_STORE_RECORD_BYTES];
+    size_t lost = 0;
+
+    if (store->fd == -1)
+    {
+        return count;
+    }
+
+    // only the newest capacity samples of the batch can be kept
+    if (count > store->capacity)
+    {
+        lost = count - store->capacity;
+        samples += lost;
+        count = store->capacity;
+    }
+
+    // full, drop the oldest records the batch displaces from the header before their slots are overwritten
+    size_t displaced = store->count + count > store->capacity ? store->count + count - store->capacity : 0;
+
+    if (lost + displaced > 0)
+    {
+        store->head = (uint32_t)((store->head + displaced) % store->capacity);
+        store->count -= (uint32_t)displaced;
+        store->dropped_total += (uint32_t)(lost + displaced);
+        lost += displaced;
+        write_header(store);
+    }
+
+    for (size_t i = 0; i < count; i++)
+    {
+        encode_record(&samples[i], record);
+
+        if (pwrite(store->fd, record, sizeof(record), record_offset(store, store->head + store->count)) != (ssize_t)sizeof(record))
+        {
+            store->dropped_total += (uint32_t)(count - i);
+            lost += count - i;
+            break;
+        }
+
+        store->count++;
+    }
+
+    write_header(store);
+
+    return lost;
+}
+
+size_t telemetry_store_peek(TELEMETRY_STORE *store, TELEMETRY_SAMPLE *samples, size_t max_count, uint32_t *records_read)
+{
+    uint8_t record[TELEMETRY_STORE_RECORD_BYTES];
+    uint32_t records = store->count < max_count ? store->count : (uint32_t)max_count;
+    size_t copied = 0;
+
+    *records_read = 0;
+
+    if (store->fd == -1 || records == 0)
+    {
+        return 0;
+    }
+
+    // Newest first takes the most recent records, both orders return them in time order
+    uint32_t first = store->order == TELEMETRY_BACKFILL_NEWEST_FIRST ? store->head + store->count - records : store->head;
+
+    for (uint32_t i = 0; i < records; i++)
+    {
+        if (pread(store->fd, record, sizeof(record), record_offset(store, first + i)) != (ssize_t)sizeof(record))
+        {
+            break;
+        }
+
+        (*records_read)++;
+
+        if (decode_record(record, &samples[copied]))
+        {
+            copied++;
+        }
+        else
+        {
+            store->dropped_total++;
+        }
+    }
+
+    return copied;
+}
+
+void telemetry_store_consume(TELEMETRY_STORE *store, uint32_t records_read)
+{
+    if (store->fd == -1 || records_read == 0)
+    {
+        return;
+    }
+
+    records_read = records_read < store->count ? records_read : store->count;
+
+    if (store->order == TELEMETRY_BACKFILL_OLDEST_FIRST)
+    {
+        store->head = (store->head + records_read) % store->capacity;
+    }
+
+    store->count -= records_read;
+    write_header(store);
+}
@@ -107,6 +107,7 @@ static stmdev_ctx_t dev_ctx;
 static stmdev_ctx_t pressure_ctx;
 static bool lps22hhDetected;
 static bool initialized = false;
+static bool low_power = false;
 
 /* Extern variables ----------------------------------------------------------*/
 
@@ -593,6 +594,64 @@ bool lp_imu_initialize(void)
 }
 
 
+/// <summary>
+///     Low power mode turns off the accelerometer and gyro and powers down the LPS22HH between samples.
+///     Take each sample with lp_imu_sample_one_shot.
+/// </summary>
+void lp_imu_set_low_power(bool enable)
+{
+	if (!initialized)
+	{
+		return;
+	}
+
+	low_power = enable;
+
+	lsm6dso_xl_data_rate_set(&dev_ctx, enable ? LSM6DSO_XL_ODR_OFF : LSM6DSO_XL_ODR_12Hz5);
+	lsm6dso_gy_data_rate_set(&dev_ctx, enable ? LSM6DSO_GY_ODR_OFF : LSM6DSO_GY_ODR_12Hz5);
+
+	if (lps22hhDetected)
+	{
+		lps22hh_data_rate_set(&pressure_ctx, enable ? LPS22HH_POWER_DOWN : LPS22HH_10_Hz_LOW_NOISE);
+	}
+}
+
+
+/// <summary>
+///     Start a single LPS22HH conversion and wait for the result, the sensor returns to power down when done.
+///     Both outputs are read here, reading TEMP_OUT clears T_DA so lp_get_pressure would never see the sample.
+/// </summary>
+bool lp_imu_sample_one_shot(float* temperature_degC, float* pressure_hPa)
+{
+	lps22hh_reg_t lps22hhReg;
+	uint32_t ui32bit = 0;
+	int16_t i16bit = 0;
+
+	if (!initialized || !lps22hhDetected)
+	{
+		return false;
+	}
+
+	lps22hh_data_rate_set(&pressure_ctx, LPS22HH_ONE_SHOOT);
+
+	for (int i = 0; i < 10; i++)
+	{
+		lps22hh_read_reg(&pressure_ctx, LPS22HH_STATUS, (uint8_t*)&lps22hhReg, 1);
+		if ((lps22hhReg.status.p_da == 1) && (lps22hhReg.status.t_da == 1))
+		{
+			lps22hh_pressure_raw_get(&pressure_ctx, &ui32bit);
+			lps22hh_temperature_raw_get(&pressure_ctx, &i16bit);
+			*pressure_hPa = lps22hh_from_lsb_to_hpa(ui32bit);
+			*temperature_degC = lps22hh_from_lsb_to_celsius(i16bit);
+			return true;
+		}
+		platform_delay(5000);	// Gpt3_WaitUs, 5 milliseconds
+	}
+
+	return false;
+}
+
+
 /// <summary>
 ///     Closes the I2C interface File Descriptors.
 /// </summary>
@@ -727,8 +786,8 @@ static int32_t lsm6dso_read_lps22hh_cx(void* ctx, uint8_t reg, uint8_t* data, ui
 	Log_Debug("\n", len);
 #endif 
 
-	/* Re-enable accelerometer */
-	lsm6dso_xl_data_rate_set(&dev_ctx, LSM6DSO_XL_ODR_104Hz);
+	/* Re-enable accelerometer, left off in low power mode as it is only needed to clock the sensor hub */
+	lsm6dso_xl_data_rate_set(&dev_ctx, low_power ? LSM6DSO_XL_ODR_OFF : LSM6DSO_XL_ODR_104Hz);
 
 	return ret;
 }
\ No newline at end of file
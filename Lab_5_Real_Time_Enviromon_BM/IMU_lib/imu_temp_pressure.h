@@ -39,3 +39,5 @@ float lp_get_temperature_lps22h(void);	// get_temperature() from lsm6dso is fast
 void lp_calibrate_angular_rate(void);
 AngularRateDegreesPerSecond lp_get_angular_rate(void);
 AccelerationMilligForce lp_get_acceleration(void);
+void lp_imu_set_low_power(bool enable);
+bool lp_imu_sample_one_shot(float* temperature_degC, float* pressure_hPa);
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <stdint.h>
+
+/*************************************************************************************************************************************
+ * Interrupt safe counters for ISR to main loop signalling
+ *
+ * Read-modify-write on a volatile is not atomic, an interrupt between the load and the store loses an update.
+ * These use the Cortex-M4 exclusive access instructions, exception entry clears the exclusive monitor so a
+ * sequence interrupted by an ISR that touched the counter fails its STREX and retries.
+ *************************************************************************************************************************************/
+
+/// <summary>
+/// Atomically add delta to the counter
+/// </summary>
+/// <returns>The new value</returns>
+static inline uint32_t atomic_add_u32(volatile uint32_t *counter, uint32_t delta)
+{
+    uint32_t value, failed;
+
+    do {
+        __asm__ volatile("ldrex %0, [%1]" : "=r"(value) : "r"(counter) : "memory");
+        value += delta;
+        __asm__ volatile("strex %0, %2, [%1]" : "=&r"(failed) : "r"(counter), "r"(value) : "memory");
+    } while (failed);
+
+    return value;
+}
+
+/// <summary>
+/// Atomically replace the counter with new_value
+/// </summary>
+/// <returns>The previous value</returns>
+static inline uint32_t atomic_exchange_u32(volatile uint32_t *counter, uint32_t new_value)
+{
+    uint32_t value, failed;
+
+    do {
+        __asm__ volatile("ldrex %0, [%1]" : "=r"(value) : "r"(counter) : "memory");
+        __asm__ volatile("strex %0, %2, [%1]" : "=&r"(failed) : "r"(counter), "r"(new_value) : "memory");
+    } while (failed);
+
+    return value;
+}
@@ -15,7 +15,7 @@ void mbox_fifo_cb(struct mtk_os_hal_mbox_cb_data* data) {
 	if (data->event.channel == OS_HAL_MBOX_CH0) {
 		/* A7 core write data to mailbox fifo. */
 		if (data->event.wr_int)
-			blockFifoSema++;
+			atomic_add_u32(&blockFifoSema, 1);
 	}
 }
 
@@ -30,7 +30,7 @@ void mbox_fifo_cb(struct mtk_os_hal_mbox_cb_data* data) {
 void mbox_swint_cb(struct mtk_os_hal_mbox_cb_data* data) {
 	if (data->swint.channel == OS_HAL_MBOX_CH0) {
 		if (data->swint.swint_sts & (1 << 1))
-			blockDeqSema++;
+			atomic_add_u32(&blockDeqSema, 1);
 	}
 }
 
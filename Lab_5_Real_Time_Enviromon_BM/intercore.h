@@ -5,6 +5,7 @@
 #include "os_hal_mbox_shared_mem.h"
 #include <string.h>
 #include "mhal_osai.h"
+#include "atomic_counter.h"
 
 /* Maximum mailbox buffer len.
  *    Maximum message len: 1024B
@@ -20,8 +21,8 @@ extern u32 mbox_shared_buf_size;
 extern uint32_t mbox_irq_status;
 extern uint8_t mbox_local_buf[MBOX_BUFFER_LEN_MAX];
 extern BufferHeader* outbound, * inbound;
-extern volatile u8  blockDeqSema;
-extern volatile u8  blockFifoSema;
+extern volatile uint32_t blockDeqSema;
+extern volatile uint32_t blockFifoSema;
 
 /// <summary>
 ///     When sending a message, this is the recipient HLApp's component ID.
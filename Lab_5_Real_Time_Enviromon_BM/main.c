@@ -40,6 +40,7 @@
 
 #include "intercore.h"
 #include "intercore_contract.h"
+#include "periodic_tasks.h"
 
 #if defined(OEM_AVNET)
 #include "IMU_lib/imu_temp_pressure.h"
@@ -79,9 +80,18 @@ HVAC_MODE hvac_mode;
 
 uint8_t mbox_local_buf[MBOX_BUFFER_LEN_MAX];
 BufferHeader *outbound, *inbound;
-volatile u8 blockDeqSema;
-volatile u8 blockFifoSema;
-volatile bool refresh_data_trigger;
+volatile uint32_t blockDeqSema;
+volatile uint32_t blockFifoSema;
+
+typedef struct {
+    uint32_t wakes;          // main loop passes that found the dequeue semaphore set
+    uint32_t signals;        // mailbox interrupts consumed by those wakes
+    uint32_t messages;       // messages dequeued
+    uint32_t empty_wakes;    // wakes that found no message, the interrupt raced an earlier drain
+    uint32_t max_per_wake;
+} MBOX_DRAIN_STATS;
+
+static MBOX_DRAIN_STATS mbox_drain_stats;
 
 struct os_gpt_int gpt0_int;
 struct os_gpt_int gpt3_int;
@@ -100,6 +110,47 @@ static const uint8_t uart_port_num = OS_HAL_UART_ISU3;
 static const uint8_t gpt_task_scheduler = OS_HAL_GPT0;
 static const uint32_t gpt_task_scheduler_timer_val = 1; /* 1ms */
 
+/* Milliseconds since the scheduler started, advanced by task_scheduler */
+static volatile uint32_t scheduler_ms = 0;
+
+#ifdef LOW_POWER_MODE
+/* GPT0 runs one shot to the next job release, zero when the timer is idle */
+static volatile uint32_t scheduler_armed_ms = 0;
+
+typedef struct {
+    uint32_t window_start_ms;
+    uint32_t wake_cycles;
+    uint64_t awake_us;
+    uint32_t wakes;
+} POWER_STATS;
+
+static POWER_STATS power_stats;
+#endif
+
+/// <summary>
+/// Monotonic milliseconds for the intercore timestamps
+/// </summary>
+static uint32_t monotonic_ms(void)
+{
+#ifdef LOW_POWER_MODE
+    // scheduler_ms only moves when GPT0 fires, add the milliseconds counted since it was armed
+    return scheduler_ms + (scheduler_armed_ms != 0 ? mtk_os_hal_gpt_get_cur_count(gpt_task_scheduler) : 0);
+#else
+    return scheduler_ms;
+#endif
+}
+
+/******************************************************************************/
+/* Periodic tasks, released by task_scheduler and run from the main loop */
+/******************************************************************************/
+void refresh_data(void);
+static void report_task_stats(void);
+
+static PERIODIC_TASK task_refresh_data = {.name = "refresh data", .period_ms = 2000, .priority = 1, .handler = refresh_data};
+static PERIODIC_TASK task_report_stats = {.name = "report stats", .period_ms = 60000, .priority = 2, .handler = report_task_stats};
+
+static PERIODIC_TASK *periodic_tasks[] = {&task_refresh_data, &task_report_stats};
+
 /******************************************************************************/
 /* Applicaiton Hooks */
 /******************************************************************************/
@@ -164,6 +215,28 @@ static void send_intercore_msg(void *data, size_t length)
     EnqueueData(inbound, outbound, mbox_shared_buf_size, mbox_local_buf, dataSize);
 }
 
+/// <summary>
+/// Reply to IC_RT_STATS with the worst case timing of each periodic task
+/// </summary>
+static void send_rt_stats(void)
+{
+    INTERCORE_STATS_BLOCK stats = {.cmd = IC_RT_STATS, .uptime_ms = monotonic_ms()};
+
+    for (size_t i = 0; i < NELEMS(periodic_tasks) && i < IC_RT_STATS_TASKS; i++) {
+        INTERCORE_TASK_STATS *task = &stats.tasks[stats.task_count++];
+
+        strncpy(task->name, periodic_tasks[i]->name, IC_RT_STATS_NAME_BYTES - 1);
+        task->releases = periodic_tasks[i]->stats.releases;
+        task->deadline_overruns = periodic_tasks[i]->stats.deadline_overruns;
+        task->missed_releases = periodic_tasks[i]->stats.missed_releases;
+        task->exec_us_max = periodic_tasks[i]->stats.exec_us_max;
+        task->lateness_us_max = periodic_tasks[i]->stats.lateness_us_max;
+        task->response_us_max = periodic_tasks[i]->stats.response_us_max;
+    }
+
+    send_intercore_msg(&stats, sizeof(stats));
+}
+
 /// <summary>
 /// Set the temperature status led.
 /// Red if HVAC needs to be turned on to get to desired temperature.
@@ -199,7 +272,11 @@ void set_hvac_operating_mode(int temperature)
 #endif
 }
 
-static void process_inbound_message()
+/// <summary>
+/// Dequeue and handle one message from the high-level app
+/// </summary>
+/// <returns>false when the inbound buffer is empty</returns>
+static bool process_inbound_message(void)
 {
     u32 mbox_local_buf_len;
     int result;
@@ -207,12 +284,17 @@ static void process_inbound_message()
     mbox_local_buf_len = MBOX_BUFFER_LEN_MAX;
     result = DequeueData(outbound, inbound, mbox_shared_buf_size, mbox_local_buf, &mbox_local_buf_len);
 
-    if (result == 0 && mbox_local_buf_len > payloadStart) {
+    if (result != 0) {
+        return false;
+    }
+
+    if (mbox_local_buf_len > payloadStart) {
 
         ic_inbound_data = (INTERCORE_BLOCK *)(mbox_local_buf + payloadStart);
 
         switch (ic_inbound_data->cmd) {
         case IC_READ_SENSOR:
+            ic_outbound_data.reply_ms = monotonic_ms();
             send_intercore_msg(&ic_outbound_data, sizeof(INTERCORE_BLOCK));
             break;
         case IC_TARGET_TEMPERATURE:
@@ -222,25 +304,86 @@ static void process_inbound_message()
                 set_hvac_operating_mode(hvac_mode.last_temperature);
             }
             break;
+        case IC_RT_STATS:
+            send_rt_stats();
+            break;
+        case IC_SAMPLE_RATE:
+            if (mbox_local_buf_len >= payloadStart + sizeof(INTERCORE_RATE_BLOCK)) {
+                uint32_t period_ms = ((INTERCORE_RATE_BLOCK *)ic_inbound_data)->read_period_ms;
+
+                if (IN_RANGE(period_ms, IC_SAMPLE_RATE_MIN_MS, IC_SAMPLE_RATE_MAX_MS)) {
+                    // Masked so task_scheduler cannot release the task mid update
+                    __asm__ volatile("cpsid i" ::: "memory");
+                    uint32_t now_ms = monotonic_ms();
+#ifdef LOW_POWER_MODE
+                    // GPT0 is armed for the old release, bring the scheduler clock up to now and stop it. The main
+                    // loop arms it again for the new release.
+                    mtk_os_hal_gpt_stop(gpt_task_scheduler);
+                    scheduler_ms = now_ms;
+                    scheduler_armed_ms = 0;
+#endif
+                    periodic_task_set_period(&task_refresh_data, period_ms, now_ms);
+                    __asm__ volatile("cpsie i" ::: "memory");
+                }
+            }
+            break;
         default:
             break;
         }
     }
+
+    return true;
+}
+
+/// <summary>
+/// Drain every message queued by the high-level app. The semaphore is cleared before draining so a message
+/// that arrives during the drain raises it again and is picked up on the next pass.
+/// </summary>
+static void process_inbound_messages(uint32_t signals)
+{
+    uint32_t messages = 0;
+
+    while (process_inbound_message()) {
+        messages++;
+    }
+
+    mbox_drain_stats.wakes++;
+    mbox_drain_stats.signals += signals;
+    mbox_drain_stats.messages += messages;
+
+    if (messages == 0) {
+        mbox_drain_stats.empty_wakes++;
+    }
+
+    if (messages > mbox_drain_stats.max_per_wake) {
+        mbox_drain_stats.max_per_wake = messages;
+    }
 }
 
 // sensor read
 #if defined(OEM_AVNET)
-static void refresh_data(void)
+void refresh_data(void)
 {
     int rand_number;
 
     ic_outbound_data.cmd = IC_READ_SENSOR;
 
+#ifdef LOW_POWER_MODE
+    float temperature, pressure;
+
+    // The last reading is sent again if the conversion does not complete
+    if (lp_imu_sample_one_shot(&temperature, &pressure)) {
+        ic_outbound_data.temperature = round(temperature);
+        ic_outbound_data.pressure = round(pressure);
+    }
+#else
     ic_outbound_data.temperature = round(lp_get_temperature_lps22h());
     ic_outbound_data.pressure = round(lp_get_pressure());
+#endif
 
     rand_number = rand() % 20;
     ic_outbound_data.humidity = 40.0 + rand_number;
+    ic_outbound_data.timestamp_ms = monotonic_ms();
 
     hvac_mode.last_temperature = ic_outbound_data.temperature;
 
@@ -261,6 +404,7 @@ void refresh_data(void)
 
     rand_number = rand() % 40;
     ic_outbound_data.humidity = 40.0 + rand_number;
+    ic_outbound_data.timestamp_ms = monotonic_ms();
 
     hvac_mode.last_temperature = ic_outbound_data.temperature;
 
@@ -268,16 +412,98 @@ void refresh_data(void)
 }
 #endif
 
+#ifdef LOW_POWER_MODE
+/// <summary>
+/// Report the share of the last window the core was awake. Awake time is measured with the cycle counter from each
+/// wake to the next wfi, the window length comes from the scheduler clock.
+/// </summary>
+static void report_power_stats(void)
+{
+    uint32_t now_cycles = periodic_tasks_cycle_count();
+    uint32_t window_ms = scheduler_ms - power_stats.window_start_ms;
+    uint64_t awake_us = power_stats.awake_us + (now_cycles - power_stats.wake_cycles) / PERIODIC_TASKS_CPU_MHZ;
+
+    if (window_ms > 0) {
+        // microseconds per millisecond is parts per thousand
+        uint32_t awake_permille = (uint32_t)(awake_us / window_ms);
+        printf("power: awake %u.%u%%, asleep %u.%u%%, wakes %u in %u ms\n", awake_permille / 10, awake_permille % 10, (1000 - awake_permille) / 10,
+               (1000 - awake_permille) % 10, power_stats.wakes, window_ms);
+    }
+
+    power_stats.window_start_ms = scheduler_ms;
+    power_stats.wake_cycles = now_cycles;
+    power_stats.awake_us = 0;
+    power_stats.wakes = 0;
+}
+#endif
+
+static void report_task_stats(void)
+{
+    periodic_tasks_print_stats(periodic_tasks, NELEMS(periodic_tasks));
+
+    printf("mailbox: wakes %u, signals %u, messages %u, empty wakes %u, max per wake %u\n", mbox_drain_stats.wakes, mbox_drain_stats.signals,
+           mbox_drain_stats.messages, mbox_drain_stats.empty_wakes, mbox_drain_stats.max_per_wake);
+
+#ifdef LOW_POWER_MODE
+    report_power_stats();
+#endif
+}
+
+#ifdef LOW_POWER_MODE
 static void task_scheduler(void *cb_data)
 {
-    static size_t refresh_data_tick_counter = SIZE_MAX;
+    scheduler_ms += scheduler_armed_ms;
+    scheduler_armed_ms = 0;
+
+    periodic_tasks_release(periodic_tasks, NELEMS(periodic_tasks), scheduler_ms);
+}
+
+/// <summary>
+/// Program GPT0 for the next job release rather than ticking every millisecond.
+/// Left alone while armed, a mailbox interrupt wakes the core without moving the deadline.
+/// </summary>
+static void arm_next_release(void)
+{
+    if (scheduler_armed_ms != 0) {
+        return;
+    }
+
+    uint32_t next_ms = periodic_tasks_next_release_ms(periodic_tasks, NELEMS(periodic_tasks), scheduler_ms);
+    if (next_ms == 0) {
+        return;
+    }
+
+    scheduler_armed_ms = next_ms;
+    mtk_os_hal_gpt_reset_timer(gpt_task_scheduler, next_ms, false);
+    mtk_os_hal_gpt_start(gpt_task_scheduler);
+}
+
+/// <summary>
+/// Sleep until the next interrupt if there is no work. Interrupts are masked while checking so an interrupt that
+/// arrives after the check still ends the wfi (a pending interrupt wakes the core even when masked), and is taken
+/// once they are unmasked.
+/// </summary>
+static void sleep_until_interrupt(void)
+{
+    __asm__ volatile("cpsid i" ::: "memory");
 
-    if (refresh_data_tick_counter++ >= 2000) // 2 seconds
-    {
-        refresh_data_tick_counter = 0;
-        refresh_data_trigger = true;
+    if (blockDeqSema == 0 && scheduler_armed_ms != 0 && periodic_tasks_next_release_ms(periodic_tasks, NELEMS(periodic_tasks), scheduler_ms) != 0) {
+        power_stats.awake_us += (periodic_tasks_cycle_count() - power_stats.wake_cycles) / PERIODIC_TASKS_CPU_MHZ;
+
+        __asm__ volatile("dsb\n\twfi\n\tisb" ::: "memory");
+
+        power_stats.wake_cycles = periodic_tasks_cycle_count();
+        power_stats.wakes++;
     }
+
+    __asm__ volatile("cpsie i" ::: "memory");
 }
+#else
+static void task_scheduler(void *cb_data)
+{
+    periodic_tasks_release(periodic_tasks, NELEMS(periodic_tasks), ++scheduler_ms);
+}
+#endif
 
 _Noreturn void RTCoreMain(void)
 {
@@ -295,23 +521,38 @@ _Noreturn void RTCoreMain(void)
     /* and register GPT0 user interrupt callback handle and user data. */
     mtk_os_hal_gpt_config(gpt_task_scheduler, false, &gpt0_int);
 
-    /* configure GPT0 timeout as 1ms and repeat mode. */
-    mtk_os_hal_gpt_reset_timer(gpt_task_scheduler, gpt_task_scheduler_timer_val, true);
-
     initialise_intercore_comms();
     initialize_hardware();
 
+    periodic_tasks_init(periodic_tasks, NELEMS(periodic_tasks), 0);
+
+#ifdef LOW_POWER_MODE
+#if defined(OEM_AVNET)
+    lp_imu_set_low_power(true);
+#endif
+    power_stats.wake_cycles = periodic_tasks_cycle_count();
+
+    /* release the first jobs now, GPT0 is then programmed one shot for each following release */
+    periodic_tasks_release(periodic_tasks, NELEMS(periodic_tasks), scheduler_ms);
+#else
+    /* configure GPT0 timeout as 1ms and repeat mode. */
+    mtk_os_hal_gpt_reset_timer(gpt_task_scheduler, gpt_task_scheduler_timer_val, true);
+
     /* start timer */
     mtk_os_hal_gpt_start(gpt_task_scheduler);
+#endif
 
     for (;;) {
-        if (blockDeqSema > 0) {
-            process_inbound_message();
+        uint32_t signals = atomic_exchange_u32(&blockDeqSema, 0);
+        if (signals > 0) {
+            process_inbound_messages(signals);
         }
 
-        if (refresh_data_trigger) {
-            refresh_data_trigger = false;
-            refresh_data();
-        }
+        periodic_tasks_dispatch(periodic_tasks, NELEMS(periodic_tasks));
+
+#ifdef LOW_POWER_MODE
+        arm_next_release();
+        sleep_until_interrupt();
+#endif
     }
 }
@@ -0,0 +1,188 @@
+#include "periodic_tasks.h"
+#include "printf.h"
+
+#ifdef RT_HOST_BUILD
+#include <time.h>
+
+// Host build, monotonic clock scaled to the M4 core clock so the cycle arithmetic below is unchanged
+static inline uint32_t cycles_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)(((uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec) * PERIODIC_TASKS_CPU_MHZ / 1000);
+}
+#else
+// Cortex-M4 DWT cycle counter, ARM DDI 0403E.d C1.8
+#define DEMCR (*(volatile uint32_t *)0xE000EDFC)
+#define DWT_CTRL (*(volatile uint32_t *)0xE0001000)
+#define DWT_CYCCNT (*(volatile uint32_t *)0xE0001004)
+
+static inline uint32_t cycles_now(void)
+{
+    return DWT_CYCCNT;
+}
+#endif
+
+static inline uint32_t cycles_to_us(uint32_t cycles)
+{
+    return cycles / PERIODIC_TASKS_CPU_MHZ;
+}
+
+// wrap safe "a is at or after b" for millisecond timestamps
+static inline bool time_reached(uint32_t now_ms, uint32_t when_ms)
+{
+    return (int32_t)(now_ms - when_ms) >= 0;
+}
+
+static inline uint32_t deadline_us(const PERIODIC_TASK *task)
+{
+    return (task->deadline_ms ? task->deadline_ms : task->period_ms) * 1000;
+}
+
+void periodic_tasks_init(PERIODIC_TASK *tasks[], size_t task_count, uint32_t now_ms)
+{
+#ifndef RT_HOST_BUILD
+    // DEMCR.TRCENA enables the DWT unit, DWT_CTRL.CYCCNTENA starts the cycle counter
+    DEMCR |= 1 << 24;
+    DWT_CTRL |= 1;
+#endif
+
+    // insertion sort, the table is small and stays in declaration order for equal priorities
+    for (size_t i = 1; i < task_count; i++) {
+        PERIODIC_TASK *task = tasks[i];
+        size_t j = i;
+        while (j > 0 && tasks[j - 1]->priority > task->priority) {
+            tasks[j] = tasks[j - 1];
+            j--;
+        }
+        tasks[j] = task;
+    }
+
+    for (size_t i = 0; i < task_count; i++) {
+        tasks[i]->next_release_ms = now_ms;
+        tasks[i]->pending = false;
+    }
+}
+
+size_t periodic_tasks_release(PERIODIC_TASK *tasks[], size_t task_count, uint32_t now_ms)
+{
+    size_t released = 0;
+
+    for (size_t i = 0; i < task_count; i++) {
+        PERIODIC_TASK *task = tasks[i];
+
+        if (!time_reached(now_ms, task->next_release_ms)) {
+            continue;
+        }
+
+        if (task->pending) {
+            // the previous job has not started yet
+            task->stats.missed_releases++;
+        }
+
+        task->release_cycles = cycles_now();
+        task->pending = true;
+        task->stats.releases++;
+        released++;
+
+        task->next_release_ms += task->period_ms;
+        if (time_reached(now_ms, task->next_release_ms)) {
+            // more than a period behind, skip the lost releases rather than bursting to catch up
+            task->next_release_ms = now_ms + task->period_ms;
+        }
+
+        if (task->on_release) {
+            task->on_release();
+        }
+    }
+
+    return released;
+}
+
+void periodic_task_begin(PERIODIC_TASK *task)
+{
+    task->start_cycles = cycles_now();
+    task->pending = false;
+
+    uint32_t lateness_us = cycles_to_us(task->start_cycles - task->release_cycles);
+    if (lateness_us > task->stats.lateness_us_max) {
+        task->stats.lateness_us_max = lateness_us;
+    }
+}
+
+void periodic_task_end(PERIODIC_TASK *task)
+{
+    uint32_t end_cycles = cycles_now();
+    uint32_t response_us = cycles_to_us(end_cycles - task->release_cycles);
+
+    task->stats.exec_us_last = cycles_to_us(end_cycles - task->start_cycles);
+    task->stats.completions++;
+
+    if (task->stats.exec_us_last > task->stats.exec_us_max) {
+        task->stats.exec_us_max = task->stats.exec_us_last;
+    }
+
+    if (response_us > task->stats.response_us_max) {
+        task->stats.response_us_max = response_us;
+    }
+
+    if (response_us > deadline_us(task)) {
+        task->stats.deadline_overruns++;
+        printf("Deadline overrun: %s, response %u us, deadline %u us\n", task->name, response_us, deadline_us(task));
+    }
+}
+
+size_t periodic_tasks_dispatch(PERIODIC_TASK *tasks[], size_t task_count)
+{
+    size_t dispatched = 0;
+
+    for (size_t i = 0; i < task_count; i++) {
+        PERIODIC_TASK *task = tasks[i];
+
+        if (task->pending && task->handler) {
+            periodic_task_begin(task);
+            task->handler();
+            periodic_task_end(task);
+            dispatched++;
+        }
+    }
+
+    return dispatched;
+}
+
+uint32_t periodic_tasks_next_release_ms(PERIODIC_TASK *tasks[], size_t task_count, uint32_t now_ms)
+{
+    uint32_t next_ms = UINT32_MAX;
+
+    for (size_t i = 0; i < task_count; i++) {
+        if (tasks[i]->pending || time_reached(now_ms, tasks[i]->next_release_ms)) {
+            return 0;
+        }
+        if (tasks[i]->next_release_ms - now_ms < next_ms) {
+            next_ms = tasks[i]->next_release_ms - now_ms;
+        }
+    }
+
+    return next_ms;
+}
+
+void periodic_task_set_period(PERIODIC_TASK *task, uint32_t period_ms, uint32_t now_ms)
+{
+    task->period_ms = period_ms;
+    task->next_release_ms = now_ms + period_ms;
+}
+
+uint32_t periodic_tasks_cycle_count(void)
+{
+    return cycles_now();
+}
+
+void periodic_tasks_print_stats(PERIODIC_TASK *tasks[], size_t task_count)
+{
+    for (size_t i = 0; i < task_count; i++) {
+        PERIODIC_TASK_STATS *stats = &tasks[i]->stats;
+        printf("%s: releases %u, exec max %u us, lateness max %u us, response max %u us, deadline overruns %u, missed releases %u\n",
+               tasks[i]->name, stats->releases, stats->exec_us_max, stats->lateness_us_max, stats->response_us_max, stats->deadline_overruns,
+               stats->missed_releases);
+    }
+}
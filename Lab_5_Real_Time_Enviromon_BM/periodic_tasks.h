@@ -0,0 +1,94 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*************************************************************************************************************************************
+ * Table driven periodic tasks
+ *
+ * Each job is declared once with its period, deadline and priority. The scheduler tick calls periodic_tasks_release,
+ * jobs then run either from periodic_tasks_dispatch (bare-metal main loop) or in their own thread which brackets the
+ * work with periodic_task_begin and periodic_task_end (Azure RTOS).
+ *
+ * Execution time, lateness (release to start) and response time (release to completion) are measured with the
+ * DWT cycle counter. A job that completes after its deadline, or is released again before it started, is counted
+ * as an overrun.
+ *************************************************************************************************************************************/
+
+// MT3620 M4 core clock, used to convert cycle counts to microseconds
+#define PERIODIC_TASKS_CPU_MHZ 197
+
+#ifndef NELEMS
+#define NELEMS(x) (sizeof(x) / sizeof((x)[0]))
+#endif
+
+typedef void (*PERIODIC_TASK_HANDLER)(void);
+
+typedef struct {
+    uint32_t releases;
+    uint32_t completions;
+    uint32_t deadline_overruns;
+    uint32_t missed_releases;
+    uint32_t exec_us_last;
+    uint32_t exec_us_max;
+    uint32_t lateness_us_max;
+    uint32_t response_us_max;
+} PERIODIC_TASK_STATS;
+
+typedef struct {
+    const char *name;
+    uint32_t period_ms;
+    uint32_t deadline_ms;                  // relative to release, zero means the deadline is the period
+    uint8_t priority;                      // periodic_tasks_dispatch runs released jobs in ascending priority order
+    PERIODIC_TASK_HANDLER handler;         // job body, run by periodic_tasks_dispatch
+    PERIODIC_TASK_HANDLER on_release;      // called in the release context, for example to wake the job's thread
+    uint32_t next_release_ms;
+    uint32_t release_cycles;
+    uint32_t start_cycles;
+    volatile bool pending;
+    PERIODIC_TASK_STATS stats;
+} PERIODIC_TASK;
+
+/// <summary>
+/// Sort the table by priority, start the cycle counter and release every job at now_ms
+/// </summary>
+void periodic_tasks_init(PERIODIC_TASK *tasks[], size_t task_count, uint32_t now_ms);
+
+/// <summary>
+/// Release the jobs that are due. Call from the scheduler tick.
+/// </summary>
+/// <returns>Number of jobs released</returns>
+size_t periodic_tasks_release(PERIODIC_TASK *tasks[], size_t task_count, uint32_t now_ms);
+
+/// <summary>
+/// Run the released jobs that have a handler, highest priority first
+/// </summary>
+/// <returns>Number of jobs run</returns>
+size_t periodic_tasks_dispatch(PERIODIC_TASK *tasks[], size_t task_count);
+
+/// <summary>
+/// Mark the start and end of a job that runs in its own thread
+/// </summary>
+void periodic_task_begin(PERIODIC_TASK *task);
+void periodic_task_end(PERIODIC_TASK *task);
+
+/// <summary>
+/// Milliseconds from now_ms until the next job release, zero if a job is already pending
+/// </summary>
+uint32_t periodic_tasks_next_release_ms(PERIODIC_TASK *tasks[], size_t task_count, uint32_t now_ms);
+
+/// <summary>
+/// Change the period of a job, the next release is rescheduled from now_ms
+/// </summary>
+void periodic_task_set_period(PERIODIC_TASK *task, uint32_t period_ms, uint32_t now_ms);
+
+/// <summary>
+/// Current value of the cycle counter used for the job timing
+/// </summary>
+uint32_t periodic_tasks_cycle_count(void);
+
+/// <summary>
+/// Print the worst case numbers for each job
+/// </summary>
+void periodic_tasks_print_stats(PERIODIC_TASK *tasks[], size_t task_count);
@@ -44,10 +44,14 @@
 #include "mt3620-intercore.h"
 #include "os_hal_gpio.h"
 #include "os_hal_uart.h"
+#include "periodic_tasks.h"
 #include "printf.h"
+#include "rt_trace.h"
 #include "tx_api.h"
 #include <math.h>
 #include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
 #include <time.h>
 
 #define DEMO_STACK_SIZE 1024
@@ -57,17 +61,20 @@
 
 // 1 tick = 10ms. It is configurable.
 #define MS_TO_TICK(ms)  ((ms) * (TX_TIMER_TICKS_PER_SECOND) / 1000)
+// Monotonic milliseconds for the task scheduler and the intercore timestamps, tick resolution. Scaling the 32 bit tick
+// count keeps the value wrapping at 2^32, as the scheduler and the high-level app expect.
+#define MONOTONIC_MS()  ((uint32_t)tx_time_get() * (1000 / TX_TIMER_TICKS_PER_SECOND))
 
 // forward signatures
 void set_hvac_operating_mode(int temperature);
 
 // resources for inter core messaging
 static uint8_t buf[256];
+static uint8_t trace_buf[20 + sizeof(INTERCORE_TRACE_BLOCK)];
 static uint32_t dataSize;
 static BufferHeader* outbound, * inbound;
 static uint32_t sharedBufSize = 0;
 static const size_t payloadStart = 20;
-static int sensorSampleRateInSeconds = 500; // initialize to 5 seconds 500 ticks at 10ms a tick
 
 INTERCORE_BLOCK ic_control_block;
 INTERCORE_BLOCK environment_control_block;
@@ -111,6 +118,14 @@ void intercore_thread(ULONG thread_input);
 void read_sensor_thread(ULONG thread_input);
 void timer_scheduler(ULONG input);
 
+// Periodic jobs, released by timer_scheduler and run in their own threads. Priorities are rate monotonic and used as the thread priorities.
+static void release_read_sensor(void);
+static void release_intercore(void);
+
+PERIODIC_TASK task_intercore = { .name = "intercore", .period_ms = 250, .priority = 2, .on_release = release_intercore };
+PERIODIC_TASK task_read_sensor = { .name = "read sensor", .period_ms = 5000, .priority = 3, .on_release = release_read_sensor };
+
+PERIODIC_TASK* periodic_tasks[] = { &task_intercore, &task_read_sensor };
 
 int main() {
     tx_kernel_enter(); // Enter the Azure RTOS kernel.
@@ -121,6 +136,9 @@ void tx_application_define(void* first_unused_memory) {
     CHAR* pointer;
     UINT status = TX_SUCCESS;
 
+    // Start tracing before any objects are created so they are registered by name (THREADX_EVENT_TRACE builds only)
+    rt_trace_init();
+
     /* Create a byte memory pool from which to allocate the thread stacks.  */
     tx_byte_pool_create(&byte_pool_0, "byte pool 0", memory_area, DEMO_BYTE_POOL_SIZE);
 
@@ -139,12 +157,12 @@ void tx_application_define(void* first_unused_memory) {
     tx_byte_allocate(&byte_pool_0, (VOID**)&pointer, DEMO_STACK_SIZE, TX_NO_WAIT);
     /* Create the main thread.  */
     tx_thread_create(&tx_hardware_Thread, "read sensor thread", read_sensor_thread, 0,
-        pointer, DEMO_STACK_SIZE, 1, 1, TX_NO_TIME_SLICE, TX_AUTO_START);
+        pointer, DEMO_STACK_SIZE, task_read_sensor.priority, task_read_sensor.priority, TX_NO_TIME_SLICE, TX_AUTO_START);
 
     tx_byte_allocate(&byte_pool_0, (VOID**)&pointer, DEMO_STACK_SIZE, TX_NO_WAIT);
     /* Create the intercore msg thread.  */
     tx_thread_create(&tx_Intercore_Thread, "Intercore Thread", intercore_thread, 0,
-        pointer, DEMO_STACK_SIZE, 4, 4, TX_NO_TIME_SLICE, TX_AUTO_START);
+        pointer, DEMO_STACK_SIZE, task_intercore.priority, task_intercore.priority, TX_NO_TIME_SLICE, TX_AUTO_START);
 
     tx_byte_allocate(&byte_pool_0, (VOID**)&pointer, DEMO_STACK_SIZE, TX_NO_WAIT);
     // Create a hardware init thread.
@@ -152,6 +170,7 @@ void tx_application_define(void* first_unused_memory) {
         pointer, DEMO_STACK_SIZE, 1, 1, TX_NO_TIME_SLICE, TX_AUTO_START);
 }
 
+#ifndef RT_HOST_BUILD
 // https://embeddedartistry.com/blog/2017/02/17/implementing-malloc-with-threadx/
 // overrides for malloc and free required for srand and rand
 void* malloc(size_t size) {
@@ -176,6 +195,7 @@ void free(void* ptr) {
         tx_byte_release(ptr);
     }
 }
+#endif // RT_HOST_BUILD
 
 // initialize hardware here.
 #if defined(OEM_AVNET)
@@ -230,41 +250,64 @@ bool initialize_hardware(void) {
 #endif
 
 
+static void release_read_sensor(void) {
+    if (tx_event_flags_set(&hardware_event_flags_0, 0x1, TX_OR) != TX_SUCCESS) {
+        printf("failed to set hardware event flags\r\n");
+    }
+}
+
+static void release_intercore(void) {
+    if (tx_event_flags_set(&Intercore_event_flags_0, 0x1, TX_OR) != TX_SUCCESS) {
+        printf("failed to set Intercore event flags\r\n");
+    }
+}
+
 // Using default threadX 10ms tick period
 void timer_scheduler(ULONG input) {
-    static size_t intercoreTickCounter = 0;
-    static size_t readSensorTickCounter = SIZE_MAX;
-    ULONG status = TX_SUCCESS;
-
     if (hardwareInitOK == true) {
-        readSensorTickCounter++;
-        if (readSensorTickCounter >= sensorSampleRateInSeconds) {
-            readSensorTickCounter = 0;
-            status = tx_event_flags_set(&hardware_event_flags_0, 0x1, TX_OR);
-            if (status != TX_SUCCESS) {
-                printf("failed to set hardware event flags\r\n");
-            }
-        }
-
-        intercoreTickCounter++;
-        if (intercoreTickCounter >= 25)  // 250ms = 0.25 seconds.
-        {
-            intercoreTickCounter = 0;
-            status = tx_event_flags_set(&Intercore_event_flags_0, 0x1, TX_OR);
-            if (status != TX_SUCCESS) {
-                printf("failed to set Intercore event flags\r\n");
-            }
-        }
+        periodic_tasks_release(periodic_tasks, NELEMS(periodic_tasks), MONOTONIC_MS());
     }
 }
 
 void send_intercore_msg(void) {
+    environment_control_block.reply_ms = MONOTONIC_MS();
     memcpy((void*)&buf[payloadStart], (void*)&environment_control_block, sizeof(environment_control_block));
     dataSize = payloadStart + sizeof(environment_control_block);
 
     EnqueueData(inbound, outbound, sharedBufSize, buf, dataSize);
 }
 
+void send_trace_chunk(uint32_t offset) {
+    // reuse the component id and reserved header of the request
+    memcpy((void*)trace_buf, (void*)buf, payloadStart);
+    uint32_t length = rt_trace_read_chunk(offset, (INTERCORE_TRACE_BLOCK*)&trace_buf[payloadStart]);
+
+    EnqueueData(inbound, outbound, sharedBufSize, trace_buf, payloadStart + length);
+}
+
+/// <summary>
+/// Reply to IC_RT_STATS with the worst case timing of each periodic task, each task runs in its own thread
+/// </summary>
+void send_rt_stats(void) {
+    INTERCORE_STATS_BLOCK stats = { .cmd = IC_RT_STATS, .uptime_ms = MONOTONIC_MS() };
+
+    for (size_t i = 0; i < NELEMS(periodic_tasks) && i < IC_RT_STATS_TASKS; i++) {
+        INTERCORE_TASK_STATS* task = &stats.tasks[stats.task_count++];
+
+        strncpy(task->name, periodic_tasks[i]->name, IC_RT_STATS_NAME_BYTES - 1);
+        task->releases = periodic_tasks[i]->stats.releases;
+        task->deadline_overruns = periodic_tasks[i]->stats.deadline_overruns;
+        task->missed_releases = periodic_tasks[i]->stats.missed_releases;
+        task->exec_us_max = periodic_tasks[i]->stats.exec_us_max;
+        task->lateness_us_max = periodic_tasks[i]->stats.lateness_us_max;
+        task->response_us_max = periodic_tasks[i]->stats.response_us_max;
+    }
+
+    // reuse the component id and reserved header of the request
+    memcpy((void*)&buf[payloadStart], (void*)&stats, sizeof(stats));
+    EnqueueData(inbound, outbound, sharedBufSize, buf, payloadStart + sizeof(stats));
+}
+
 /*************************************************************************************************************************************
 * This thread monitors intercore messages.
 * There needs to be a shared understanding of the data structure being shared between the real-time and high-level apps
@@ -285,6 +328,7 @@ void intercore_thread(ULONG thread_input) {
 
         if ((status != TX_SUCCESS) || (actual_flags != 0x1)) { break; }
 
+        periodic_task_begin(&task_intercore);
         queuedMessages = true;
 
         while (queuedMessages) {
@@ -305,6 +349,26 @@ void intercore_thread(ULONG thread_input) {
                     hvac_mode.target_temperature = ic_control_block.temperature;
                     set_hvac_operating_mode(hvac_mode.last_temperature);
                     break;
+                case IC_TRACE_CHUNK:
+                    if (dataSize >= payloadStart + IC_TRACE_REQUEST_LENGTH) {
+                        send_trace_chunk(((INTERCORE_TRACE_BLOCK*)&buf[payloadStart])->offset);
+                    }
+                    break;
+                case IC_RT_STATS:
+                    send_rt_stats();
+                    break;
+                case IC_SAMPLE_RATE:
+                    if (dataSize >= payloadStart + sizeof(INTERCORE_RATE_BLOCK)) {
+                        uint32_t period_ms = ((INTERCORE_RATE_BLOCK*)&buf[payloadStart])->read_period_ms;
+
+                        if (period_ms >= IC_SAMPLE_RATE_MIN_MS && period_ms <= IC_SAMPLE_RATE_MAX_MS) {
+                            // Same clock as timer_scheduler, which must not release the task mid update
+                            UINT interrupts = tx_interrupt_control(TX_INT_DISABLE);
+                            periodic_task_set_period(&task_read_sensor, period_ms, MONOTONIC_MS());
+                            tx_interrupt_control(interrupts);
+                        }
+                    }
+                    break;
                 default:
                     break;
                 }
@@ -313,6 +377,8 @@ void intercore_thread(ULONG thread_input) {
                 queuedMessages = false;
             }
         }
+
+        periodic_task_end(&task_intercore);
     }
 }
 
@@ -364,6 +430,8 @@ void read_sensor_thread(ULONG thread_input) {
 
         if ((status != TX_SUCCESS) || (actual_flags != 0x1)) { break; }
 
+        periodic_task_begin(&task_read_sensor);
+
         environment_control_block.cmd = IC_READ_SENSOR;
 
         environment_control_block.temperature = (int)lp_get_temperature_lps22h();
@@ -371,10 +439,13 @@ void read_sensor_thread(ULONG thread_input) {
 
         rand_number = rand() % 20;
         environment_control_block.humidity = 40 + rand_number;
+        environment_control_block.timestamp_ms = MONOTONIC_MS();
 
         hvac_mode.last_temperature = environment_control_block.temperature;
 
         set_hvac_operating_mode(environment_control_block.temperature);
+
+        periodic_task_end(&task_read_sensor);
     }
 }
 #else
@@ -391,6 +462,8 @@ void read_sensor_thread(ULONG thread_input) {
 
         if ((status != TX_SUCCESS) || (actual_flags != 0x1)) { break; }
 
+        periodic_task_begin(&task_read_sensor);
+
         environment_control_block.cmd = IC_READ_SENSOR;
 
         rand_number = (rand() % 10);
@@ -401,10 +474,13 @@ void read_sensor_thread(ULONG thread_input) {
 
         rand_number = (rand() % 20);
         environment_control_block.humidity = 40 + rand_number;
+        environment_control_block.timestamp_ms = MONOTONIC_MS();
 
         hvac_mode.last_temperature = environment_control_block.temperature;
 
         set_hvac_operating_mode(environment_control_block.temperature);
+
+        periodic_task_end(&task_read_sensor);
     }
 }
 #endif
@@ -420,6 +496,7 @@ void hardware_init_thread(ULONG thread_input) {
 
     if (initialize_hardware()) {
         // start the timer.
+        periodic_tasks_init(periodic_tasks, NELEMS(periodic_tasks), MONOTONIC_MS());
         hardwareInitOK = true;
         status = tx_timer_create(&msTimer, "10ms Timer", timer_scheduler, 0, 1, 1, TX_AUTO_ACTIVATE);
         if (status != TX_SUCCESS) {
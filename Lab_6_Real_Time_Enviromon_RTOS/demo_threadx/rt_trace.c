@@ -0,0 +1,70 @@
+#include "rt_trace.h"
+#include "mt3620-baremetal.h"
+#include <stdbool.h>
+#include <string.h>
+
+#ifdef TX_ENABLE_EVENT_TRACE
+
+// The Cortex-M4 ThreadX port timestamps trace events with the DWT cycle counter
+static const uintptr_t DWT_BASE = 0xE0001000;
+static const uintptr_t DEMCR_ADDRESS = 0xE000EDFC;
+
+static UCHAR trace_buffer[RT_TRACE_BUFFER_SIZE] __attribute__((aligned(4)));
+static bool trace_frozen = false;
+
+void rt_trace_init(void) {
+#ifndef RT_HOST_BUILD
+    // DEMCR.TRCENA enables the DWT unit, DWT_CTRL.CYCCNTENA starts the cycle counter
+    SetReg32(DEMCR_ADDRESS, 0, 1 << 24);
+    WriteReg32(DWT_BASE, 0x04, 0);
+    SetReg32(DWT_BASE, 0x00, 1);
+#endif
+
+    tx_trace_enable(trace_buffer, sizeof(trace_buffer), RT_TRACE_REGISTRY_ENTRIES);
+}
+
+uint32_t rt_trace_read_chunk(uint32_t offset, INTERCORE_TRACE_BLOCK *reply) {
+    if (offset == 0 && !trace_frozen) {
+        // Stop recording, the buffer and its header are left intact for reading
+        tx_trace_disable();
+        trace_frozen = true;
+    }
+
+    reply->cmd = IC_TRACE_CHUNK;
+    reply->offset = offset;
+    reply->total_size = sizeof(trace_buffer);
+    reply->length = 0;
+
+    if (trace_frozen && offset < sizeof(trace_buffer)) {
+        reply->length = sizeof(trace_buffer) - offset;
+        if (reply->length > IC_TRACE_CHUNK_BYTES) {
+            reply->length = IC_TRACE_CHUNK_BYTES;
+        }
+        memcpy(reply->data, &trace_buffer[offset], reply->length);
+    }
+
+    if (trace_frozen && offset + reply->length >= sizeof(trace_buffer)) {
+        // Last chunk read, start a new trace
+        trace_frozen = false;
+        tx_trace_enable(trace_buffer, sizeof(trace_buffer), RT_TRACE_REGISTRY_ENTRIES);
+    }
+
+    return IC_TRACE_REQUEST_LENGTH + reply->length;
+}
+
+#else
+
+void rt_trace_init(void) {
+}
+
+uint32_t rt_trace_read_chunk(uint32_t offset, INTERCORE_TRACE_BLOCK *reply) {
+    // Built without THREADX_EVENT_TRACE, a total size of zero tells the high-level app there is no trace
+    reply->cmd = IC_TRACE_CHUNK;
+    reply->offset = offset;
+    reply->length = 0;
+    reply->total_size = 0;
+
+    return IC_TRACE_REQUEST_LENGTH;
+}
+
+#endif // TX_ENABLE_EVENT_TRACE
@@ -0,0 +1,26 @@
+#pragma once
+
+#include "intercore_contract.h"
+#include "tx_api.h"
+
+// ThreadX event trace buffer. Registry entries are sized for the threads, event flags, pools and timer created by the app.
+#define RT_TRACE_BUFFER_SIZE (32 * 1024)
+#define RT_TRACE_REGISTRY_ENTRIES 16
+
+// ISR ids recorded in ISR enter/exit trace events
+#define RT_TRACE_ISR_SYSTICK 15
+
+/// <summary>
+/// Enable ThreadX event tracing into the RAM trace buffer.
+/// Call at the start of tx_application_define so the threads and event flags are registered by name.
+/// Does nothing unless built with THREADX_EVENT_TRACE.
+/// </summary>
+void rt_trace_init(void);
+
+/// <summary>
+/// Copy the trace chunk at offset into the reply block.
+/// The first request (offset zero) freezes the trace so the high-level app reads a consistent snapshot,
+/// tracing restarts once the last chunk has been read.
+/// </summary>
+/// <returns>Number of bytes to send, header included</returns>
+uint32_t rt_trace_read_chunk(uint32_t offset, INTERCORE_TRACE_BLOCK *reply);
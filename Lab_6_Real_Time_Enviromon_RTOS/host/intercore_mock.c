@@ -0,0 +1,196 @@
+/*************************************************************************************************************************************
+ * Intercore mock for the host build of the real-time app
+ *
+ * Replaces the MT3620 mailbox and shared buffers with two in-process message queues, and runs a simulated high-level app
+ * on a plain pthread (outside the ThreadX scheduler). The simulated high-level app sets a target temperature, requests a
+ * sensor reading every RT_HOST_REQUEST_MS milliseconds (default 1000) and measures the request to reply latency.
+ *
+ * After RT_HOST_RUN_SECONDS seconds (default 30, zero runs forever) the periodic task numbers are requested with IC_RT_STATS,
+ * the latency and periodic task numbers are printed and the process exits, so perf and the sanitizers see a normal exit.
+ *************************************************************************************************************************************/
+
+#include "intercore_contract.h"
+#include "mt3620-intercore.h"
+#include "periodic_tasks.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// Same limits as the MT3620 mailbox: 1024 bytes of message plus the 16 byte component id and 4 reserved bytes
+#define MOCK_MESSAGE_MAX 1044
+#define MOCK_QUEUE_DEPTH 16
+#define MOCK_PAYLOAD_START 20
+
+typedef struct {
+    uint8_t data[MOCK_QUEUE_DEPTH][MOCK_MESSAGE_MAX];
+    uint32_t length[MOCK_QUEUE_DEPTH];
+    size_t head;
+    size_t count;
+    uint32_t dropped;
+} MESSAGE_QUEUE;
+
+// Periodic jobs declared in demo_threadx.c
+extern PERIODIC_TASK task_intercore;
+extern PERIODIC_TASK task_read_sensor;
+
+static pthread_mutex_t queue_lock = PTHREAD_MUTEX_INITIALIZER;
+static MESSAGE_QUEUE to_real_time;
+static MESSAGE_QUEUE to_high_level;
+
+// Handed to the app so the EnqueueData and DequeueData calls can tell the direction
+static BufferHeader outbound_header;
+static BufferHeader inbound_header;
+
+static pthread_t high_level_thread;
+
+static uint64_t now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+}
+
+static unsigned env_unsigned(const char* name, unsigned default_value) {
+    const char* value = getenv(name);
+    return value ? (unsigned)strtoul(value, NULL, 10) : default_value;
+}
+
+static int queue_put(MESSAGE_QUEUE* queue, const void* src, uint32_t length) {
+    int result = -1;
+
+    pthread_mutex_lock(&queue_lock);
+    if (length <= MOCK_MESSAGE_MAX && queue->count < MOCK_QUEUE_DEPTH) {
+        size_t slot = (queue->head + queue->count) % MOCK_QUEUE_DEPTH;
+        memcpy(queue->data[slot], src, length);
+        queue->length[slot] = length;
+        queue->count++;
+        result = 0;
+    } else {
+        queue->dropped++;
+    }
+    pthread_mutex_unlock(&queue_lock);
+
+    return result;
+}
+
+static int queue_get(MESSAGE_QUEUE* queue, void* dest, uint32_t* length) {
+    int result = -1;
+
+    pthread_mutex_lock(&queue_lock);
+    if (queue->count > 0 && queue->length[queue->head] <= *length) {
+        *length = queue->length[queue->head];
+        memcpy(dest, queue->data[queue->head], *length);
+        queue->head = (queue->head + 1) % MOCK_QUEUE_DEPTH;
+        queue->count--;
+        result = 0;
+    }
+    pthread_mutex_unlock(&queue_lock);
+
+    return result;
+}
+
+static void send_to_real_time(const void* payload, size_t length) {
+    uint8_t message[MOCK_MESSAGE_MAX] = { 0 };
+
+    // component id and reserved bytes are left zero, the real-time app echoes them back
+    memcpy(&message[MOCK_PAYLOAD_START], payload, length);
+    queue_put(&to_real_time, message, (uint32_t)(MOCK_PAYLOAD_START + length));
+}
+
+static void print_task(const PERIODIC_TASK* task) {
+    printf("  %-12s releases %u, completions %u, exec max %u us, lateness max %u us, response max %u us, overruns %u, missed %u\n",
+        task->name, task->stats.releases, task->stats.completions, task->stats.exec_us_max, task->stats.lateness_us_max,
+        task->stats.response_us_max, task->stats.deadline_overruns, task->stats.missed_releases);
+}
+
+static void* high_level_app(void* arg) {
+    unsigned run_seconds = env_unsigned("RT_HOST_RUN_SECONDS", 30);
+    unsigned request_ms = env_unsigned("RT_HOST_REQUEST_MS", 1000);
+    uint64_t start_us = now_us();
+    uint64_t next_request_us = start_us;
+    uint64_t request_sent_us = 0;
+    uint64_t latency_total_us = 0, latency_max_us = 0;
+    unsigned requests = 0, replies = 0;
+    uint8_t message[MOCK_MESSAGE_MAX];
+
+    INTERCORE_BLOCK target = { .cmd = IC_TARGET_TEMPERATURE, .temperature = 22 };
+    send_to_real_time(&target, sizeof(target));
+
+    while (run_seconds == 0 || now_us() - start_us < (uint64_t)run_seconds * 1000000) {
+        if (now_us() >= next_request_us) {
+            INTERCORE_BLOCK request = { .cmd = IC_READ_SENSOR };
+            send_to_real_time(&request, sizeof(request));
+            request_sent_us = now_us();
+            next_request_us += (uint64_t)request_ms * 1000;
+            requests++;
+        }
+
+        uint32_t length = sizeof(message);
+        while (queue_get(&to_high_level, message, &length) == 0) {
+            INTERCORE_BLOCK* reply = (INTERCORE_BLOCK*)&message[MOCK_PAYLOAD_START];
+
+            if (length >= MOCK_PAYLOAD_START + sizeof(INTERCORE_BLOCK) && reply->cmd == IC_READ_SENSOR) {
+                uint64_t latency_us = now_us() - request_sent_us;
+                latency_total_us += latency_us;
+                latency_max_us = latency_us > latency_max_us ? latency_us : latency_max_us;
+                replies++;
+
+                printf("HL: temperature %d, pressure %d, humidity %d, mode %d, sample age %u ms, latency %llu us\n", reply->temperature,
+                    reply->pressure, reply->humidity, reply->operating_mode, reply->reply_ms - reply->timestamp_ms,
+                    (unsigned long long)latency_us);
+            }
+            length = sizeof(message);
+        }
+
+        usleep(1000);
+    }
+
+    // Ask for the periodic task stats the way the Lab 7 GetDiagnostics direct method does
+    INTERCORE_BLOCK stats_request = { .cmd = IC_RT_STATS };
+    send_to_real_time(&stats_request, sizeof(stats_request));
+
+    for (uint64_t stats_deadline_us = now_us() + 100000; now_us() < stats_deadline_us; usleep(1000)) {
+        uint32_t length = sizeof(message);
+        if (queue_get(&to_high_level, message, &length) == 0 && length >= MOCK_PAYLOAD_START + sizeof(INTERCORE_STATS_BLOCK) &&
+            ((INTERCORE_STATS_BLOCK*)&message[MOCK_PAYLOAD_START])->cmd == IC_RT_STATS) {
+            INTERCORE_STATS_BLOCK* stats = (INTERCORE_STATS_BLOCK*)&message[MOCK_PAYLOAD_START];
+
+            printf("HL: IC_RT_STATS at %u ms\n", stats->uptime_ms);
+            for (uint32_t i = 0; i < stats->task_count && i < IC_RT_STATS_TASKS; i++) {
+                printf("  %-12s releases %u, exec max %u us, lateness max %u us, response max %u us, overruns %u, missed %u\n",
+                    stats->tasks[i].name, stats->tasks[i].releases, stats->tasks[i].exec_us_max, stats->tasks[i].lateness_us_max,
+                    stats->tasks[i].response_us_max, stats->tasks[i].deadline_overruns, stats->tasks[i].missed_releases);
+            }
+            break;
+        }
+    }
+
+    printf("\nHost run complete: %u requests, %u replies, latency avg %llu us, max %llu us, dropped %u/%u\n", requests, replies,
+        replies ? (unsigned long long)(latency_total_us / replies) : 0ULL, (unsigned long long)latency_max_us, to_real_time.dropped,
+        to_high_level.dropped);
+    print_task(&task_intercore);
+    print_task(&task_read_sensor);
+
+    exit(EXIT_SUCCESS);
+    return arg;
+}
+
+int GetIntercoreBuffers(BufferHeader** outbound, BufferHeader** inbound, uint32_t* bufSize) {
+    *outbound = &outbound_header;
+    *inbound = &inbound_header;
+    *bufSize = MOCK_QUEUE_DEPTH * MOCK_MESSAGE_MAX;
+
+    return pthread_create(&high_level_thread, NULL, high_level_app, NULL) == 0 ? 0 : -1;
+}
+
+int EnqueueData(BufferHeader* inbound, BufferHeader* outbound, uint32_t bufSize, const void* src, uint32_t dataSize) {
+    return queue_put(&to_high_level, src, dataSize);
+}
+
+int DequeueData(BufferHeader* outbound, BufferHeader* inbound, uint32_t bufSize, void* dest, uint32_t* dataSize) {
+    return queue_get(&to_real_time, dest, dataSize);
+}
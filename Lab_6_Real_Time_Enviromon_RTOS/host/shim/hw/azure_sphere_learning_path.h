@@ -0,0 +1,6 @@
+#pragma once
+
+// Host build: stand in for the generated hardware definition, the values only identify the LED in the GPIO log
+#define LED_RED 8
+#define LED_GREEN 9
+#define LED_BLUE 10
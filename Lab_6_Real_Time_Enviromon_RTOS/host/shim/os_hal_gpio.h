@@ -0,0 +1,23 @@
+#pragma once
+
+#include <stdio.h>
+
+// Host build: GPIO writes are logged rather than driving pins
+
+typedef enum {
+    OS_HAL_GPIO_DIR_INPUT = 0,
+    OS_HAL_GPIO_DIR_OUTPUT = 1,
+} os_hal_gpio_direction;
+
+typedef int os_hal_gpio_pin;
+
+static inline int mtk_os_hal_gpio_set_direction(os_hal_gpio_pin pin, os_hal_gpio_direction dir) {
+    (void)pin;
+    (void)dir;
+    return 0;
+}
+
+static inline int mtk_os_hal_gpio_set_output(os_hal_gpio_pin pin, int out_val) {
+    printf("gpio %d = %d\n", pin, out_val);
+    return 0;
+}
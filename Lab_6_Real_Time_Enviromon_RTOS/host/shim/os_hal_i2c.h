@@ -0,0 +1,6 @@
+#pragma once
+
+// Host build: no I2C, the app runs with the simulated sensors. The IMU header only needs the bus speed constant.
+typedef enum {
+    I2C_SCL_1000kHz = 7,
+} I2C_SPEED_KHZ;
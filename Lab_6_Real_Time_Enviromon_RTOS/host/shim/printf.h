@@ -0,0 +1,4 @@
+#pragma once
+
+// Host build: the MT3620 BSP printf is replaced by the C library printf
+#include <stdio.h>
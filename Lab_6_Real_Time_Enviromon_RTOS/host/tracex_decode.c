@@ -0,0 +1,252 @@
+/*************************************************************************************************************************************
+ * ThreadX event trace decoder
+ *
+ * Reassembles the trace buffer captured with the Lab 7 RtTraceCapture direct method and prints a timeline of
+ * thread switches, ISR entries and event flag operations.
+ *
+ * Build the real-time app with THREADX_EVENT_TRACE=ON, save the high-level app debug output to a file, then run
+ *
+ *   tracex_decode [--mhz <core clock MHz>] <debug log file>
+ *
+ * Only "RT_TRACE <total> <offset> <hex>" lines are read, anything else in the log is ignored.
+ *
+ * The buffer layout follows tx_trace.h: a header, the object registry, then a circular buffer of 32 byte entries.
+ *************************************************************************************************************************************/
+
+#include "periodic_tasks.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TX_TRACE_VALID 0x54585442UL
+#define TRACE_HEADER_SIZE 48
+#define TRACE_ENTRY_SIZE 32
+
+// Trace entry thread pointer values that are not threads
+#define TRACE_CONTEXT_ISR 0xFFFFFFFFUL
+#define TRACE_CONTEXT_INITIALIZE 0xF0F0F0F0UL
+
+// Event ids, see tx_trace.h
+#define TX_TRACE_THREAD_RESUME 1
+#define TX_TRACE_THREAD_SUSPEND 2
+#define TX_TRACE_ISR_ENTER 3
+#define TX_TRACE_ISR_EXIT 4
+#define TX_TRACE_TIME_SLICE 5
+#define TX_TRACE_RUNNING 6
+#define TX_TRACE_EVENT_FLAGS_GET 32
+#define TX_TRACE_EVENT_FLAGS_SET 36
+
+#define MAX_REGISTRY_ENTRIES 64
+#define OBJECT_NAME_MAX 64
+
+typedef struct {
+    uint32_t object;
+    uint8_t type;
+    char name[OBJECT_NAME_MAX];
+} REGISTRY_ENTRY;
+
+static uint8_t *trace;
+static uint32_t trace_size;
+static REGISTRY_ENTRY registry[MAX_REGISTRY_ENTRIES];
+static size_t registry_count;
+
+static uint32_t read_u32(uint32_t offset) {
+    return (uint32_t)trace[offset] | (uint32_t)trace[offset + 1] << 8 | (uint32_t)trace[offset + 2] << 16 | (uint32_t)trace[offset + 3] << 24;
+}
+
+static uint16_t read_u16(uint32_t offset) {
+    return (uint16_t)(trace[offset] | trace[offset + 1] << 8);
+}
+
+static int hex_value(char c) {
+    if (c >= '0' && c <= '9') { return c - '0'; }
+    if (c >= 'a' && c <= 'f') { return c - 'a' + 10; }
+    if (c >= 'A' && c <= 'F') { return c - 'A' + 10; }
+    return -1;
+}
+
+/// <summary>
+/// Rebuild the trace buffer from the RT_TRACE lines in the debug log
+/// </summary>
+static bool load_trace(FILE *log) {
+    char line[1024];
+    uint32_t bytes_loaded = 0;
+
+    while (fgets(line, sizeof(line), log)) {
+        char *record = strstr(line, "RT_TRACE ");
+        unsigned total, offset;
+        int hex_start = 0;
+
+        if (record == NULL || sscanf(record, "RT_TRACE %u %u %n", &total, &offset, &hex_start) != 2 || hex_start == 0) {
+            continue;
+        }
+
+        if (trace == NULL) {
+            trace_size = total;
+            trace = calloc(1, trace_size);
+            if (trace == NULL) { return false; }
+        }
+
+        for (char *hex = record + hex_start; hex_value(hex[0]) >= 0 && hex_value(hex[1]) >= 0 && offset < trace_size; hex += 2) {
+            trace[offset++] = (uint8_t)(hex_value(hex[0]) << 4 | hex_value(hex[1]));
+            bytes_loaded++;
+        }
+    }
+
+    if (trace == NULL || bytes_loaded < trace_size) {
+        fprintf(stderr, "Incomplete trace: %u of %u bytes\n", bytes_loaded, trace_size);
+    }
+
+    return trace != NULL && trace_size >= TRACE_HEADER_SIZE && read_u32(0) == TX_TRACE_VALID;
+}
+
+static const char *object_name(uint32_t object) {
+    static char unknown[16];
+
+    for (size_t i = 0; i < registry_count; i++) {
+        if (registry[i].object == object) {
+            return registry[i].name;
+        }
+    }
+    snprintf(unknown, sizeof(unknown), "0x%08x", object);
+    return unknown;
+}
+
+static const char *context_name(uint32_t thread_pointer) {
+    switch (thread_pointer) {
+    case 0:
+        return "idle";
+    case TRACE_CONTEXT_ISR:
+        return "ISR";
+    case TRACE_CONTEXT_INITIALIZE:
+        return "initialize";
+    default:
+        return object_name(thread_pointer);
+    }
+}
+
+static void load_registry(uint32_t base, uint32_t registry_start, uint32_t registry_end, uint16_t name_size) {
+    uint32_t entry_size = 16 + name_size;
+
+    for (uint32_t offset = registry_start - base; offset + entry_size <= registry_end - base && registry_count < MAX_REGISTRY_ENTRIES; offset += entry_size) {
+        // tx_trace_object_entry_available is zero once the entry is in use
+        if (trace[offset] != 0) { continue; }
+
+        REGISTRY_ENTRY *entry = &registry[registry_count++];
+        entry->type = trace[offset + 1];
+        entry->object = read_u32(offset + 4);
+        snprintf(entry->name, sizeof(entry->name), "%.*s", name_size < OBJECT_NAME_MAX ? name_size : OBJECT_NAME_MAX - 1, (const char *)&trace[offset + 16]);
+    }
+}
+
+static void print_entry(uint32_t offset, uint32_t *first_timestamp, double cycles_per_us) {
+    uint32_t thread_pointer = read_u32(offset);
+    uint32_t event_id = read_u32(offset + 8);
+    uint32_t timestamp = read_u32(offset + 12);
+    uint32_t info[4] = {read_u32(offset + 16), read_u32(offset + 20), read_u32(offset + 24), read_u32(offset + 28)};
+
+    // Cycle counter wraps, unsigned subtraction keeps the delta correct for traces shorter than one wrap
+    double time_us = (timestamp - *first_timestamp) / cycles_per_us;
+
+    printf("%12.1f  %-22s  ", time_us, context_name(thread_pointer));
+
+    switch (event_id) {
+    case TX_TRACE_THREAD_RESUME:
+        printf("resume        %s\n", object_name(info[0]));
+        break;
+    case TX_TRACE_THREAD_SUSPEND:
+        printf("suspend       %s, next %s\n", object_name(info[0]), info[3] ? object_name(info[3]) : "idle");
+        break;
+    case TX_TRACE_ISR_ENTER:
+        printf("isr enter     %u\n", info[1]);
+        break;
+    case TX_TRACE_ISR_EXIT:
+        printf("isr exit      %u\n", info[1]);
+        break;
+    case TX_TRACE_TIME_SLICE:
+        printf("time slice    next %s\n", object_name(info[0]));
+        break;
+    case TX_TRACE_RUNNING:
+        printf("running\n");
+        break;
+    case TX_TRACE_EVENT_FLAGS_GET:
+        printf("flags get     %s, requested 0x%x, current 0x%x\n", object_name(info[0]), info[1], info[2]);
+        break;
+    case TX_TRACE_EVENT_FLAGS_SET:
+        printf("flags set     %s, flags 0x%x, suspended %u\n", object_name(info[0]), info[1], info[3]);
+        break;
+    default:
+        printf("event %-7u 0x%08x 0x%08x 0x%08x 0x%08x\n", event_id, info[0], info[1], info[2], info[3]);
+        break;
+    }
+}
+
+int main(int argc, char *argv[]) {
+    double cpu_mhz = PERIODIC_TASKS_CPU_MHZ; // the DWT cycle counter clock the real-time app uses
+    const char *log_file = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--mhz") == 0 && i + 1 < argc) {
+            cpu_mhz = atof(argv[++i]);
+        } else {
+            log_file = argv[i];
+        }
+    }
+
+    FILE *log = log_file ? fopen(log_file, "r") : stdin;
+    if (log == NULL || cpu_mhz <= 0) {
+        fprintf(stderr, "usage: tracex_decode [--mhz <core clock MHz>] <debug log file>\n");
+        return 1;
+    }
+
+    if (!load_trace(log)) {
+        fprintf(stderr, "No valid ThreadX trace found\n");
+        return 1;
+    }
+
+    uint32_t base = read_u32(8);
+    uint32_t registry_start = read_u32(12);
+    uint16_t name_size = read_u16(18);
+    uint32_t registry_end = read_u32(20);
+    uint32_t buffer_start = read_u32(24) - base;
+    uint32_t buffer_end = read_u32(28) - base;
+    uint32_t buffer_current = read_u32(32) - base;
+
+    if (buffer_start > buffer_end || buffer_end > trace_size || buffer_current < buffer_start || buffer_current > buffer_end ||
+        registry_start < base || registry_end < registry_start || registry_end - base > trace_size) {
+        fprintf(stderr, "Corrupt trace header\n");
+        return 1;
+    }
+
+    load_registry(base, registry_start, registry_end, name_size);
+
+    printf("%12s  %-22s  %s\n", "time (us)", "context", "event");
+
+    // The oldest entry is at the current pointer when the buffer has wrapped
+    bool first = true;
+    uint32_t first_timestamp = 0;
+    uint32_t offset = buffer_current;
+
+    do {
+        if (offset + TRACE_ENTRY_SIZE > buffer_end) {
+            offset = buffer_start;
+            if (offset == buffer_current) { break; }
+        }
+
+        if (read_u32(offset + 8) != 0) {
+            if (first) {
+                first_timestamp = read_u32(offset + 12);
+                first = false;
+            }
+            print_entry(offset, &first_timestamp, cpu_mhz);
+        }
+
+        offset += TRACE_ENTRY_SIZE;
+    } while (offset != buffer_current);
+
+    free(trace);
+    return 0;
+}
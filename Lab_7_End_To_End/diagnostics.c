@@ -0,0 +1,213 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+#include "diagnostics.h"
+
+#include <applibs/applications.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+static int64_t elapsed_us(const struct timespec *since, const struct timespec *now)
+{
+    return (int64_t)(now->tv_sec - since->tv_sec) * 1000000 + (now->tv_nsec - since->tv_nsec) / 1000;
+}
+
+/// <summary>
+/// snprintf at the end of the buffer
+/// </summary>
+/// <returns>New length, buffer_size once it overflowed</returns>
+static size_t append(char *buffer, size_t buffer_size, size_t length, const char *format, ...)
+{
+    va_list args;
+
+    if (length >= buffer_size)
+    {
+        return buffer_size;
+    }
+
+    va_start(args, format);
+    int written = vsnprintf(buffer + length, buffer_size - length, format, args);
+    va_end(args);
+
+    return written < 0 ? buffer_size : length + (size_t)written;
+}
+
+void diagnostics_rt_stats(DIAGNOSTICS *diagnostics, const INTERCORE_STATS_BLOCK *stats, ssize_t length)
+{
+    if (length < (ssize_t)sizeof(INTERCORE_STATS_BLOCK))
+    {
+        return;
+    }
+
+    diagnostics->rt_stats = *stats;
+    diagnostics->rt_stats.task_count = stats->task_count < IC_RT_STATS_TASKS ? stats->task_count : IC_RT_STATS_TASKS;
+    for (uint32_t i = 0; i < diagnostics->rt_stats.task_count; i++)
+    {
+        diagnostics->rt_stats.tasks[i].name[IC_RT_STATS_NAME_BYTES - 1] = '\0';
+    }
+
+    diagnostics->rt_stats_valid = true;
+    clock_gettime(CLOCK_MONOTONIC, &diagnostics->rt_stats_received);
+}
+
+static size_t append_handlers(char *buffer, size_t buffer_size, size_t length)
+{
+    length = append(buffer, buffer_size, length, "\"handlers\":[");
+
+    for (size_t i = 0; i < handler_profile_count(); i++)
+    {
+        const HANDLER_PROFILE *profile = handler_profile_get(i);
+
+        length = append(buffer, buffer_size, length,
+                        "%s{\"name\":\"%s\",\"count\":%u,\"minUs\":%u,\"avgUs\":%u,\"p99Us\":%u,\"maxUs\":%u,\"lateMeanUs\":%u,"
+                        "\"lateMaxUs\":%u}",
+                        i > 0 ? "," : "", profile->name, profile->count, profile->min_us, handler_profile_mean_us(profile),
+                        handler_profile_percentile_us(profile, 99), profile->max_us, handler_profile_late_mean_us(profile),
+                        profile->late_max_us);
+    }
+
+    return append(buffer, buffer_size, length, "]");
+}
+
+static size_t append_timers(const DIAGNOSTICS *diagnostics, char *buffer, size_t buffer_size, size_t length)
+{
+    const TIMER_WHEEL *wheel = diagnostics->timer_wheel;
+
+    length = append(buffer, buffer_size, length,
+                    "\"timers\":{\"wakeups\":%u,\"idleWakeups\":%u,\"expirations\":%u,\"savedWakeups\":%u,\"jitterMeanUs\":%u,"
+                    "\"jitterMaxUs\":%u,\"timers\":[",
+                    wheel->wakeups, wheel->idle_wakeups, wheel->expirations, timer_wheel_saved_wakeups(wheel), timer_wheel_jitter_mean_us(wheel),
+                    wheel->jitter_max_us);
+
+    for (size_t i = 0; i < wheel->timer_count; i++)
+    {
+        const TIMER_WHEEL_TIMER *timer = wheel->timers[i];
+
+        length = append(buffer, buffer_size, length, "%s{\"name\":\"%s\",\"fired\":%u,\"missed\":%u,\"jitterMaxUs\":%u}", i > 0 ? "," : "",
+                        timer->name, timer->fired, timer->missed, timer->profile.late_max_us);
+    }
+
+    return append(buffer, buffer_size, length, "]}");
+}
+
+static size_t append_intercore(const DIAGNOSTICS *diagnostics, char *buffer, size_t buffer_size, size_t length)
+{
+    const TELEMETRY_CLOCK *clock = diagnostics->clock;
+    uint32_t min_ms = 0, max_ms = 0;
+
+    for (size_t i = 0; i < clock->count; i++)
+    {
+        min_ms = i == 0 || clock->exchanges[i].round_trip_ms < min_ms ? clock->exchanges[i].round_trip_ms : min_ms;
+        max_ms = clock->exchanges[i].round_trip_ms > max_ms ? clock->exchanges[i].round_trip_ms : max_ms;
+    }
+
+    return append(buffer, buffer_size, length, "\"intercore\":{\"exchanges\":%zu,\"rttMinMs\":%u,\"rttMaxMs\":%u,\"requestPending\":%s}",
+                  clock->count, min_ms, max_ms, clock->request_pending ? "true" : "false");
+}
+
+static size_t append_publish(const DIAGNOSTICS *diagnostics, char *buffer, size_t buffer_size, size_t length)
+{
+    const TELEMETRY_HEALTH *health = diagnostics->health;
+
+    length = append(buffer, buffer_size, length,
+                    "\"publish\":{\"queueDepth\":%u,\"queueDepthMax\":%u,\"delivered\":%u,\"timeouts\":%u,\"failed\":%u,\"notSent\":%u,"
+                    "\"latencyP50Ms\":%u,\"latencyP99Ms\":%u,\"latencyMaxMs\":%u,\"histogram\":",
+                    health->queue_depth, health->queue_depth_max, health->outcomes[TELEMETRY_OUTCOME_DELIVERED],
+                    health->outcomes[TELEMETRY_OUTCOME_TIMEOUT], health->outcomes[TELEMETRY_OUTCOME_FAILED],
+                    health->outcomes[TELEMETRY_OUTCOME_NOT_SENT], telemetry_health_percentile_ms(health, 50),
+                    telemetry_health_percentile_ms(health, 99), health->latency_max_ms);
+
+    if (length < buffer_size)
+    {
+        size_t written = telemetry_health_histogram(health, buffer + length, buffer_size - length);
+        length = written > 0 ? length + written : buffer_size;
+    }
+
+    return append(buffer, buffer_size, length, "}");
+}
+
+static size_t append_twin(const DIAGNOSTICS *diagnostics, char *buffer, size_t buffer_size, size_t length)
+{
+    const TWIN_BATCH *batch = diagnostics->twin_batch;
+    const TWIN_CACHE *cache = diagnostics->twin_cache;
+
+    length = append(buffer, buffer_size, length,
+                    "\"twin\":{\"patchesSent\":%u,\"patchesAcked\":%u,\"patchesFailed\":%u,\"propertiesSent\":%u,\"coalesced\":%u,"
+                    "\"bytesSent\":%lu,\"cacheRestored\":%u,\"cacheCurrent\":%u,\"cacheChanged\":%u,\"cacheWrites\":%u,\"debounced\":[",
+                    batch->patches_sent, batch->patches_acked, batch->patches_failed, batch->properties_sent, batch->properties_coalesced,
+                    batch->bytes_sent, cache->loaded, cache->current, cache->changed, cache->writes);
+
+    for (size_t i = 0; i < diagnostics->twin_debounce->count; i++)
+    {
+        const TWIN_DEBOUNCE *item = diagnostics->twin_debounce->items[i];
+
+        length = append(buffer, buffer_size, length, "%s{\"name\":\"%s\",\"applied\":%u,\"superseded\":%u,\"pending\":%s}",
+                        i > 0 ? "," : "", item->binding->propertyName, item->applied, item->superseded, item->pending ? "true" : "false");
+    }
+
+    length = append(buffer, buffer_size, length, "],\"reported\":[");
+
+    for (size_t i = 0; i < diagnostics->twin_report_count; i++)
+    {
+        const TWIN_HYSTERESIS *report = diagnostics->twin_reports[i];
+
+        length = append(buffer, buffer_size, length, "%s{\"name\":\"%s\",\"checks\":%u,\"reports\":%u,\"heldBand\":%u,\"heldInterval\":%u}",
+                        i > 0 ? "," : "", report->binding->propertyName, report->checks, report->reports, report->held_band,
+                        report->held_interval);
+    }
+
+    return append(buffer, buffer_size, length, "]}");
+}
+
+static size_t append_rt_core(const DIAGNOSTICS *diagnostics, char *buffer, size_t buffer_size, size_t length, const struct timespec *now)
+{
+    const INTERCORE_STATS_BLOCK *stats = &diagnostics->rt_stats;
+
+    if (!diagnostics->rt_stats_valid)
+    {
+        return append(buffer, buffer_size, length, "\"rtCore\":null");
+    }
+
+    length = append(buffer, buffer_size, length, "\"rtCore\":{\"ageMs\":%lld,\"uptimeMs\":%u,\"tasks\":[",
+                    (long long)(elapsed_us(&diagnostics->rt_stats_received, now) / 1000), stats->uptime_ms);
+
+    for (uint32_t i = 0; i < stats->task_count; i++)
+    {
+        const INTERCORE_TASK_STATS *task = &stats->tasks[i];
+
+        length = append(buffer, buffer_size, length,
+                        "%s{\"name\":\"%s\",\"releases\":%u,\"overruns\":%u,\"missed\":%u,\"execMaxUs\":%u,\"latenessMaxUs\":%u,"
+                        "\"responseMaxUs\":%u}",
+                        i > 0 ? "," : "", task->name, task->releases, task->deadline_overruns, task->missed_releases, task->exec_us_max,
+                        task->lateness_us_max, task->response_us_max);
+    }
+
+    return append(buffer, buffer_size, length, "]}");
+}
+
+size_t diagnostics_snapshot(const DIAGNOSTICS *diagnostics, char *buffer, size_t buffer_size)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    size_t length = append(buffer, buffer_size, 0,
+                           "{\"uptimeS\":%lld,\"memory\":{\"totalKB\":%u,\"userKB\":%u,\"peakUserKB\":%u},", (long long)now.tv_sec,
+                           Applications_GetTotalMemoryUsageInKB(), Applications_GetUserModeMemoryUsageInKB(),
+                           Applications_GetPeakUserModeMemoryUsageInKB());
+
+    length = append_handlers(buffer, buffer_size, length);
+    length = append(buffer, buffer_size, length, ",");
+    length = append_timers(diagnostics, buffer, buffer_size, length);
+    length = append(buffer, buffer_size, length, ",");
+    length = append_intercore(diagnostics, buffer, buffer_size, length);
+    length = append(buffer, buffer_size, length, ",");
+    length = append_publish(diagnostics, buffer, buffer_size, length);
+    length = append(buffer, buffer_size, length, ",");
+    length = append_twin(diagnostics, buffer, buffer_size, length);
+    length = append(buffer, buffer_size, length, ",");
+    length = append_rt_core(diagnostics, buffer, buffer_size, length, &now);
+    length = append(buffer, buffer_size, length, "}");
+
+    return length < buffer_size ? length : 0;
+}
@@ -0,0 +1,56 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+#pragma once
+
+#include "handler_profile.h"
+#include "telemetry_clock.h"
+#include "telemetry_health.h"
+#include "timer_wheel.h"
+#include "twin_batch.h"
+#include "twin_cache.h"
+#include "twin_debounce.h"
+#include "twin_hysteresis.h"
+
+#include "../IntercoreContract/intercore_contract.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <time.h>
+
+// Largest GetDiagnostics response, room for every counter at its maximum with the handlers the app profiles
+#define DIAGNOSTICS_JSON_BYTES 8192
+
+/// <summary>
+/// Everything the GetDiagnostics direct method reports, the app owns the sources and the diagnostics only read them.
+/// The event loop handlers are the ones listed with the handler profiler.
+/// </summary>
+typedef struct
+{
+    const TELEMETRY_CLOCK *clock;
+    const TELEMETRY_HEALTH *health;
+    const TIMER_WHEEL *timer_wheel;
+    const TWIN_BATCH *twin_batch;
+    const TWIN_CACHE *twin_cache;
+    const TWIN_DEBOUNCE_SET *twin_debounce;
+    TWIN_HYSTERESIS **twin_reports;
+    size_t twin_report_count;
+    // Last IC_RT_STATS reply from the real-time core
+    bool rt_stats_valid;
+    struct timespec rt_stats_received;
+    INTERCORE_STATS_BLOCK rt_stats;
+} DIAGNOSTICS;
+
+/// <summary>
+/// Keep an IC_RT_STATS reply for the next snapshot
+/// </summary>
+void diagnostics_rt_stats(DIAGNOSTICS *diagnostics, const INTERCORE_STATS_BLOCK *stats, ssize_t length);
+
+/// <summary>
+/// Serialize a snapshot as one JSON document
+/// {"uptimeS":n,"memory":{..},"handlers":[..],"timers":{..},"intercore":{..},"publish":{..},"twin":{..},"rtCore":{..}}
+/// </summary>
+/// <returns>Length written, zero if the buffer is too small</returns>
+size_t diagnostics_snapshot(const DIAGNOSTICS *diagnostics, char *buffer, size_t buffer_size);
@@ -0,0 +1,287 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+#include "handler_profile.h"
+
+#include "dx_utilities.h"
+
+#include <stdio.h>
+#include <string.h>
+
+typedef void (*TWIN_HANDLER)(DX_DEVICE_TWIN_BINDING *deviceTwinBinding);
+typedef DX_DIRECT_METHOD_RESPONSE_CODE (*METHOD_HANDLER)(JSON_Value *json, DX_DIRECT_METHOD_BINDING *directMethodBinding,
+                                                         char **responseMsg);
+
+typedef struct
+{
+    DX_DEVICE_TWIN_BINDING *binding;
+    TWIN_HANDLER handler;
+    HANDLER_PROFILE profile;
+} TWIN_HOOK;
+
+typedef struct
+{
+    DX_DIRECT_METHOD_BINDING *binding;
+    METHOD_HANDLER handler;
+    HANDLER_PROFILE profile;
+} METHOD_HOOK;
+
+static struct
+{
+    HANDLER_PROFILE *profiles[HANDLER_PROFILE_MAX];
+    size_t count;
+    TWIN_HOOK twins[HANDLER_PROFILE_HOOKS];
+    size_t twin_count;
+    METHOD_HOOK methods[HANDLER_PROFILE_HOOKS];
+    size_t method_count;
+} profiler;
+
+/// <summary>
+/// Exact below 4 us, then four buckets per power of two
+/// </summary>
+static unsigned bucket_of(uint32_t us)
+{
+    if (us < 4)
+    {
+        return us;
+    }
+
+    unsigned msb = 31u - (unsigned)__builtin_clz(us);
+    unsigned bucket = 4 * (msb - 1) + ((us >> (msb - 2)) & 3);
+
+    return bucket < HANDLER_PROFILE_BUCKETS ? bucket : HANDLER_PROFILE_BUCKETS - 1;
+}
+
+static uint32_t bucket_upper_us(unsigned bucket)
+{
+    if (bucket < 4)
+    {
+        return bucket;
+    }
+
+    unsigned msb = bucket / 4 + 1;
+    return ((4u + bucket % 4) << (msb - 2)) + (1u << (msb - 2)) - 1;
+}
+
+void handler_profile_begin(HANDLER_PROFILE *profile)
+{
+    clock_gettime(CLOCK_MONOTONIC, &profile->started);
+}
+
+void handler_profile_end(HANDLER_PROFILE *profile)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    uint32_t us = (uint32_t)((int64_t)(now.tv_sec - profile->started.tv_sec) * 1000000 + (now.tv_nsec - profile->started.tv_nsec) / 1000);
+
+    profile->min_us = profile->count == 0 || us < profile->min_us ? us : profile->min_us;
+    profile->max_us = us > profile->max_us ? us : profile->max_us;
+    profile->count++;
+    profile->total_us += us;
+    profile->histogram[bucket_of(us)]++;
+}
+
+void handler_profile_late(HANDLER_PROFILE *profile, uint32_t late_us)
+{
+    profile->late_count++;
+    profile->late_total_us += late_us;
+    profile->late_max_us = late_us > profile->late_max_us ? late_us : profile->late_max_us;
+}
+
+uint32_t handler_profile_mean_us(const HANDLER_PROFILE *profile)
+{
+    return profile->count > 0 ? (uint32_t)(profile->total_us / profile->count) : 0;
+}
+
+uint32_t handler_profile_late_mean_us(const HANDLER_PROFILE *profile)
+{
+    return profile->late_count > 0 ? (uint32_t)(profile->late_total_us / profile->late_count) : 0;
+}
+
+uint32_t handler_profile_percentile_us(const HANDLER_PROFILE *profile, unsigned percentile)
+{
+    uint64_t seen = 0;
+
+    for (unsigned i = 0; i < HANDLER_PROFILE_BUCKETS && profile->count > 0; i++)
+    {
+        seen += profile->histogram[i];
+        if (seen * 100 >= (uint64_t)profile->count * percentile)
+        {
+            // the bucket bound can overshoot, the real maximum cannot
+            uint32_t upper = bucket_upper_us(i);
+            return upper < profile->max_us ? upper : profile->max_us;
+        }
+    }
+
+    return 0;
+}
+
+void handler_profile_add(HANDLER_PROFILE *profile)
+{
+    if (profiler.count == HANDLER_PROFILE_MAX)
+    {
+        dx_Log_Debug("Handler profile %s not listed, raise HANDLER_PROFILE_MAX\n", profile->name);
+        return;
+    }
+
+    profiler.profiles[profiler.count++] = profile;
+}
+
+static void twin_handler(DX_DEVICE_TWIN_BINDING *deviceTwinBinding)
+{
+    for (size_t i = 0; i < profiler.twin_count; i++)
+    {
+        TWIN_HOOK *hook = &profiler.twins[i];
+
+        if (hook->binding == deviceTwinBinding)
+        {
+            handler_profile_begin(&hook->profile);
+            hook->handler(deviceTwinBinding);
+            handler_profile_end(&hook->profile);
+            return;
+        }
+    }
+}
+
+static DX_DIRECT_METHOD_RESPONSE_CODE method_handler(JSON_Value *json, DX_DIRECT_METHOD_BINDING *directMethodBinding, char **responseMsg)
+{
+    for (size_t i = 0; i < profiler.method_count; i++)
+    {
+        METHOD_HOOK *hook = &profiler.methods[i];
+
+        if (hook->binding == directMethodBinding)
+        {
+            handler_profile_begin(&hook->profile);
+            DX_DIRECT_METHOD_RESPONSE_CODE result = hook->handler(json, directMethodBinding, responseMsg);
+            handler_profile_end(&hook->profile);
+            return result;
+        }
+    }
+
+    return DX_METHOD_NOT_FOUND;
+}
+
+void handler_profile_twins(DX_DEVICE_TWIN_BINDING *bindings[], size_t binding_count)
+{
+    for (size_t i = 0; i < binding_count; i++)
+    {
+        if (bindings[i]->handler == NULL || bindings[i]->handler == twin_handler)
+        {
+            continue;
+        }
+
+        if (profiler.twin_count == HANDLER_PROFILE_HOOKS)
+        {
+            dx_Log_Debug("Device twin %s not profiled, raise HANDLER_PROFILE_HOOKS\n", bindings[i]->propertyName);
+            continue;
+        }
+
+        TWIN_HOOK *hook = &profiler.twins[profiler.twin_count++];
+        hook->binding = bindings[i];
+        hook->handler = bindings[i]->handler;
+        hook->profile.name = bindings[i]->propertyName;
+        bindings[i]->handler = twin_handler;
+        handler_profile_add(&hook->profile);
+    }
+}
+
+void handler_profile_methods(DX_DIRECT_METHOD_BINDING *bindings[], size_t binding_count)
+{
+    for (size_t i = 0; i < binding_count; i++)
+    {
+        if (bindings[i]->handler == NULL || bindings[i]->handler == method_handler)
+        {
+            continue;
+        }
+
+        if (profiler.method_count == HANDLER_PROFILE_HOOKS)
+        {
+            dx_Log_Debug("Direct method %s not profiled, raise HANDLER_PROFILE_HOOKS\n", bindings[i]->methodName);
+            continue;
+        }
+
+        METHOD_HOOK *hook = &profiler.methods[profiler.method_count++];
+        hook->binding = bindings[i];
+        hook->handler = bindings[i]->handler;
+        hook->profile.name = bindings[i]->methodName;
+        bindings[i]->handler = method_handler;
+        handler_profile_add(&hook->profile);
+    }
+}
+
+size_t handler_profile_count(void)
+{
+    return profiler.count;
+}
+
+const HANDLER_PROFILE *handler_profile_get(size_t index)
+{
+    return index < profiler.count ? profiler.profiles[index] : NULL;
+}
+
+void handler_profile_log(void)
+{
+    dx_Log_Debug("%-32s %8s %8s %8s %8s %8s %8s %8s\n", "Handler (us)", "count", "min", "avg", "p99", "max", "late avg", "late max");
+
+    for (size_t i = 0; i < profiler.count; i++)
+    {
+        const HANDLER_PROFILE *profile = profiler.profiles[i];
+
+        dx_Log_Debug("%-32s %8u %8u %8u %8u %8u %8u %8u\n", profile->name, profile->count, profile->min_us, handler_profile_mean_us(profile),
+                     handler_profile_percentile_us(profile, 99), profile->max_us, handler_profile_late_mean_us(profile),
+                     profile->late_max_us);
+    }
+}
+
+size_t handler_profile_summary(char *buffer, size_t buffer_size)
+{
+    bool listed[HANDLER_PROFILE_MAX] = {false};
+    size_t length = 0;
+    int written = snprintf(buffer, buffer_size, "{\"handlers\":[");
+
+    if (written < 0 || (length = (size_t)written) >= buffer_size)
+    {
+        return 0;
+    }
+
+    for (size_t n = 0; n < HANDLER_PROFILE_TELEMETRY_TOP; n++)
+    {
+        const HANDLER_PROFILE *slowest = NULL;
+        uint32_t slowest_p99 = 0;
+        size_t slowest_index = 0;
+
+        for (size_t i = 0; i < profiler.count; i++)
+        {
+            uint32_t p99 = handler_profile_percentile_us(profiler.profiles[i], 99);
+
+            if (!listed[i] && profiler.profiles[i]->count > 0 && (slowest == NULL || p99 > slowest_p99))
+            {
+                slowest = profiler.profiles[i];
+                slowest_p99 = p99;
+                slowest_index = i;
+            }
+        }
+
+        if (slowest == NULL)
+        {
+            break;
+        }
+
+        listed[slowest_index] = true;
+
+        written = snprintf(buffer + length, buffer_size - length,
+                           "%s{\"name\":\"%s\",\"count\":%u,\"avgUs\":%u,\"p99Us\":%u,\"maxUs\":%u,\"lateMaxUs\":%u}", n > 0 ? "," : "",
+                           slowest->name, slowest->count, handler_profile_mean_us(slowest), slowest_p99, slowest->max_us,
+                           slowest->late_max_us);
+
+        if (written < 0 || (length += (size_t)written) >= buffer_size)
+        {
+            return 0;
+        }
+    }
+
+    written = snprintf(buffer + length, buffer_size - length, "]}");
+
+    return written < 0 || length + (size_t)written >= buffer_size ? 0 : length + (size_t)written;
+}
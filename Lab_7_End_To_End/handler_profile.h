@@ -0,0 +1,86 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+#pragma once
+
+#include "dx_device_twins.h"
+#include "dx_direct_methods.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+// Run time histogram, exact below 4 us then four buckets per power of two (within 25%), the last bucket holds
+// everything from 1.8 s
+#define HANDLER_PROFILE_BUCKETS 80
+// Profiles listed in the dump and the summaries
+#define HANDLER_PROFILE_MAX 32
+// Device twin and direct method bindings whose handlers can be routed through the profiler, of each
+#define HANDLER_PROFILE_HOOKS 16
+// The telemetry summary lists the handlers with the highest p99 run time
+#define HANDLER_PROFILE_TELEMETRY_TOP 5
+#define HANDLER_PROFILE_JSON_BYTES 768
+
+/// <summary>
+/// Run time of an event loop handler since start, and for timers how late it ran against the scheduled expiry
+/// </summary>
+typedef struct
+{
+    const char *name;
+    unsigned count;
+    uint64_t total_us;
+    uint32_t min_us;
+    uint32_t max_us;
+    uint32_t histogram[HANDLER_PROFILE_BUCKETS];
+    unsigned late_count;
+    uint64_t late_total_us;
+    uint32_t late_max_us;
+    struct timespec started;
+} HANDLER_PROFILE;
+
+/// <summary>
+/// Bracket an event loop handler
+/// </summary>
+void handler_profile_begin(HANDLER_PROFILE *profile);
+void handler_profile_end(HANDLER_PROFILE *profile);
+
+/// <summary>
+/// Record how late a timer handler runs, before it is bracketed
+/// </summary>
+void handler_profile_late(HANDLER_PROFILE *profile, uint32_t late_us);
+
+uint32_t handler_profile_mean_us(const HANDLER_PROFILE *profile);
+uint32_t handler_profile_late_mean_us(const HANDLER_PROFILE *profile);
+
+/// <summary>
+/// Upper bound of the run time percentile, from the histogram
+/// </summary>
+uint32_t handler_profile_percentile_us(const HANDLER_PROFILE *profile, unsigned percentile);
+
+/// <summary>
+/// List the profile in the dump and the summaries
+/// </summary>
+void handler_profile_add(HANDLER_PROFILE *profile);
+
+/// <summary>
+/// Route the binding handlers through the profiler, a profile is added for each binding with a handler. Call before the
+/// bindings are subscribed. The handlers take no context, so there is one profiler for the app.
+/// </summary>
+void handler_profile_twins(DX_DEVICE_TWIN_BINDING *bindings[], size_t binding_count);
+void handler_profile_methods(DX_DIRECT_METHOD_BINDING *bindings[], size_t binding_count);
+
+size_t handler_profile_count(void);
+const HANDLER_PROFILE *handler_profile_get(size_t index);
+
+/// <summary>
+/// Log a table of every profile
+/// </summary>
+void handler_profile_log(void);
+
+/// <summary>
+/// Serialize the HANDLER_PROFILE_TELEMETRY_TOP handlers with the highest p99 run time for telemetry,
+/// {"handlers":[{"name":"..","count":n,"avgUs":n,"p99Us":n,"maxUs":n,"lateMaxUs":n},..]}
+/// </summary>
+/// <returns>Length written, zero if the buffer is too small</returns>
+size_t handler_profile_summary(char *buffer, size_t buffer_size);
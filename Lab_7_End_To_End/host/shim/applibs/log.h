@@ -0,0 +1,6 @@
+#pragma once
+
+// Host stand-in for the Azure Sphere applibs logging used by the DevX sources
+#include <stdio.h>
+
+#define Log_Debug(...) printf(__VA_ARGS__)
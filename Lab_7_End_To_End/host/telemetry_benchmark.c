@@ -0,0 +1,261 @@
+/*************************************************************************************************************************************
+ * Telemetry encoding benchmark
+ *
+ * Compares the encoded size and encode time of the JSON and CBOR telemetry formats for a single reading and for
+ * batches of readings. The specialised JSON encoder is checked against, and timed with, a snprintf based reference. When the AzureSphereDevX submodule is present the single reading is also encoded with
+ * dx_jsonSerialize, the encoder the labs used before batching. The gzip rows time encoding plus compression.
+ *
+ *   telemetry_benchmark [iterations]
+ *************************************************************************************************************************************/
+
+#include "telemetry_encode.h"
+#include "telemetry_gzip.h"
+#include "telemetry_stats.h"
+
+#ifdef HAVE_DX_JSON_SERIALIZER
+#include "dx_json_serializer.h"
+#endif
+
+#include <math.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MESSAGE_BYTES TELEMETRY_JSON_MAX_BYTES(TELEMETRY_BATCH_MAX_SAMPLES)
+
+typedef size_t (*ENCODER)(const TELEMETRY_PAYLOAD *payload, uint8_t *buffer, size_t buffer_size);
+
+static TELEMETRY_SAMPLE samples[TELEMETRY_BATCH_MAX_SAMPLES];
+static uint8_t buffer[MESSAGE_BYTES];
+
+// Keeps the optimizer from discarding the encode loops
+static volatile size_t sink;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+static size_t encode_json(const TELEMETRY_PAYLOAD *payload, uint8_t *out, size_t out_size)
+{
+    return telemetry_encode_json(payload, (char *)out, out_size);
+}
+
+static TELEMETRY_GZIP_STATE gzip_state;
+static uint8_t plain[MESSAGE_BYTES];
+
+static size_t encode_json_gzip(const TELEMETRY_PAYLOAD *payload, uint8_t *out, size_t out_size)
+{
+    size_t length = encode_json(payload, plain, sizeof(plain));
+    return length ? telemetry_gzip(&gzip_state, plain, length, out, out_size) : 0;
+}
+
+static size_t encode_cbor_gzip(const TELEMETRY_PAYLOAD *payload, uint8_t *out, size_t out_size)
+{
+    size_t length = telemetry_encode_cbor(payload, plain, sizeof(plain));
+    return length ? telemetry_gzip(&gzip_state, plain, length, out, out_size) : 0;
+}
+
+static bool printf_append(char *out, size_t out_size, size_t *offset, const char *format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    int written = vsnprintf(out + *offset, out_size - *offset, format, args);
+    va_end(args);
+
+    if (written < 0 || (size_t)written >= out_size - *offset)
+    {
+        return false;
+    }
+
+    *offset += (size_t)written;
+    return true;
+}
+
+static bool printf_field_stats(char *out, size_t out_size, size_t *offset, const char *field, const TELEMETRY_FIELD_STATS *stats)
+{
+    uint32_t mean = stats->mean_x100 < 0 ? 0u - (uint32_t)stats->mean_x100 : (uint32_t)stats->mean_x100;
+
+    return printf_append(out, out_size, offset, ",\"%sMean\":%s%u.%02u,\"%sMin\":%d,\"%sMax\":%d,\"%sStdDev\":%u.%02u", field,
+                         stats->mean_x100 < 0 ? "-" : "", mean / 100, mean % 100, field, stats->min, field, stats->max, field,
+                         stats->stddev_x100 / 100, stats->stddev_x100 % 100);
+}
+
+/// <summary>
+/// Reference varargs encoder for the same JSON layout, format strings parsed on every call
+/// </summary>
+static size_t encode_json_printf(const TELEMETRY_PAYLOAD *payload, uint8_t *buffer_out, size_t out_size)
+{
+    char *out = (char *)buffer_out;
+    size_t offset = 0;
+    bool ok = printf_append(out, out_size, &offset,
+                            "{\"msgId\":%d,\"peakUserMemoryKiB\":%d,\"totalMemoryKiB\":%d,\"samplesDropped\":%u,"
+                            "\"samplesSuppressed\":%u,\"backlog\":%u,\"backlogDropped\":%u,\"publishPeriod\":%u,\"publishReason\":\"%.*s\","
+                            "\"samples\":[",
+                            payload->msgId, payload->peakUserMemoryKiB, payload->totalMemoryKiB, payload->samplesDropped,
+                            payload->samplesSuppressed, payload->backlog, payload->backlogDropped, payload->publishPeriod, TELEMETRY_TEXT_MAX,
+                            payload->publishReason);
+
+    for (size_t i = 0; ok && i < payload->count; i++)
+    {
+        const TELEMETRY_SAMPLE *sample = &payload->samples[(payload->head + i) % TELEMETRY_BATCH_MAX_SAMPLES];
+        struct tm utc;
+        char timestamp[24];
+
+        gmtime_r(&sample->timestamp.tv_sec, &utc);
+        strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%S", &utc);
+
+        ok = printf_append(out, out_size, &offset, "%s{\"timestamp\":\"%s.%03ldZ\",\"temperature\":%d,\"pressure\":%d,\"humidity\":%d",
+                           i == 0 ? "" : ",", timestamp, sample->timestamp.tv_nsec / 1000000, sample->temperature, sample->pressure,
+                           sample->humidity);
+
+        if (ok && sample->count > 0)
+        {
+            ok = printf_append(out, out_size, &offset, ",\"count\":%u", sample->count) &&
+                 printf_field_stats(out, out_size, &offset, "temperature", &sample->temperature_stats) &&
+                 printf_field_stats(out, out_size, &offset, "pressure", &sample->pressure_stats) &&
+                 printf_field_stats(out, out_size, &offset, "humidity", &sample->humidity_stats);
+        }
+
+        ok = ok && printf_append(out, out_size, &offset, "}");
+    }
+
+    ok = ok && printf_append(out, out_size, &offset, "]}");
+
+    return ok ? offset : 0;
+}
+
+static void field_stats(const RUNNING_STATS *stats, TELEMETRY_FIELD_STATS *out)
+{
+    *out = (TELEMETRY_FIELD_STATS){.mean_x100 = (int32_t)lround(stats->mean * 100),
+                                   .min = stats->min,
+                                   .max = stats->max,
+                                   .stddev_x100 = (uint32_t)lround(running_stats_stddev(stats) * 100)};
+}
+
+static void run(const char *name, ENCODER encoder, size_t sample_count, unsigned iterations)
+{
+    TELEMETRY_PAYLOAD payload = {
+        .msgId = 1234, .peakUserMemoryKiB = 312, .totalMemoryKiB = 298, .publishPeriod = 5, .publishReason = "normal", .samples = samples, .head = 0,
+        .count = sample_count};
+    size_t length = 0;
+
+    uint64_t start_ns = now_ns();
+    for (unsigned i = 0; i < iterations; i++)
+    {
+        payload.msgId = (int)i;
+        length = encoder(&payload, buffer, sizeof(buffer));
+        sink += length;
+    }
+    uint64_t elapsed_ns = now_ns() - start_ns;
+
+    printf("%-18s %8zu %10zu %12zu %12.0f\n", name, sample_count, length, sample_count ? length / sample_count : 0,
+           (double)elapsed_ns / iterations);
+}
+
+#ifdef HAVE_DX_JSON_SERIALIZER
+static void run_dx_json_serialize(unsigned iterations)
+{
+    size_t length = 0;
+
+    uint64_t start_ns = now_ns();
+    for (unsigned i = 0; i < iterations; i++)
+    {
+        // clang-format off
+        // The single reading message published before batching
+        dx_jsonSerialize((char *)buffer, sizeof(buffer), 6,
+            DX_JSON_INT, "msgId", (int)i,
+            DX_JSON_INT, "temperature", samples[0].temperature,
+            DX_JSON_INT, "pressure", samples[0].pressure,
+            DX_JSON_INT, "humidity", samples[0].humidity,
+            DX_JSON_INT, "peakUserMemoryKiB", 312,
+            DX_JSON_INT, "totalMemoryKiB", 298);
+        // clang-format on
+        length = strlen((char *)buffer);
+        sink += length;
+    }
+    uint64_t elapsed_ns = now_ns() - start_ns;
+
+    printf("%-18s %8d %10zu %12zu %12.0f\n", "dx_jsonSerialize", 1, length, length, (double)elapsed_ns / iterations);
+}
+#endif
+
+int main(int argc, char *argv[])
+{
+    unsigned iterations = argc > 1 ? (unsigned)strtoul(argv[1], NULL, 10) : 100000;
+    const size_t batch_sizes[] = {1, 12, TELEMETRY_BATCH_MAX_SAMPLES};
+
+    if (iterations == 0)
+    {
+        fprintf(stderr, "usage: telemetry_benchmark [iterations]\n");
+        return 1;
+    }
+
+    // Five second windows of one second readings with the spread of the simulated HVAC sensor
+    for (size_t i = 0; i < TELEMETRY_BATCH_MAX_SAMPLES; i++)
+    {
+        TELEMETRY_WINDOW window = {0};
+
+        samples[i].timestamp.tv_sec = 1633046400 + (time_t)(i * 5);
+        samples[i].timestamp.tv_nsec = (long)(i * 37 % 1000) * 1000000;
+
+        for (size_t reading = 0; reading < 5; reading++)
+        {
+            telemetry_window_add(&window, &samples[i].timestamp, 18 + (int)((i + reading) % 12), 950 + (int)((i * 7 + reading * 3) % 100),
+                                 40 + (int)((i * 3 + reading) % 30));
+        }
+        samples[i].temperature = running_stats_mean(&window.temperature);
+        samples[i].pressure = running_stats_mean(&window.pressure);
+        samples[i].humidity = running_stats_mean(&window.humidity);
+        samples[i].count = window.temperature.count;
+        field_stats(&window.temperature, &samples[i].temperature_stats);
+        field_stats(&window.pressure, &samples[i].pressure_stats);
+        field_stats(&window.humidity, &samples[i].humidity_stats);
+    }
+
+    // Extreme statistics, and a backfilled sample without statistics, for the check only
+    TELEMETRY_SAMPLE typical[3];
+    memcpy(typical, samples, sizeof(typical));
+    samples[1].temperature_stats = (TELEMETRY_FIELD_STATS){.mean_x100 = INT32_MIN, .min = INT32_MIN, .max = INT32_MAX, .stddev_x100 = UINT32_MAX};
+    samples[1].pressure_stats.mean_x100 = -5;
+    samples[2].count = 0;
+
+    // The specialised encoder must match the reference byte for byte
+    for (size_t count = 0; count <= TELEMETRY_BATCH_MAX_SAMPLES; count++)
+    {
+        TELEMETRY_PAYLOAD payload = {.msgId = -1, .peakUserMemoryKiB = INT32_MAX, .totalMemoryKiB = INT32_MIN, .samplesDropped = UINT32_MAX,
+                                     .samplesSuppressed = 3,
+                                     .backlog = 4096, .backlogDropped = 17, .publishPeriod = UINT32_MAX, .publishReason = "reason longer than the limit",
+                                     .samples = samples, .count = count};
+        static uint8_t reference[MESSAGE_BYTES];
+        size_t length = encode_json(&payload, buffer, sizeof(buffer));
+
+        if (length == 0 || length != encode_json_printf(&payload, reference, sizeof(reference)) || memcmp(buffer, reference, length) != 0)
+        {
+            fprintf(stderr, "JSON encoders differ for %zu samples\n", count);
+            return 1;
+        }
+    }
+
+    memcpy(samples, typical, sizeof(typical));
+
+    printf("%-18s %8s %10s %12s %12s\n", "encoder", "samples", "bytes", "bytes/sample", "ns/encode");
+
+#ifdef HAVE_DX_JSON_SERIALIZER
+    run_dx_json_serialize(iterations);
+#endif
+
+    for (size_t i = 0; i < sizeof(batch_sizes) / sizeof(batch_sizes[0]); i++)
+    {
+        run("json printf", encode_json_printf, batch_sizes[i], iterations);
+        run("json", encode_json, batch_sizes[i], iterations);
+        run("cbor", telemetry_encode_cbor, batch_sizes[i], iterations);
+        run("json+gzip", encode_json_gzip, batch_sizes[i], iterations / 10 + 1);
+        run("cbor+gzip", encode_cbor_gzip, batch_sizes[i], iterations / 10 + 1);
+    }
+
+    return 0;
+}
@@ -3,52 +3,166 @@
 
 #include "hvac_status.h"
 
+#include "app_exit_codes.h"
+#include "dx_terminate.h"
+
+#ifdef NETWORK_CONNECTED_LED_PWM
+#include <applibs/pwm.h>
+#include <errno.h>
+#include <string.h>
+#endif
+
+typedef enum
+{
+    LED_CONNECTING,
+    LED_CONNECTED,
+    LED_DISCONNECTED
+} LED_PATTERN_ID;
+
 /// <summary>
-/// Handler to turn off LEDs
+/// A blink, on then off, repeated. Once a pattern with a repeat count has run it is followed by the pattern for the
+/// connection state.
 /// </summary>
-/// <param name="eventLoopTimer"></param>
-void azure_status_led_off_handler(EventLoopTimer *eventLoopTimer)
+typedef struct
 {
-    if (ConsumeEventLoopTimerEvent(eventLoopTimer) != 0)
+    uint32_t on_ms;
+    uint32_t off_ms;
+    unsigned repeat; // zero for until the connection state changes
+} LED_PATTERN;
+
+static const LED_PATTERN led_patterns[] = {
+    [LED_CONNECTING] = {.on_ms = 100, .off_ms = 100, .repeat = 25},
+    [LED_CONNECTED] = {.on_ms = 1300, .off_ms = 100},
+    [LED_DISCONNECTED] = {.on_ms = 700, .off_ms = 700},
+};
+
+static struct
+{
+    const LED_PATTERN *pattern; // NULL until the first timer event
+    unsigned cycles;            // of the pattern completed
+    bool on;
+#ifdef NETWORK_CONNECTED_LED_PWM
+    int pwm_fd;
+#endif
+} led;
+
+static const LED_PATTERN *next_pattern(void)
+{
+    if (led.pattern == NULL)
     {
-        dx_terminate(DX_ExitCode_ConsumeEventLoopTimeEvent);
-        return;
+        return &led_patterns[LED_CONNECTING];
+    }
+
+    if (led.pattern->repeat > 0 && led.cycles < led.pattern->repeat)
+    {
+        return led.pattern;
+    }
+
+    return &led_patterns[azure_connected ? LED_CONNECTED : LED_DISCONNECTED];
+}
+
+static void select_pattern(void)
+{
+    const LED_PATTERN *pattern = next_pattern();
+
+    if (pattern != led.pattern)
+    {
+        led.pattern = pattern;
+        led.cycles = 0;
+    }
+}
+
+#ifdef NETWORK_CONNECTED_LED_PWM
+
+static void apply_pattern(void)
+{
+    // The LED is active low, it is lit for the duty cycle
+    PwmState state = {.period_nsec = (led.pattern->on_ms + led.pattern->off_ms) * 1000000,
+                      .dutyCycle_nsec = led.pattern->on_ms * 1000000,
+                      .polarity = PWM_Polarity_Inversed,
+                      .enabled = true};
+
+    if (PWM_Apply(led.pwm_fd, NETWORK_CONNECTED_LED_PWM_CHANNEL, &state) == -1)
+    {
+        dx_Log_Debug("ERROR: PWM_Apply: %s\n", strerror(errno));
     }
-    dx_gpioOff(&gpio_network_led);
 }
 
 /// <summary>
-/// Flash LEDs timer handler
+/// Status LED timer handler, runs at startup and when a pattern with a repeat count has run
 /// </summary>
-void azure_status_led_on_handler(EventLoopTimer *eventLoopTimer)
+void azure_status_led_handler(TIMER_WHEEL_TIMER *timer)
 {
-    static int init_sequence = 25;
-
-    if (ConsumeEventLoopTimerEvent(eventLoopTimer) != 0)
+    if (led.pattern == NULL && (led.pwm_fd = PWM_Open(NETWORK_CONNECTED_LED_PWM_CONTROLLER)) == -1)
     {
-        dx_terminate(DX_ExitCode_ConsumeEventLoopTimeEvent);
+        dx_Log_Debug("ERROR: PWM_Open: %s\n", strerror(errno));
+        dx_terminate(APP_ExitCode_Pwm_Open);
         return;
     }
 
-    if (init_sequence-- > 0)
+    if (led.pattern != NULL)
     {
-        dx_gpioOn(&gpio_network_led);
-        // on for 100ms off for 100ms = 200 ms in total
-        dx_timerOneShotSet(&tmr_azure_status_led_on, &(struct timespec){0, 200 * ONE_MS});
-        dx_timerOneShotSet(&tmr_azure_status_led_off, &(struct timespec){0, 100 * ONE_MS});
+        led.cycles = led.pattern->repeat;
     }
-    else if (azure_connected)
+
+    select_pattern();
+    apply_pattern();
+
+    if (led.pattern->repeat > 0)
     {
-        dx_gpioOn(&gpio_network_led);
-        // on for 1300ms off for 100ms = 1400 ms in total
-        dx_timerOneShotSet(&tmr_azure_status_led_on, &(struct timespec){1, 400 * ONE_MS});
-        dx_timerOneShotSet(&tmr_azure_status_led_off, &(struct timespec){1, 300 * ONE_MS});
+        timer_wheel_oneshot(&timer_wheel, timer, led.pattern->repeat * (led.pattern->on_ms + led.pattern->off_ms));
     }
     else
     {
-        dx_gpioOn(&gpio_network_led);
-        // on for 100ms off for 1300ms = 1400 ms in total
-        dx_timerOneShotSet(&tmr_azure_status_led_on, &(struct timespec){1, 400 * ONE_MS});
-        dx_timerOneShotSet(&tmr_azure_status_led_off, &(struct timespec){0, 700 * ONE_MS});
+        timer_wheel_cancel(&timer_wheel, timer);
+    }
+}
+
+void azure_status_led_update(void)
+{
+    if (led.pattern == NULL || led.pattern->repeat > 0 || next_pattern() == led.pattern)
+    {
+        return;
+    }
+
+    select_pattern();
+    apply_pattern();
+}
+
+#else
+
+/// <summary>
+/// Status LED timer handler, steps the current pattern. The timer is rearmed for the end of each on and off phase, the
+/// pattern is chosen again at the start of each blink.
+/// </summary>
+void azure_status_led_handler(TIMER_WHEEL_TIMER *timer)
+{
+    if (led.on)
+    {
+        dx_gpioOff(&gpio_network_led);
+        led.on = false;
+        led.cycles++;
+        timer_wheel_oneshot(&timer_wheel, timer, led.pattern->off_ms);
+        return;
+    }
+
+    select_pattern();
+
+    dx_gpioOn(&gpio_network_led);
+    led.on = true;
+    timer_wheel_oneshot(&timer_wheel, timer, led.pattern->on_ms);
+}
+
+void azure_status_led_update(void)
+{
+    if (led.pattern == NULL || led.pattern->repeat > 0 || next_pattern() == led.pattern)
+    {
+        return;
     }
-}
\ No newline at end of file
+
+    // Start a blink of the new pattern now
+    led.on = false;
+    timer_wheel_oneshot(&timer_wheel, &tmr_azure_status_led, 0);
+}
+
+#endif
@@ -5,10 +5,24 @@
 
 #include "dx_azure_iot.h"
 #include "dx_gpio.h"
-#include "dx_timer.h"
 #include "dx_utilities.h"
+#include "timer_wheel.h"
+
+#include "hw/azure_sphere_learning_path.h" // Hardware definition
+
+// Where the hardware definition maps the network LED to a PWM channel the blink runs in hardware, the status LED timer
+// then only runs when the pattern changes. The controller must be listed in the Pwm capability of the app manifest,
+// and the LED is not opened as a GPIO.
+#if defined(NETWORK_CONNECTED_LED_PWM_CONTROLLER) && defined(NETWORK_CONNECTED_LED_PWM_CHANNEL)
+#define NETWORK_CONNECTED_LED_PWM
+#endif
 
 extern DX_GPIO_BINDING gpio_network_led;
-extern DX_TIMER_BINDING tmr_azure_status_led_off;
-extern DX_TIMER_BINDING tmr_azure_status_led_on;
+extern TIMER_WHEEL timer_wheel;
+extern TIMER_WHEEL_TIMER tmr_azure_status_led;
 extern bool azure_connected;
+
+/// <summary>
+/// Show a change of connection state straight away rather than at the end of the current blink
+/// </summary>
+void azure_status_led_update(void);
@@ -42,86 +42,150 @@
  **********************************************************************************************************/
 
 /// <summary>
-/// Determine if telemetry value changed. If so, update it's device twin
+/// Determine if telemetry value moved past its hysteresis band and its minimum report interval has passed. If so,
+/// queue it for the next device twin patch
 /// </summary>
-/// <param name="new_value"></param>
-/// <param name="previous_value"></param>
-/// <param name="device_twin"></param>
-static void device_twin_update(int *latest_value, int *previous_value, DX_DEVICE_TWIN_BINDING *device_twin)
+/// <param name="latest_value"></param>
+/// <param name="hysteresis"></param>
+static void device_twin_update(int *latest_value, TWIN_HYSTERESIS *hysteresis)
 {
-    if (*latest_value != *previous_value)
+    if (twin_hysteresis_check(hysteresis, *latest_value))
     {
-        *previous_value = *latest_value;
-        dx_deviceTwinReportValue(device_twin, latest_value);
+        twin_batch_add(&twin_batch, hysteresis->binding, latest_value);
+        twin_cache_set(&twin_cache, hysteresis->binding, latest_value);
     }
 }
 
 /// <summary>
-/// Only update device twins if data changed to minimize network and cloud costs
+/// Only update device twins if data changed to minimize network and cloud costs. All the changes, including operating
+/// mode changes queued since the last cycle, are sent as one reported properties patch.
 /// </summary>
 /// <param name="temperature"></param>
 /// <param name="pressure"></param>
-static void update_device_twins(EventLoopTimer *eventLoopTimer)
+static void update_device_twins(TIMER_WHEEL_TIMER *timer)
 {
-    if (ConsumeEventLoopTimerEvent(eventLoopTimer) != 0)
-    {
-        dx_terminate(DX_ExitCode_ConsumeEventLoopTimeEvent);
-        return;
-    }
-
     if (telemetry.valid && azure_connected)
     {
-        device_twin_update(&telemetry.latest.temperature, &telemetry.previous.temperature, &dt_hvac_temperature);
-        device_twin_update(&telemetry.latest.pressure, &telemetry.previous.pressure, &dt_hvac_pressure);
-        device_twin_update(&telemetry.latest.humidity, &telemetry.previous.humidity, &dt_hvac_humidity);
+        device_twin_update(&telemetry.latest.temperature, &report_temperature);
+        device_twin_update(&telemetry.latest.pressure, &report_pressure);
+        device_twin_update(&telemetry.latest.humidity, &report_humidity);
 
         if (telemetry.latest_operating_mode != HVAC_MODE_UNKNOWN && telemetry.latest_operating_mode != telemetry.previous_operating_mode)
         {
             telemetry.previous_operating_mode = telemetry.latest_operating_mode;
             // Update operating mode device twin
-            dx_deviceTwinReportValue(&dt_hvac_operating_mode, hvac_state[telemetry.latest_operating_mode]);
+            twin_batch_add(&twin_batch, &dt_hvac_operating_mode, hvac_state[telemetry.latest_operating_mode]);
         }
+
+        twin_batch_send(&twin_batch);
     }
 }
 
 /// <summary>
-/// Publish HVAC telemetry
+/// Send callback for the telemetry batch, the readings are kept for the next attempt when not connected. Each message
+/// is tracked until IoT Hub confirms it, the outcome and confirmation latency drive the adaptive publish rate.
 /// </summary>
-/// <param name="eventLoopTimer"></param>
-static void publish_telemetry_handler(EventLoopTimer *eventLoopTimer)
+static bool publish_telemetry_batch(const void *message, size_t length, unsigned flags)
 {
-    static int msgId = 0;
+    // Publish telemetry message to IoT Hub/Central
+    return telemetry_publish(&telemetry_health, flags & TELEMETRY_SEND_BACKFILL, message, length, messageProperties,
+                             NELEMS(messageProperties), flags & TELEMETRY_SEND_GZIP ? &gzipContentProperties : &contentProperties);
+}
 
-    if (ConsumeEventLoopTimerEvent(eventLoopTimer) != 0)
+/// <summary>
+/// Change the publish period when publishes fail or slow down, after an anomaly, or to drain the backlog
+/// </summary>
+static void adapt_publish_rate(void)
+{
+    if (telemetry_rate_update(&telemetry_rate, telemetry_store.count))
     {
-        dx_terminate(DX_ExitCode_ConsumeEventLoopTimeEvent);
-        return;
+        // One backfill message per publish while draining, rate limited otherwise
+        telemetry_store.backfill_interval_seconds = telemetry_rate.reason == TELEMETRY_RATE_BACKLOG ? 0 : TELEMETRY_BACKFILL_INTERVAL_SECONDS;
+        timer_wheel_change(&timer_wheel, &tmr_publish_telemetry, (uint32_t)telemetry_rate.period_seconds * 1000);
+        dx_Log_Debug("Telemetry publish period %d seconds, %s\n", telemetry_rate.period_seconds, telemetry_rate_reason(telemetry_rate.reason));
     }
+}
 
-    if (telemetry.valid && azure_connected)
+/// <summary>
+/// Queue the statistics of the readings since the last publish if the mean moved past the deadband or the heartbeat
+/// expired, a batch is published when full or when the oldest sample reaches its maximum age. The timer period then
+/// adapts to the link and the backlog.
+/// </summary>
+/// <param name="timer"></param>
+static void publish_telemetry_handler(TIMER_WHEEL_TIMER *timer)
+{
+    // Any valid readings since the last publish
+    if (telemetry_window.temperature.count > 0)
     {
-        // clang-format off
-        // Serialize telemetry as JSON
-        if (dx_jsonSerialize(msgBuffer, sizeof(msgBuffer), 6,
-            DX_JSON_INT, "msgId", msgId++,
-            DX_JSON_INT, "temperature", telemetry.latest.temperature,
-            DX_JSON_INT, "pressure", telemetry.latest.pressure,
-            DX_JSON_INT, "humidity", telemetry.latest.humidity,
-            DX_JSON_INT, "peakUserMemoryKiB", (int)Applications_GetPeakUserModeMemoryUsageInKB(),
-            DX_JSON_INT, "totalMemoryKiB", (int)Applications_GetTotalMemoryUsageInKB()))
-        // clang-format on
+        if (telemetry_deadband_check(&telemetry_deadband, running_stats_mean(&telemetry_window.temperature),
+                                     running_stats_mean(&telemetry_window.pressure), running_stats_mean(&telemetry_window.humidity)))
         {
-            dx_Log_Debug("%s\n", msgBuffer);
+            telemetry_batch_add(&telemetry_batch, &telemetry_window);
+
+            if (telemetry_deadband.moved)
+            {
+                // Send the change now and publish faster for a while
+                telemetry_rate_anomaly(&telemetry_rate);
+                telemetry_batch_flush(&telemetry_batch);
+            }
 
-            // Publish telemetry message to IoT Hub/Central
-            dx_azurePublish(msgBuffer, strlen(msgBuffer), messageProperties, NELEMS(messageProperties), &contentProperties);
+            dx_Log_Debug("Telemetry deadband: %u%% of readings suppressed\n", telemetry_deadband_suppressed_percent(&telemetry_deadband));
         }
         else
         {
-            dx_Log_Debug("JSON Serialization failed: Buffer too small\n");
-            dx_terminate(APP_ExitCode_Telemetry_Buffer_Too_Small);
+            telemetry_batch_suppress(&telemetry_batch);
         }
+
+        telemetry_window_reset(&telemetry_window);
     }
+
+    telemetry_batch_flush_if_due(&telemetry_batch);
+    adapt_publish_rate();
+}
+
+/// <summary>
+/// Publish the telemetry pipeline health for the last interval and the slowest event loop handlers as separate low rate
+/// messages
+/// </summary>
+/// <param name="timer"></param>
+static void publish_health_handler(TIMER_WHEEL_TIMER *timer)
+{
+    size_t length;
+
+    // Keep counting while offline, the next summary covers the whole outage
+    if (azure_connected && (length = telemetry_health_summary(&telemetry_health, healthBuffer, sizeof(healthBuffer))) > 0)
+    {
+        dx_Log_Debug("%s\n", healthBuffer);
+        // Not tracked, the summary does not count itself
+        dx_azurePublish(healthBuffer, length, healthMessageProperties, NELEMS(healthMessageProperties), &healthContentProperties);
+    }
+
+    if (azure_connected && (length = handler_profile_summary(profileBuffer, sizeof(profileBuffer))) > 0)
+    {
+        dx_azurePublish(profileBuffer, length, profileMessageProperties, NELEMS(profileMessageProperties), &healthContentProperties);
+    }
+
+    handler_profile_log();
+
+    dx_Log_Debug("Timer wheel: %u wakeups for %u expirations, %u saved, jitter mean %u us max %u us\n", timer_wheel.wakeups,
+                 timer_wheel.expirations, timer_wheel_saved_wakeups(&timer_wheel), timer_wheel_jitter_mean_us(&timer_wheel),
+                 timer_wheel.jitter_max_us);
+
+    request_rt_stats();
+}
+
+/// <summary>
+/// The one kernel timer behind the application timers, runs the ones that are due
+/// </summary>
+static void timer_wheel_handler(EventLoopTimer *eventLoopTimer)
+{
+    if (ConsumeEventLoopTimerEvent(eventLoopTimer) != 0)
+    {
+        dx_terminate(DX_ExitCode_ConsumeEventLoopTimeEvent);
+        return;
+    }
+
+    timer_wheel_run(&timer_wheel);
 }
 
 /***********************************************************************************************************
@@ -132,32 +196,47 @@ static void publish_telemetry_handler(EventLoopTimer *eventLoopTimer)
  **********************************************************************************************************/
 
 /// <summary>
-/// read_telemetry_handler callback handler called every 4 seconds
+/// read_telemetry_handler callback handler called every READ_TELEMETRY_SECONDS, or the period set with SetRates
 /// Environment sensors read and HVAC operating mode LED updated
 /// </summary>
-/// <param name="eventLoopTimer"></param>
-static void read_telemetry_handler(EventLoopTimer *eventLoopTimer)
+/// <param name="timer"></param>
+static void read_telemetry_handler(TIMER_WHEEL_TIMER *timer)
 {
-    if (ConsumeEventLoopTimerEvent(eventLoopTimer) != 0)
-    {
-        dx_terminate(DX_ExitCode_ConsumeEventLoopTimeEvent);
-        return;
-    }
     // Set command for real-time core application
     intercore_block.cmd = IC_READ_SENSOR;
+    telemetry_clock_request_sent(&telemetry_clock);
     dx_intercorePublish(&intercore_environment_ctx, &intercore_block, sizeof(intercore_block));
 }
 
+/// <summary>
+/// Ask the real-time core for its periodic task stats, the reply is kept for GetDiagnostics
+/// </summary>
+static void request_rt_stats(void)
+{
+    INTERCORE_BLOCK request = {.cmd = IC_RT_STATS};
+    dx_intercorePublish(&intercore_environment_ctx, &request, sizeof(request));
+}
+
 /// <summary>
 /// Callback handler for Inter-Core Messaging
 /// </summary>
 static void intercore_environment_receive_msg_handler(void *data_block, ssize_t message_length)
 {
     INTERCORE_BLOCK *ic_data = (INTERCORE_BLOCK *)data_block;
+    // Real-time apps built before the timestamps were added send a shorter block
+    bool timestamped = message_length >= (ssize_t)sizeof(INTERCORE_BLOCK);
+    struct timespec acquired;
+
+    handler_profile_begin(&profile_intercore_receive);
 
     switch (ic_data->cmd)
     {
     case IC_READ_SENSOR:
+        if (timestamped)
+        {
+            telemetry_clock_reply(&telemetry_clock, ic_data->reply_ms);
+        }
+
         telemetry.latest.temperature = ic_data->temperature;
         telemetry.latest.pressure = ic_data->pressure;
         telemetry.latest.humidity = ic_data->humidity;
@@ -172,25 +251,181 @@ static void intercore_environment_receive_msg_handler(void *data_block, ssize_t
             IN_RANGE(telemetry.latest.humidity, 0, 100);
         // clang-format on
 
+        if (telemetry.valid)
+        {
+            // Without a timestamp or before the first clock exchange the reading is taken to be fresh
+            if (!timestamped || !telemetry_clock_rt_to_utc(&telemetry_clock, ic_data->timestamp_ms, &acquired))
+            {
+                clock_gettime(CLOCK_REALTIME, &acquired);
+            }
+
+            telemetry_window_add(&telemetry_window, &acquired, telemetry.latest.temperature, telemetry.latest.pressure,
+                                 telemetry.latest.humidity);
+        }
+
         if (telemetry.previous_operating_mode != telemetry.latest_operating_mode)
         {
             telemetry.previous_operating_mode = telemetry.latest_operating_mode;
-            // Update HVAC operating mode device twin
-            dx_deviceTwinReportValue(&dt_hvac_operating_mode, hvac_state[telemetry.latest_operating_mode]);
+            // Update HVAC operating mode device twin with the next patch
+            twin_batch_add(&twin_batch, &dt_hvac_operating_mode, hvac_state[telemetry.latest_operating_mode]);
         }
 
+        break;
+    case IC_TRACE_CHUNK:
+        rt_trace_capture_chunk(&intercore_environment_ctx, (INTERCORE_TRACE_BLOCK *)data_block, message_length);
+        break;
+    case IC_RT_STATS:
+        diagnostics_rt_stats(&diagnostics, (INTERCORE_STATS_BLOCK *)data_block, message_length);
         break;
     default:
         break;
     }
+
+    handler_profile_end(&profile_intercore_receive);
 }
 
 /***********************************************************************************************************
  * REMOTE OPERATIONS: DEVICE TWINS
  *
  * Set target HVAC temperature
+ * Set publish, read and device twin update periods
  **********************************************************************************************************/
 
+/// <summary>
+/// Binding handler for the debounced desired properties, the value is applied once it stops changing
+/// </summary>
+static void dt_debounce_handler(DX_DEVICE_TWIN_BINDING *deviceTwinBinding)
+{
+    twin_debounce_update(&twin_debounce, deviceTwinBinding);
+}
+
+/// <summary>
+/// Quiet period over, apply the latest desired values
+/// </summary>
+static void twin_debounce_handler(EventLoopTimer *eventLoopTimer)
+{
+    if (ConsumeEventLoopTimerEvent(eventLoopTimer) != 0)
+    {
+        dx_terminate(DX_ExitCode_ConsumeEventLoopTimeEvent);
+        return;
+    }
+
+    handler_profile_begin(&profile_twin_debounce);
+    twin_debounce_timer(&twin_debounce);
+    handler_profile_end(&profile_twin_debounce);
+}
+
+static long startup_elapsed_ms(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (long)(now.tv_sec - startup.start.tv_sec) * 1000 + (now.tv_nsec - startup.start.tv_nsec) / 1000000;
+}
+
+/// <summary>
+/// Send the target temperature to the real-time core, the first one sent is logged with the time since startup
+/// </summary>
+static void send_target_temperature(int temperature, const char *source)
+{
+    intercore_block.cmd = IC_TARGET_TEMPERATURE;
+    intercore_block.temperature = temperature;
+    dx_intercorePublish(&intercore_environment_ctx, &intercore_block, sizeof(intercore_block));
+
+    if (!startup.decided)
+    {
+        startup.decided = true;
+        dx_Log_Debug("First control decision %ld ms after startup, target temperature %d from %s\n", startup_elapsed_ms(), temperature,
+                     source);
+    }
+}
+
+/// <summary>
+/// Change a timer period. The publish period is the normal rate of the adaptive publish rate, the fast and maximum
+/// periods scale with it. The read period is also sent to the real-time core sensor task. The period in use is queued as
+/// its Applied reported property.
+/// </summary>
+/// <returns>false if the period is out of range</returns>
+static bool set_rate(RATE_SETTING *setting, int seconds)
+{
+    if (!IN_RANGE(seconds, RATE_MIN_SECONDS, RATE_MAX_SECONDS))
+    {
+        return false;
+    }
+
+    setting->seconds = seconds;
+
+    if (setting == &rate_publish)
+    {
+        int fast_seconds = seconds * TELEMETRY_FAST_PUBLISH_SECONDS / TELEMETRY_PUBLISH_SECONDS;
+        int max_seconds = seconds * TELEMETRY_MAX_PUBLISH_SECONDS / TELEMETRY_PUBLISH_SECONDS;
+
+        telemetry_rate.normal_seconds = seconds;
+        telemetry_rate.fast_seconds = fast_seconds > 0 ? fast_seconds : 1;
+        telemetry_rate.max_seconds = max_seconds;
+        adapt_publish_rate();
+    }
+    else
+    {
+        timer_wheel_change(&timer_wheel, setting->timer, (uint32_t)seconds * 1000);
+    }
+
+    if (setting == &rate_read)
+    {
+        INTERCORE_RATE_BLOCK request = {.cmd = IC_SAMPLE_RATE, .read_period_ms = (uint32_t)seconds * 1000};
+        dx_intercorePublish(&intercore_environment_ctx, &request, sizeof(request));
+    }
+
+    twin_batch_add(&twin_batch, setting->applied, &setting->seconds);
+    dx_Log_Debug("%s set to %d seconds\n", setting->binding->propertyName, seconds);
+
+    return true;
+}
+
+static RATE_SETTING *find_rate_setting(DX_DEVICE_TWIN_BINDING *binding)
+{
+    for (size_t i = 0; i < NELEMS(rate_settings); i++)
+    {
+        if (rate_settings[i]->binding == binding)
+        {
+            return rate_settings[i];
+        }
+    }
+    return NULL;
+}
+
+/// <summary>
+/// Apply the device twin values saved by the previous run, before IoT Hub sends the twin
+/// </summary>
+static void apply_twin_cache(void)
+{
+    TWIN_HYSTERESIS *reports[] = {&report_temperature, &report_pressure, &report_humidity};
+    const int *value;
+
+    if ((value = twin_cache_get(&twin_cache, &dt_hvac_target_temperature)) != NULL && IN_RANGE(*value, 0, 50))
+    {
+        send_target_temperature(*value, "twin cache");
+    }
+
+    for (size_t i = 0; i < NELEMS(rate_settings); i++)
+    {
+        if ((value = twin_cache_get(&twin_cache, rate_settings[i]->binding)) != NULL)
+        {
+            set_rate(rate_settings[i], *value);
+        }
+    }
+
+    // IoT Hub still holds the values reported before the restart, readings that have not moved are not reported again
+    for (size_t i = 0; i < NELEMS(reports); i++)
+    {
+        if ((value = twin_cache_get(&twin_cache, reports[i]->binding)) != NULL)
+        {
+            reports[i]->reported_valid = true;
+            reports[i]->reported = *value;
+        }
+    }
+}
+
 /// <summary>
 /// dt_set_target_temperature_handler callback handler is called when TargetTemperature device twin message received
 /// HVAC operating mode LED updated and IoT Plug and Play device twin acknowledged
@@ -198,13 +433,46 @@ static void intercore_environment_receive_msg_handler(void *data_block, ssize_t
 /// <param name="deviceTwinBinding"></param>
 static void dt_set_target_temperature_handler(DX_DEVICE_TWIN_BINDING *deviceTwinBinding)
 {
+    if (!startup.twin_received)
+    {
+        startup.twin_received = true;
+        dx_Log_Debug("Device twin target temperature %ld ms after startup\n", startup_elapsed_ms());
+    }
+
     if (IN_RANGE(*(int *)deviceTwinBinding->propertyValue, 0, 50))
     {
-        intercore_block.cmd = IC_TARGET_TEMPERATURE;
-        intercore_block.temperature = *(int *)deviceTwinBinding->propertyValue;
-        dx_intercorePublish(&intercore_environment_ctx, &intercore_block, sizeof(intercore_block));
+        // The version applied from the twin cache at startup is not sent again
+        if (!twin_cache_is_current(&twin_cache, deviceTwinBinding))
+        {
+            send_target_temperature(*(int *)deviceTwinBinding->propertyValue, "device twin");
+            twin_cache_set(&twin_cache, deviceTwinBinding, deviceTwinBinding->propertyValue);
+        }
+
+        dx_deviceTwinAckDesiredValue(deviceTwinBinding, deviceTwinBinding->propertyValue, DX_DEVICE_TWIN_RESPONSE_COMPLETED);
+    }
+    else
+    {
+        dx_deviceTwinAckDesiredValue(deviceTwinBinding, deviceTwinBinding->propertyValue, DX_DEVICE_TWIN_RESPONSE_ERROR);
+    }
+}
 
+/// <summary>
+/// dt_set_rate_handler callback handler is called when a PublishPeriodSeconds, ReadPeriodSeconds or
+/// TwinUpdatePeriodSeconds device twin message is received. The period is applied, cached and acknowledged.
+/// </summary>
+/// <param name="deviceTwinBinding"></param>
+static void dt_set_rate_handler(DX_DEVICE_TWIN_BINDING *deviceTwinBinding)
+{
+    RATE_SETTING *setting = find_rate_setting(deviceTwinBinding);
+    int seconds = *(int *)deviceTwinBinding->propertyValue;
+
+    // The version applied from the twin cache at startup is not applied again. A period set since with SetRates stays in
+    // use, but only the desired value is cached and acknowledged.
+    if (setting != NULL && (twin_cache_is_current(&twin_cache, deviceTwinBinding) || set_rate(setting, seconds)))
+    {
+        twin_cache_set(&twin_cache, deviceTwinBinding, deviceTwinBinding->propertyValue);
         dx_deviceTwinAckDesiredValue(deviceTwinBinding, deviceTwinBinding->propertyValue, DX_DEVICE_TWIN_RESPONSE_COMPLETED);
+        twin_batch_send(&twin_batch);
     }
     else
     {
@@ -217,8 +485,74 @@ static void dt_set_target_temperature_handler(DX_DEVICE_TWIN_BINDING *deviceTwin
  *
  * Set HVAC panel message
  * Turn HVAC on and off
+ * Capture the real-time core ThreadX event trace
+ * Return a diagnostics snapshot
+ * Set publish, read and device twin update periods
+ * Run long methods as jobs and return their status
  **********************************************************************************************************/
 
+/// <summary>
+/// Copy a JSON response for DevX, which sends it and frees it
+/// </summary>
+static bool method_response(const char *json, size_t length, char **responseMsg)
+{
+    if ((*responseMsg = malloc(length + 1)) == NULL)
+    {
+        return false;
+    }
+
+    memcpy(*responseMsg, json, length + 1);
+    return true;
+}
+
+/// <summary>
+/// Queue a job for the method and respond with its ID, the job reports its progress as it runs
+/// </summary>
+static DX_DIRECT_METHOD_RESPONSE_CODE start_method_job(DX_DIRECT_METHOD_BINDING *directMethodBinding, METHOD_JOB_STEP step, char **responseMsg)
+{
+    const METHOD_JOB *job = method_jobs_start(&method_jobs, directMethodBinding->methodName, step);
+    int length;
+
+    if (job == NULL)
+    {
+        return DX_METHOD_FAILED;
+    }
+
+    length = snprintf(msgBuffer, sizeof(msgBuffer), "{\"jobId\":%u,\"state\":\"%s\"}", job->id, method_jobs_state(job->state));
+
+    return method_response(msgBuffer, (size_t)length, responseMsg) ? DX_METHOD_SUCCEEDED : DX_METHOD_FAILED;
+}
+
+/// <summary>
+/// Report the state and progress of a job with the next device twin patch, sent straight away when connected
+/// </summary>
+static void report_method_job(const METHOD_JOB *job)
+{
+    int id = (int)job->id;
+    int progress = (int)job->progress;
+
+    twin_batch_add(&twin_batch, &dt_method_job_id, &id);
+    twin_batch_add(&twin_batch, &dt_method_job_state, method_jobs_state(job->state));
+    twin_batch_add(&twin_batch, &dt_method_job_progress, &progress);
+    twin_batch_send(&twin_batch);
+}
+
+/// <summary>
+/// Run the job steps that are due
+/// </summary>
+static void method_jobs_handler(EventLoopTimer *eventLoopTimer)
+{
+    if (ConsumeEventLoopTimerEvent(eventLoopTimer) != 0)
+    {
+        dx_terminate(DX_ExitCode_ConsumeEventLoopTimeEvent);
+        return;
+    }
+
+    handler_profile_begin(&profile_method_jobs);
+    method_jobs_timer(&method_jobs);
+    handler_profile_end(&profile_method_jobs);
+}
+
 // Direct method name = HvacOn
 static DX_DIRECT_METHOD_RESPONSE_CODE gpio_on_handler(JSON_Value *json, DX_DIRECT_METHOD_BINDING *directMethodBinding, char **responseMsg)
 {
@@ -233,6 +567,148 @@ static DX_DIRECT_METHOD_RESPONSE_CODE gpio_off_handler(JSON_Value *json, DX_DIRE
     return DX_METHOD_SUCCEEDED;
 }
 
+/// <summary>
+/// RtTraceCapture job, starts the capture then follows the chunks arriving from the real-time core
+/// </summary>
+static METHOD_JOB_STATE rt_trace_capture_job(METHOD_JOB *job)
+{
+    uint32_t captured, total_size;
+
+    if (job->step_count == 0)
+    {
+        // Trace chunks stream to the debug log, the real-time app must be built with THREADX_EVENT_TRACE=ON
+        if (!rt_trace_capture_start(&intercore_environment_ctx))
+        {
+            snprintf(job->result, sizeof(job->result), "capture already in progress");
+            return METHOD_JOB_FAILED;
+        }
+
+        job->next_step_ms = RT_TRACE_CAPTURE_POLL_MS;
+        return METHOD_JOB_RUNNING;
+    }
+
+    if (rt_trace_capture_status(&captured, &total_size))
+    {
+        if (job->elapsed_ms >= RT_TRACE_CAPTURE_TIMEOUT_MS)
+        {
+            rt_trace_capture_cancel();
+            snprintf(job->result, sizeof(job->result), "real-time core stopped after %u bytes", captured);
+            return METHOD_JOB_FAILED;
+        }
+
+        job->progress = total_size > 0 ? (unsigned)((uint64_t)captured * 100 / total_size) : 0;
+        job->next_step_ms = RT_TRACE_CAPTURE_POLL_MS;
+        return METHOD_JOB_RUNNING;
+    }
+
+    if (total_size == 0)
+    {
+        snprintf(job->result, sizeof(job->result), "trace not enabled in the real-time app");
+        return METHOD_JOB_FAILED;
+    }
+
+    snprintf(job->result, sizeof(job->result), "%u of %u bytes written to the debug log", captured, total_size);
+    return METHOD_JOB_SUCCEEDED;
+}
+
+// Direct method name = RtTraceCapture
+static DX_DIRECT_METHOD_RESPONSE_CODE rt_trace_capture_handler(JSON_Value *json, DX_DIRECT_METHOD_BINDING *directMethodBinding, char **responseMsg)
+{
+    return start_method_job(directMethodBinding, rt_trace_capture_job, responseMsg);
+}
+
+// Direct method name = GetJobStatus, payload {"jobId":n} or none for every job kept
+static DX_DIRECT_METHOD_RESPONSE_CODE get_job_status_handler(JSON_Value *json, DX_DIRECT_METHOD_BINDING *directMethodBinding, char **responseMsg)
+{
+    JSON_Object *request = json_value_get_object(json);
+    char status[METHOD_JOBS_MAX * METHOD_JOB_JSON_BYTES + 3];
+    uint32_t id = 0;
+    size_t length;
+
+    if (request != NULL && json_object_has_value_of_type(request, "jobId", JSONNumber))
+    {
+        double requested = json_object_get_number(request, "jobId");
+        id = requested >= 1 && requested <= UINT32_MAX ? (uint32_t)requested : 0;
+
+        if (id == 0)
+        {
+            return DX_METHOD_FAILED;
+        }
+    }
+
+    if ((length = method_jobs_status(&method_jobs, id, status, sizeof(status))) == 0)
+    {
+        return DX_METHOD_FAILED;
+    }
+
+    return method_response(status, length, responseMsg) ? DX_METHOD_SUCCEEDED : DX_METHOD_FAILED;
+}
+
+// Direct method name = GetDiagnostics
+static DX_DIRECT_METHOD_RESPONSE_CODE get_diagnostics_handler(JSON_Value *json, DX_DIRECT_METHOD_BINDING *directMethodBinding, char **responseMsg)
+{
+    size_t length = diagnostics_snapshot(&diagnostics, diagnosticsBuffer, sizeof(diagnosticsBuffer));
+
+    // The reply arrives after this response, the next call reports it
+    request_rt_stats();
+
+    return length > 0 && method_response(diagnosticsBuffer, length, responseMsg) ? DX_METHOD_SUCCEEDED : DX_METHOD_FAILED;
+}
+
+// Direct method name = SetRates, payload {"publishSeconds":n,"readSeconds":n,"twinSeconds":n}, any subset of the keys
+static DX_DIRECT_METHOD_RESPONSE_CODE set_rates_handler(JSON_Value *json, DX_DIRECT_METHOD_BINDING *directMethodBinding, char **responseMsg)
+{
+    JSON_Object *request = json_value_get_object(json);
+    int seconds[NELEMS(rate_settings)];
+    bool requested[NELEMS(rate_settings)];
+    bool any = false;
+    int length;
+
+    if (request == NULL)
+    {
+        return DX_METHOD_FAILED;
+    }
+
+    // Validate every key before applying any, so a bad request changes nothing
+    for (size_t i = 0; i < NELEMS(rate_settings); i++)
+    {
+        requested[i] = json_object_has_value_of_type(request, rate_settings[i]->key, JSONNumber);
+        double value = requested[i] ? json_object_get_number(request, rate_settings[i]->key) : 0;
+
+        // Checked as a double, a whole number of seconds in range, before it is converted
+        if (requested[i] && (!IN_RANGE(value, RATE_MIN_SECONDS, RATE_MAX_SECONDS) || value != (double)(int)value))
+        {
+            return DX_METHOD_FAILED;
+        }
+
+        seconds[i] = (int)value;
+
+        any = any || requested[i];
+    }
+
+    if (!any)
+    {
+        return DX_METHOD_FAILED;
+    }
+
+    for (size_t i = 0; i < NELEMS(rate_settings); i++)
+    {
+        // Not acknowledged or cached against the desired version, the desired value is applied again at startup
+        if (requested[i])
+        {
+            set_rate(rate_settings[i], seconds[i]);
+        }
+    }
+
+    // The Applied properties show the periods in use
+    twin_batch_send(&twin_batch);
+
+    length = snprintf(msgBuffer, sizeof(msgBuffer), "{\"publishSeconds\":%d,\"readSeconds\":%d,\"twinSeconds\":%d}", rate_publish.seconds,
+                      rate_read.seconds, rate_twin_update.seconds);
+
+    return method_response(msgBuffer, (size_t)length, responseMsg) ? DX_METHOD_SUCCEEDED : DX_METHOD_FAILED;
+}
+
 /***********************************************************************************************************
  * PRODUCTION
  *
@@ -248,26 +724,38 @@ static DX_DIRECT_METHOD_RESPONSE_CODE gpio_off_handler(JSON_Value *json, DX_DIRE
 /// <summary>
 /// Restart the Device
 /// </summary>
-static void hvac_delay_restart_handler(EventLoopTimer *eventLoopTimer)
+static void hvac_delay_restart_handler(TIMER_WHEEL_TIMER *timer)
 {
-    if (ConsumeEventLoopTimerEvent(eventLoopTimer) != 0)
+    PowerManagement_ForceSystemReboot();
+}
+
+/// <summary>
+/// HvacRestart job, saves the readings not yet published then sets the oneshot timer to restart the device.
+/// The delayed restart is to allow for the job status to reach IoT Hub
+/// </summary>
+static METHOD_JOB_STATE hvac_restart_job(METHOD_JOB *job)
+{
+    if (job->step_count == 0)
     {
-        dx_terminate(DX_ExitCode_ConsumeEventLoopTimeEvent);
-        return;
+        // Published when connected, moved to the telemetry store otherwise and backfilled after the restart
+        telemetry_batch_flush(&telemetry_batch);
+        job->progress = 50;
+        return METHOD_JOB_RUNNING;
     }
-    PowerManagement_ForceSystemReboot();
+
+    timer_wheel_oneshot(&timer_wheel, &tmr_hvac_restart_oneshot_timer, 2000);
+    snprintf(job->result, sizeof(job->result), "restarting in 2 seconds");
+    return METHOD_JOB_SUCCEEDED;
 }
 
 /// <summary>
-/// Direct method 'HvacRestart' sets oneshot timer to restart the device.
-/// The delayed restart is to allow for the direct method to return success status to IoT Hub
+/// Direct method 'HvacRestart' queues the restart job and returns its ID.
 /// For an example of a direct method with a JSON payload refer to
 /// https://github.com/Azure-Sphere-DevX/AzureSphereDevX.Examples/wiki/IoT-Hub-Direct-Methods#remote-restarting-the-azure-sphere
 /// </summary>
 static DX_DIRECT_METHOD_RESPONSE_CODE hvac_restart_handler(JSON_Value *json, DX_DIRECT_METHOD_BINDING *directMethodBinding, char **responseMsg)
 {
-    dx_timerOneShotSet(&tmr_hvac_restart_oneshot_timer, &(struct timespec){2, 0});
-    return DX_METHOD_SUCCEEDED;
+    return start_method_job(directMethodBinding, hvac_restart_job, responseMsg);
 }
 
 /************************************************************************************************************
@@ -281,8 +769,16 @@ static DX_DIRECT_METHOD_RESPONSE_CODE hvac_restart_handler(JSON_Value *json, DX_
 static void hvac_startup_report(bool connected)
 {
     snprintf(msgBuffer, sizeof(msgBuffer), "HVAC firmware: %s, DevX version: %s", HVAC_FIRMWARE_VERSION, AZURE_SPHERE_DEVX_VERSION);
-    dx_deviceTwinReportValue(&dt_hvac_sw_version, msgBuffer);                                     // DX_TYPE_STRING
-    dx_deviceTwinReportValue(&dt_hvac_start_utc, dx_getCurrentUtc(msgBuffer, sizeof(msgBuffer))); // DX_TYPE_STRING
+    twin_batch_add(&twin_batch, &dt_hvac_sw_version, msgBuffer);                                     // DX_TYPE_STRING
+    twin_batch_add(&twin_batch, &dt_hvac_start_utc, dx_getCurrentUtc(msgBuffer, sizeof(msgBuffer))); // DX_TYPE_STRING
+
+    // IoT Hub still holds the periods in use before the restart
+    for (size_t i = 0; i < NELEMS(rate_settings); i++)
+    {
+        twin_batch_add(&twin_batch, rate_settings[i]->applied, &rate_settings[i]->seconds);
+    }
+
+    twin_batch_send(&twin_batch);
 
     dx_azureUnregisterConnectionChangedNotification(hvac_startup_report);
 }
@@ -332,14 +828,9 @@ static uint32_t DeferredUpdateCalculate(uint32_t max_deferral_time_in_minutes, S
 /// <summary>
 /// This timer extends the app level lease watchdog
 /// </summary>
-/// <param name="eventLoopTimer"></param>
-static void watchdog_handler(EventLoopTimer *eventLoopTimer)
+/// <param name="timer"></param>
+static void watchdog_handler(TIMER_WHEEL_TIMER *timer)
 {
-    if (ConsumeEventLoopTimerEvent(eventLoopTimer) != 0)
-    {
-        dx_terminate(DX_ExitCode_ConsumeEventLoopTimeEvent);
-        return;
-    }
     timer_settime(watchdogTimer, 0, &watchdogInterval, NULL);
 }
 
@@ -373,12 +864,33 @@ void start_watchdog(void)
  **********************************************************************************************************/
 
 /// <summary>
-/// Update local azure_connected with new connection status
+/// Update local azure_connected with new connection status, and the status LED with it
 /// </summary>
 /// <param name="connected"></param>
 void azure_connection_state(bool connected)
 {
     azure_connected = connected;
+    azure_status_led_update();
+}
+
+/// <summary>
+/// List the event loop handlers with the profiler, the device twin and direct method handlers are routed through it so
+/// it must run before they are subscribed
+/// </summary>
+static void profile_handlers(void)
+{
+    for (size_t i = 0; i < NELEMS(timer_wheel_timers); i++)
+    {
+        handler_profile_add(&timer_wheel_timers[i]->profile);
+    }
+
+    for (size_t i = 0; i < NELEMS(handler_profiles); i++)
+    {
+        handler_profile_add(handler_profiles[i]);
+    }
+
+    handler_profile_twins(device_twin_bindings, NELEMS(device_twin_bindings));
+    handler_profile_methods(direct_method_binding_sets, NELEMS(direct_method_binding_sets));
 }
 
 /// <summary>
@@ -386,12 +898,19 @@ void azure_connection_state(bool connected)
 /// </summary>
 static void InitPeripheralsAndHandlers(void)
 {
+    clock_gettime(CLOCK_MONOTONIC, &startup.start);
     dx_Log_Debug_Init(Log_Debug_Time_buffer, sizeof(Log_Debug_Time_buffer));
+    telemetry_store_open(&telemetry_store);
+    twin_cache_open(&twin_cache);
     dx_azureConnect(&dx_config, NETWORK_INTERFACE, IOT_PLUG_AND_PLAY_MODEL_ID);
     dx_intercoreConnect(&intercore_environment_ctx);
 
     dx_gpioSetOpen(gpio_bindings, NELEMS(gpio_bindings));
     dx_timerSetStart(timer_bindings, NELEMS(timer_bindings));
+    timer_wheel_start(&timer_wheel, timer_wheel_timers, NELEMS(timer_wheel_timers));
+    profile_handlers();
+    // After the timers start, so cached periods can change them
+    apply_twin_cache();
     dx_deviceTwinSubscribe(device_twin_bindings, NELEMS(device_twin_bindings));
     dx_directMethodSubscribe(direct_method_binding_sets, NELEMS(direct_method_binding_sets));
 
@@ -400,9 +919,6 @@ static void InitPeripheralsAndHandlers(void)
 
     dx_deferredUpdateRegistration(DeferredUpdateCalculate, NULL);
 
-    // initialize previous environment sensor variables
-    telemetry.previous.temperature = telemetry.previous.pressure = telemetry.previous.humidity = INT32_MAX;
-
     // Uncomment for production
     // start_watchdog();
 }
@@ -412,6 +928,11 @@ static void InitPeripheralsAndHandlers(void)
 /// </summary>
 static void ClosePeripheralsAndHandlers(void)
 {
+    // Best effort, the batch is queued with the IoT Hub client or moved to the store before it is torn down
+    telemetry_batch_flush(&telemetry_batch);
+    telemetry_store_close(&telemetry_store);
+    twin_cache_close(&twin_cache);
+
     dx_timerSetStop(timer_bindings, NELEMS(timer_bindings));
     dx_deviceTwinUnsubscribe();
     dx_directMethodUnsubscribe();
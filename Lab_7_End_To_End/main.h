@@ -16,13 +16,31 @@
 
 #include "hw/azure_sphere_learning_path.h" // Hardware definition
 #include "app_exit_codes.h"                // application specific exit codes
+#include "diagnostics.h"
+#include "handler_profile.h"
 #include "hvac_status.h"
+#include "method_jobs.h"
+#include "telemetry_batch.h"
+#include "telemetry_clock.h"
+#include "telemetry_deadband.h"
+#include "telemetry_health.h"
+#include "telemetry_publish.h"
+#include "telemetry_rate.h"
+#include "telemetry_stats.h"
+#include "timer_wheel.h"
+#include "twin_batch.h"
+#include "twin_cache.h"
+#include "twin_debounce.h"
+#include "twin_hysteresis.h"
+#include "rt_trace_capture.h"
 
 #include "../IntercoreContract/intercore_contract.h"
 
 #include <applibs/applications.h>
 #include <applibs/log.h>
 #include <applibs/powermanagement.h>
+#include <stdlib.h>
+#include <string.h>
 
 // https://docs.microsoft.com/en-us/azure/iot-pnp/overview-iot-plug-and-play
 #define IOT_PLUG_AND_PLAY_MODEL_ID "dtmi:com:example:azuresphere:labmonitor;2"
@@ -32,22 +50,96 @@
 #define CORE_ENVIRONMENT_COMPONENT_ID "6583cf17-d321-4d72-8283-0b7c5b56442b"
 
 // Forward declarations
+static DX_DIRECT_METHOD_RESPONSE_CODE get_job_status_handler(JSON_Value *json, DX_DIRECT_METHOD_BINDING *directMethodBinding, char **responseMsg);
+static DX_DIRECT_METHOD_RESPONSE_CODE get_diagnostics_handler(JSON_Value *json, DX_DIRECT_METHOD_BINDING *directMethodBinding, char **responseMsg);
 static DX_DIRECT_METHOD_RESPONSE_CODE gpio_off_handler(JSON_Value *json, DX_DIRECT_METHOD_BINDING *directMethodBinding, char **responseMsg);
 static DX_DIRECT_METHOD_RESPONSE_CODE gpio_on_handler(JSON_Value *json, DX_DIRECT_METHOD_BINDING *directMethodBinding, char **responseMsg);
 static DX_DIRECT_METHOD_RESPONSE_CODE hvac_restart_handler(JSON_Value *json, DX_DIRECT_METHOD_BINDING *directMethodBinding, char **responseMsg);
+static DX_DIRECT_METHOD_RESPONSE_CODE rt_trace_capture_handler(JSON_Value *json, DX_DIRECT_METHOD_BINDING *directMethodBinding, char **responseMsg);
+static DX_DIRECT_METHOD_RESPONSE_CODE set_rates_handler(JSON_Value *json, DX_DIRECT_METHOD_BINDING *directMethodBinding, char **responseMsg);
+static void dt_debounce_handler(DX_DEVICE_TWIN_BINDING *deviceTwinBinding);
+static void dt_set_rate_handler(DX_DEVICE_TWIN_BINDING *deviceTwinBinding);
 static void dt_set_target_temperature_handler(DX_DEVICE_TWIN_BINDING *deviceTwinBinding);
-static void hvac_delay_restart_handler(EventLoopTimer *eventLoopTimer);
+static void hvac_delay_restart_handler(TIMER_WHEEL_TIMER *timer);
 static void intercore_environment_receive_msg_handler(void *data_block, ssize_t message_length);
-static void publish_telemetry_handler(EventLoopTimer *eventLoopTimer);
-static void read_telemetry_handler(EventLoopTimer *eventLoopTimer);
-static void update_device_twins(EventLoopTimer *eventLoopTimer);
-void azure_status_led_off_handler(EventLoopTimer *eventLoopTimer);
-void azure_status_led_on_handler(EventLoopTimer *eventLoopTimer);
-static void watchdog_handler(EventLoopTimer *eventLoopTimer);
+static void method_jobs_handler(EventLoopTimer *eventLoopTimer);
+static void report_method_job(const METHOD_JOB *job);
+static bool publish_telemetry_batch(const void *message, size_t length, unsigned flags);
+static void publish_health_handler(TIMER_WHEEL_TIMER *timer);
+static void publish_telemetry_handler(TIMER_WHEEL_TIMER *timer);
+static void read_telemetry_handler(TIMER_WHEEL_TIMER *timer);
+static void request_rt_stats(void);
+static void timer_wheel_handler(EventLoopTimer *eventLoopTimer);
+static void twin_debounce_handler(EventLoopTimer *eventLoopTimer);
+static void update_device_twins(TIMER_WHEEL_TIMER *timer);
+void azure_status_led_handler(TIMER_WHEEL_TIMER *timer);
+static void watchdog_handler(TIMER_WHEEL_TIMER *timer);
 
 // Number of bytes to allocate for the JSON telemetry message for IoT Hub/Central
 #define JSON_MESSAGE_BYTES 256
 static char msgBuffer[JSON_MESSAGE_BYTES] = {0};
+
+// Every valid reading between two publishes is summarised (count, mean, min, max, standard deviation) in constant memory
+static TELEMETRY_WINDOW telemetry_window;
+
+// Readings are timestamped on the real-time core and translated to UTC with the tracked offset between the cores
+static TELEMETRY_CLOCK telemetry_clock;
+
+// A reading is only queued when a field moves past its deadband from the last reported value, or when nothing
+// has been reported for TELEMETRY_HEARTBEAT_SECONDS
+#define TELEMETRY_HEARTBEAT_SECONDS 300
+static TELEMETRY_DEADBAND telemetry_deadband = {.temperature = {.mode = DEADBAND_ABSOLUTE, .threshold = 1},
+                                                .pressure = {.mode = DEADBAND_ABSOLUTE, .threshold = 2},
+                                                .humidity = {.mode = DEADBAND_PERCENT, .threshold = 5},
+                                                .heartbeat_seconds = TELEMETRY_HEARTBEAT_SECONDS};
+
+// Telemetry readings are batched into one message, sent when the batch is full or the oldest reading reaches the maximum age
+#define TELEMETRY_BATCH_SIZE 12
+#define TELEMETRY_BATCH_MAX_AGE_SECONDS 60
+// Readings that cannot be sent are kept in mutable storage and backfilled once connected, oldest first, one message
+// every TELEMETRY_BACKFILL_INTERVAL_SECONDS. The store must fit the MutableStorage size in app_manifest.json.
+#define TELEMETRY_STORE_RECORDS 4096
+#define TELEMETRY_BACKFILL_INTERVAL_SECONDS 10
+#define MUTABLE_STORAGE_KB 64
+_Static_assert(TELEMETRY_STORE_BYTES(TELEMETRY_STORE_RECORDS) <= MUTABLE_STORAGE_KB * 1024, "Telemetry store larger than mutable storage");
+
+static TELEMETRY_STORE telemetry_store = {.capacity = TELEMETRY_STORE_RECORDS,
+                                          .order = TELEMETRY_BACKFILL_OLDEST_FIRST,
+                                          .backfill_interval_seconds = TELEMETRY_BACKFILL_INTERVAL_SECONDS,
+                                          .backfill_samples = TELEMETRY_BATCH_MAX_SAMPLES,
+                                          .fd = -1};
+
+// Built with the TELEMETRY_GZIP CMake option, messages of at least TELEMETRY_GZIP_MIN_BYTES are sent gzip compressed
+#define TELEMETRY_GZIP_MIN_BYTES 1024
+
+// The publish period adapts at runtime. It doubles with each failed publish up to TELEMETRY_MAX_PUBLISH_SECONDS, and
+// the period doubles (rate halves) while IoT Hub takes longer than TELEMETRY_PUBLISH_LATENCY_LIMIT_MS to confirm a
+// message. Otherwise it drops to TELEMETRY_FAST_PUBLISH_SECONDS for TELEMETRY_ANOMALY_HOLD_SECONDS after a reading
+// moves past its deadband and while the backlog drains. The period and the reason are sent with each message.
+#define TELEMETRY_PUBLISH_SECONDS 5
+#define TELEMETRY_FAST_PUBLISH_SECONDS 2
+#define TELEMETRY_MAX_PUBLISH_SECONDS 60
+#define TELEMETRY_ANOMALY_HOLD_SECONDS 60
+#define TELEMETRY_PUBLISH_LATENCY_LIMIT_MS 2000
+static TELEMETRY_RATE telemetry_rate = {.normal_seconds = TELEMETRY_PUBLISH_SECONDS,
+                                        .fast_seconds = TELEMETRY_FAST_PUBLISH_SECONDS,
+                                        .max_seconds = TELEMETRY_MAX_PUBLISH_SECONDS,
+                                        .anomaly_hold_seconds = TELEMETRY_ANOMALY_HOLD_SECONDS,
+                                        .latency_limit_ms = TELEMETRY_PUBLISH_LATENCY_LIMIT_MS};
+
+// Every telemetry message is tracked from enqueue to confirmation. Outcomes, retries, queue depth and latency
+// percentiles are published every TELEMETRY_HEALTH_SECONDS.
+#define TELEMETRY_HEALTH_SECONDS 300
+static TELEMETRY_HEALTH telemetry_health = {.rate = &telemetry_rate};
+static char healthBuffer[TELEMETRY_HEALTH_JSON_BYTES];
+
+static TELEMETRY_BATCH telemetry_batch = {.max_samples = TELEMETRY_BATCH_SIZE,
+                                          .max_age_seconds = TELEMETRY_BATCH_MAX_AGE_SECONDS,
+                                          .send = publish_telemetry_batch,
+                                          .gzip_min_bytes = TELEMETRY_GZIP_MIN_BYTES,
+                                          .store = &telemetry_store,
+                                          .rate = &telemetry_rate};
+
 DX_USER_CONFIG dx_config;
 bool azure_connected = false;
 static char *hvac_state[] = {"Unknown", "Heating", "Green", "Cooling", "On", "Off"};
@@ -63,7 +155,6 @@ typedef struct
 typedef struct
 {
     SENSOR latest;
-    SENSOR previous;
     bool updated;
     bool valid;
     HVAC_OPERATING_MODE latest_operating_mode;
@@ -84,12 +175,39 @@ static char Log_Debug_Time_buffer[128];
 /// </summary>
 static DX_MESSAGE_PROPERTY *messageProperties[] = {&(DX_MESSAGE_PROPERTY){.key = "appid", .value = "hvac"},
                                                    &(DX_MESSAGE_PROPERTY){.key = "type", .value = "telemetry"},
-                                                   &(DX_MESSAGE_PROPERTY){.key = "schema", .value = "1"}};
+                                                   &(DX_MESSAGE_PROPERTY){.key = "schema", .value = "2"}};
 
 /// <summary>
 /// Common content properties for publish messages to IoT Hub/Central
 /// </summary>
-static DX_MESSAGE_CONTENT_PROPERTIES contentProperties = {.contentEncoding = "utf-8", .contentType = "application/json"};
+static DX_MESSAGE_CONTENT_PROPERTIES contentProperties = {.contentEncoding = TELEMETRY_CONTENT_ENCODING, .contentType = TELEMETRY_CONTENT_TYPE};
+
+/// <summary>
+/// Content properties for gzip compressed telemetry, the body is binary so IoT Hub message routing cannot query it
+/// </summary>
+static DX_MESSAGE_CONTENT_PROPERTIES gzipContentProperties = {.contentEncoding = "gzip", .contentType = TELEMETRY_CONTENT_TYPE};
+
+/// <summary>
+/// Telemetry pipeline health summaries and handler profiles are routed apart from the readings
+/// </summary>
+static DX_MESSAGE_PROPERTY *healthMessageProperties[] = {&(DX_MESSAGE_PROPERTY){.key = "appid", .value = "hvac"},
+                                                         &(DX_MESSAGE_PROPERTY){.key = "type", .value = "health"},
+                                                         &(DX_MESSAGE_PROPERTY){.key = "schema", .value = "1"}};
+static DX_MESSAGE_PROPERTY *profileMessageProperties[] = {&(DX_MESSAGE_PROPERTY){.key = "appid", .value = "hvac"},
+                                                          &(DX_MESSAGE_PROPERTY){.key = "type", .value = "profile"},
+                                                          &(DX_MESSAGE_PROPERTY){.key = "schema", .value = "1"}};
+static DX_MESSAGE_CONTENT_PROPERTIES healthContentProperties = {.contentEncoding = "utf-8", .contentType = "application/json"};
+
+// Reported properties changed in one update cycle are sent as a single patch
+static TWIN_BATCH twin_batch;
+
+// Sensor read and reported property update periods, see RATE_SETTING for changing them at runtime
+#define READ_TELEMETRY_SECONDS 4
+#define UPDATE_DEVICE_TWINS_SECONDS 10
+
+// A burst of desired property updates, a slider dragged in IoT Central for example, is applied once the value has been
+// stable for the quiet period. Zero applies each update as it arrives.
+#define TARGET_TEMPERATURE_QUIET_MS 750
 
 // declare device twin bindings
 static DX_DEVICE_TWIN_BINDING dt_defer_requested = {.propertyName = "DeferredUpdateRequest", .twinType = DX_DEVICE_TWIN_STRING};
@@ -99,8 +217,49 @@ static DX_DEVICE_TWIN_BINDING dt_hvac_pressure = {.propertyName = "HvacPressure"
 static DX_DEVICE_TWIN_BINDING dt_hvac_start_utc = {.propertyName = "HvacStartupUtc", .twinType = DX_DEVICE_TWIN_STRING};
 static DX_DEVICE_TWIN_BINDING dt_hvac_sw_version = {.propertyName = "HvacSoftwareVersion", .twinType = DX_DEVICE_TWIN_STRING};
 static DX_DEVICE_TWIN_BINDING dt_hvac_target_temperature = {
-    .propertyName = "HvacTargetTemperature", .twinType = DX_DEVICE_TWIN_INT, .handler = dt_set_target_temperature_handler};
+    .propertyName = "HvacTargetTemperature", .twinType = DX_DEVICE_TWIN_INT, .handler = dt_debounce_handler};
 static DX_DEVICE_TWIN_BINDING dt_hvac_temperature = {.propertyName = "HvacTemperature", .twinType = DX_DEVICE_TWIN_INT};
+static DX_DEVICE_TWIN_BINDING dt_method_job_id = {.propertyName = "MethodJobId", .twinType = DX_DEVICE_TWIN_INT};
+static DX_DEVICE_TWIN_BINDING dt_method_job_progress = {.propertyName = "MethodJobProgress", .twinType = DX_DEVICE_TWIN_INT};
+static DX_DEVICE_TWIN_BINDING dt_method_job_state = {.propertyName = "MethodJobState", .twinType = DX_DEVICE_TWIN_STRING};
+static DX_DEVICE_TWIN_BINDING dt_publish_period = {.propertyName = "PublishPeriodSeconds", .twinType = DX_DEVICE_TWIN_INT, .handler = dt_set_rate_handler};
+static DX_DEVICE_TWIN_BINDING dt_read_period = {.propertyName = "ReadPeriodSeconds", .twinType = DX_DEVICE_TWIN_INT, .handler = dt_set_rate_handler};
+static DX_DEVICE_TWIN_BINDING dt_twin_update_period = {
+    .propertyName = "TwinUpdatePeriodSeconds", .twinType = DX_DEVICE_TWIN_INT, .handler = dt_set_rate_handler};
+static DX_DEVICE_TWIN_BINDING dt_publish_period_applied = {.propertyName = "PublishPeriodAppliedSeconds", .twinType = DX_DEVICE_TWIN_INT};
+static DX_DEVICE_TWIN_BINDING dt_read_period_applied = {.propertyName = "ReadPeriodAppliedSeconds", .twinType = DX_DEVICE_TWIN_INT};
+static DX_DEVICE_TWIN_BINDING dt_twin_update_period_applied = {.propertyName = "TwinUpdatePeriodAppliedSeconds", .twinType = DX_DEVICE_TWIN_INT};
+
+// Reported sensor properties are only written when they move past their band or hold a smaller change for the minimum
+// interval, and no more often than the minimum interval, so twin writes stay bounded however noisy the sensor
+#define TWIN_REPORT_MIN_INTERVAL_SECONDS 60
+static TWIN_HYSTERESIS report_temperature = {
+    .binding = &dt_hvac_temperature, .band = 1, .min_interval_seconds = TWIN_REPORT_MIN_INTERVAL_SECONDS};
+static TWIN_HYSTERESIS report_pressure = {.binding = &dt_hvac_pressure, .band = 2, .min_interval_seconds = TWIN_REPORT_MIN_INTERVAL_SECONDS};
+static TWIN_HYSTERESIS report_humidity = {.binding = &dt_hvac_humidity, .band = 2, .min_interval_seconds = TWIN_REPORT_MIN_INTERVAL_SECONDS};
+
+// The last known target temperature, timer periods and reported sensor values are kept after the telemetry store in mutable storage.
+// At startup the cached target temperature goes to the real-time core straight away, and the device twin from IoT Hub
+// is reconciled with it by version when it arrives.
+static TWIN_CACHE_ENTRY twin_cache_entries[] = {{.binding = &dt_hvac_target_temperature, .desired = true},
+                                                {.binding = &dt_hvac_temperature},
+                                                {.binding = &dt_hvac_pressure},
+                                                {.binding = &dt_hvac_humidity},
+                                                {.binding = &dt_publish_period, .desired = true},
+                                                {.binding = &dt_read_period, .desired = true},
+                                                {.binding = &dt_twin_update_period, .desired = true}};
+static TWIN_CACHE twin_cache = {
+    .entries = twin_cache_entries, .count = NELEMS(twin_cache_entries), .offset = TELEMETRY_STORE_BYTES(TELEMETRY_STORE_RECORDS), .fd = -1};
+_Static_assert(TELEMETRY_STORE_BYTES(TELEMETRY_STORE_RECORDS) + TWIN_CACHE_BYTES(NELEMS(twin_cache_entries)) <= MUTABLE_STORAGE_KB * 1024,
+               "Telemetry store and twin cache larger than mutable storage");
+
+// Time from startup to the first target temperature sent to the real-time core, and to the first one from IoT Hub
+static struct
+{
+    struct timespec start;
+    bool decided;
+    bool twin_received;
+} startup;
 
 // declare gpio bindings
 static DX_GPIO_BINDING gpio_operating_led = {
@@ -109,35 +268,137 @@ DX_GPIO_BINDING gpio_network_led = {
     .pin = NETWORK_CONNECTED_LED, .name = "network_led", .direction = DX_OUTPUT, .initialState = GPIO_Value_Low, .invertPin = true};
 
 // declare timer bindings
-DX_TIMER_BINDING tmr_azure_status_led_off = {.name = "tmr_azure_status_led_off", .handler = azure_status_led_off_handler};
-DX_TIMER_BINDING tmr_azure_status_led_on = {.period = {0, 500 * ONE_MS}, .name = "tmr_azure_status_led_on", .handler = azure_status_led_on_handler};
-static DX_TIMER_BINDING tmr_hvac_restart_oneshot_timer = {.name = "tmr_hvac_restart_oneshot_timer", .handler = hvac_delay_restart_handler};
-static DX_TIMER_BINDING tmr_publish_telemetry = {.period = {5, 0}, .name = "tmr_publish_telemetry", .handler = publish_telemetry_handler};
-static DX_TIMER_BINDING tmr_read_telemetry = {.period = {4, 0}, .name = "tmr_read_telemetry", .handler = read_telemetry_handler};
-static DX_TIMER_BINDING tmr_update_device_twins = {.period = {10, 0}, .name = "tmr_update_device_twins", .handler = update_device_twins};
-static DX_TIMER_BINDING tmr_watchdog = {.period = {30, 0}, .name = "tmr_publish_telemetry", .handler = watchdog_handler};
+static DX_TIMER_BINDING tmr_method_jobs = {.name = "tmr_method_jobs", .handler = method_jobs_handler};
+static DX_TIMER_BINDING tmr_timer_wheel = {.name = "tmr_timer_wheel", .handler = timer_wheel_handler};
+static DX_TIMER_BINDING tmr_twin_debounce = {.name = "tmr_twin_debounce", .handler = twin_debounce_handler};
+
+// The application timers share one kernel timer through the timer wheel. A timer may run up to its slack late so
+// timers due close together are handled in one wakeup, the status LED and restart timers have none.
+TIMER_WHEEL timer_wheel = {.timer = &tmr_timer_wheel};
+
+TIMER_WHEEL_TIMER tmr_azure_status_led = {.name = "tmr_azure_status_led", .handler = azure_status_led_handler, .period_ms = 500};
+static TIMER_WHEEL_TIMER tmr_hvac_restart_oneshot_timer = {.name = "tmr_hvac_restart_oneshot_timer", .handler = hvac_delay_restart_handler};
+static TIMER_WHEEL_TIMER tmr_publish_health = {
+    .name = "tmr_publish_health", .handler = publish_health_handler, .period_ms = TELEMETRY_HEALTH_SECONDS * 1000, .slack_ms = 5000};
+static TIMER_WHEEL_TIMER tmr_publish_telemetry = {
+    .name = "tmr_publish_telemetry", .handler = publish_telemetry_handler, .period_ms = TELEMETRY_PUBLISH_SECONDS * 1000, .slack_ms = 500};
+static TIMER_WHEEL_TIMER tmr_read_telemetry = {
+    .name = "tmr_read_telemetry", .handler = read_telemetry_handler, .period_ms = READ_TELEMETRY_SECONDS * 1000, .slack_ms = 250};
+static TIMER_WHEEL_TIMER tmr_update_device_twins = {
+    .name = "tmr_update_device_twins", .handler = update_device_twins, .period_ms = UPDATE_DEVICE_TWINS_SECONDS * 1000, .slack_ms = 1000};
+static TIMER_WHEEL_TIMER tmr_watchdog = {.name = "tmr_watchdog", .handler = watchdog_handler, .period_ms = 30 * 1000, .slack_ms = 5000};
+
+// Debounced desired properties, the binding handler is dt_debounce_handler
+static TWIN_DEBOUNCE debounce_target_temperature = {
+    .binding = &dt_hvac_target_temperature, .handler = dt_set_target_temperature_handler, .quiet_ms = TARGET_TEMPERATURE_QUIET_MS};
+static TWIN_DEBOUNCE_SET twin_debounce = {
+    .items = (TWIN_DEBOUNCE *[]){&debounce_target_temperature}, .count = 1, .timer = &tmr_twin_debounce};
+
+// The publish, read and device twin update periods can be throttled at runtime, across a fleet with the desired properties
+// or on one device with the SetRates direct method, {"publishSeconds":n,"readSeconds":n,"twinSeconds":n} with any subset
+// of the keys. The last one set wins. Desired periods are cached in mutable storage and applied again at startup, a period
+// set with the method lasts until the next restart. The periods in use are reported as the read-only Applied properties,
+// the writable properties only carry the desired value and its acknowledgement. The read period is also sent to the
+// real-time core so the sensor is not sampled faster than it is read.
+#define RATE_MIN_SECONDS 1
+#define RATE_MAX_SECONDS 3600
+
+typedef struct
+{
+    DX_DEVICE_TWIN_BINDING *binding;
+    DX_DEVICE_TWIN_BINDING *applied; // read-only, the period in use
+    TIMER_WHEEL_TIMER *timer;
+    const char *key; // SetRates JSON key
+    int seconds;
+} RATE_SETTING;
+
+static RATE_SETTING rate_publish = {.binding = &dt_publish_period,
+                                   .applied = &dt_publish_period_applied,
+                                   .timer = &tmr_publish_telemetry,
+                                   .key = "publishSeconds",
+                                   .seconds = TELEMETRY_PUBLISH_SECONDS};
+static RATE_SETTING rate_read = {
+    .binding = &dt_read_period, .applied = &dt_read_period_applied, .timer = &tmr_read_telemetry, .key = "readSeconds", .seconds = READ_TELEMETRY_SECONDS};
+static RATE_SETTING rate_twin_update = {.binding = &dt_twin_update_period,
+                                       .applied = &dt_twin_update_period_applied,
+                                       .timer = &tmr_update_device_twins,
+                                       .key = "twinSeconds",
+                                       .seconds = UPDATE_DEVICE_TWINS_SECONDS};
+static RATE_SETTING *rate_settings[] = {&rate_publish, &rate_read, &rate_twin_update};
+
+// HvacRestart and RtTraceCapture run as jobs, the methods return {"jobId":n,"state":"queued"} straight away. The job
+// state and progress are reported as the MethodJob properties, and GetJobStatus returns the status of the job in
+// {"jobId":n}, or of every job kept without a payload.
+#define RT_TRACE_CAPTURE_POLL_MS 500
+static METHOD_JOBS method_jobs = {.timer = &tmr_method_jobs, .report = report_method_job};
+
+// Event loop handlers are profiled for GetDiagnostics, the debug log and telemetry. The application timers are profiled
+// by the timer wheel and the device twin and direct method handlers by the profiler, the rest are bracketed here.
+// The slowest handlers are published with the health summary every TELEMETRY_HEALTH_SECONDS.
+static HANDLER_PROFILE profile_intercore_receive = {.name = "intercore_receive"};
+static HANDLER_PROFILE profile_method_jobs = {.name = "tmr_method_jobs"};
+static HANDLER_PROFILE profile_twin_debounce = {.name = "tmr_twin_debounce"};
+static HANDLER_PROFILE *handler_profiles[] = {&profile_intercore_receive, &profile_method_jobs, &profile_twin_debounce, &timer_wheel.profile};
+static char profileBuffer[HANDLER_PROFILE_JSON_BYTES];
+
+// GetDiagnostics returns one JSON snapshot of these sources, the real-time core stats are refreshed on every call and
+// with every health summary
+static char diagnosticsBuffer[DIAGNOSTICS_JSON_BYTES];
+static TWIN_HYSTERESIS *diagnostics_twin_reports[] = {&report_temperature, &report_pressure, &report_humidity};
+static DIAGNOSTICS diagnostics = {.clock = &telemetry_clock,
+                                  .health = &telemetry_health,
+                                  .twin_batch = &twin_batch,
+                                  .twin_cache = &twin_cache,
+                                  .twin_debounce = &twin_debounce,
+                                  .timer_wheel = &timer_wheel,
+                                  .twin_reports = diagnostics_twin_reports,
+                                  .twin_report_count = NELEMS(diagnostics_twin_reports)};
 
 // Declare direct method bindings
+static DX_DIRECT_METHOD_BINDING dm_get_diagnostics = {.methodName = "GetDiagnostics", .handler = get_diagnostics_handler};
+static DX_DIRECT_METHOD_BINDING dm_get_job_status = {.methodName = "GetJobStatus", .handler = get_job_status_handler};
 static DX_DIRECT_METHOD_BINDING dm_hvac_off = {.methodName = "HvacOff", .handler = gpio_off_handler, .context = &gpio_operating_led};
 static DX_DIRECT_METHOD_BINDING dm_hvac_on = {.methodName = "HvacOn", .handler = gpio_on_handler, .context = &gpio_operating_led};
 static DX_DIRECT_METHOD_BINDING dm_hvac_restart = {.methodName = "HvacRestart", .handler = hvac_restart_handler};
+static DX_DIRECT_METHOD_BINDING dm_rt_trace_capture = {.methodName = "RtTraceCapture", .handler = rt_trace_capture_handler};
+static DX_DIRECT_METHOD_BINDING dm_set_rates = {.methodName = "SetRates", .handler = set_rates_handler};
 
 // All bindings referenced in the following binding sets are initialised in the InitPeripheralsAndHandlers function
-DX_DEVICE_TWIN_BINDING *device_twin_bindings[] = {&dt_hvac_start_utc,  &dt_hvac_sw_version, &dt_hvac_temperature,    &dt_hvac_pressure,
-                                                  &dt_defer_requested, &dt_hvac_humidity,   &dt_hvac_operating_mode, &dt_hvac_target_temperature};
+DX_DEVICE_TWIN_BINDING *device_twin_bindings[] = {&dt_hvac_start_utc,          &dt_hvac_sw_version, &dt_hvac_temperature,    &dt_hvac_pressure,
+                                                  &dt_defer_requested,         &dt_hvac_humidity,   &dt_hvac_operating_mode, &dt_hvac_target_temperature,
+                                                  &dt_publish_period,          &dt_read_period,     &dt_twin_update_period,  &dt_method_job_id,
+                                                  &dt_method_job_progress,     &dt_method_job_state,    &dt_publish_period_applied,
+                                                  &dt_read_period_applied,     &dt_twin_update_period_applied};
 
-DX_DIRECT_METHOD_BINDING *direct_method_binding_sets[] = {&dm_hvac_restart, &dm_hvac_on, &dm_hvac_off};
+DX_DIRECT_METHOD_BINDING *direct_method_binding_sets[] = {&dm_hvac_restart,     &dm_hvac_on,         &dm_hvac_off,
+                                                          &dm_rt_trace_capture, &dm_get_diagnostics, &dm_set_rates,
+                                                          &dm_get_job_status};
 
+#ifdef NETWORK_CONNECTED_LED_PWM
+DX_GPIO_BINDING *gpio_bindings[] = {&gpio_operating_led};
+#else
 DX_GPIO_BINDING *gpio_bindings[] = {&gpio_network_led, &gpio_operating_led};
+#endif
+
+DX_TIMER_BINDING *timer_bindings[] = {&tmr_timer_wheel, &tmr_twin_debounce, &tmr_method_jobs};
 
-DX_TIMER_BINDING *timer_bindings[] = {
-    &tmr_publish_telemetry,   &tmr_read_telemetry, &tmr_update_device_twins, &tmr_hvac_restart_oneshot_timer, &tmr_azure_status_led_off,
-    &tmr_azure_status_led_on, &tmr_watchdog};
+TIMER_WHEEL_TIMER *timer_wheel_timers[] = {&tmr_publish_health,      &tmr_publish_telemetry,          &tmr_read_telemetry,
+                                           &tmr_update_device_twins, &tmr_hvac_restart_oneshot_timer, &tmr_azure_status_led,
+                                           &tmr_watchdog};
 
 INTERCORE_BLOCK intercore_block;
 
+// Receive buffer sized for the largest message the real-time core sends
+static union
+{
+    INTERCORE_CMD cmd;
+    INTERCORE_BLOCK environment;
+    INTERCORE_TRACE_BLOCK trace;
+    INTERCORE_STATS_BLOCK stats;
+} intercore_recv_block;
+
 DX_INTERCORE_BINDING intercore_environment_ctx = {.nonblocking_io = true,
                                                   .rtAppComponentId = CORE_ENVIRONMENT_COMPONENT_ID,
                                                   .interCoreCallback = intercore_environment_receive_msg_handler,
-                                                  .intercore_recv_block = &intercore_block,
-                                                  .intercore_recv_block_length = sizeof(intercore_block)};
\ No newline at end of file
+                                                  .intercore_recv_block = &intercore_recv_block,
+                                                  .intercore_recv_block_length = sizeof(intercore_recv_block)};
\ No newline at end of file
@@ -0,0 +1,210 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+#include "method_jobs.h"
+
+#include "dx_utilities.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define NS_PER_SECOND 1000000000L
+
+static const char *states[] = {"free", "queued", "running", "succeeded", "failed"};
+
+static bool reached(const struct timespec *now, const struct timespec *when)
+{
+    return now->tv_sec > when->tv_sec || (now->tv_sec == when->tv_sec && now->tv_nsec >= when->tv_nsec);
+}
+
+static bool active(const METHOD_JOB *job)
+{
+    return job->state == METHOD_JOB_QUEUED || job->state == METHOD_JOB_RUNNING;
+}
+
+static void set_due(METHOD_JOB *job, const struct timespec *now, unsigned delay_ms)
+{
+    long ns = now->tv_nsec + (long)(delay_ms % 1000) * 1000000;
+    job->due.tv_sec = now->tv_sec + (time_t)(delay_ms / 1000) + ns / NS_PER_SECOND;
+    job->due.tv_nsec = ns % NS_PER_SECOND;
+}
+
+/// <summary>
+/// One shot to the earliest step due
+/// </summary>
+static void arm_timer(METHOD_JOBS *jobs, const struct timespec *now)
+{
+    const struct timespec *next = NULL;
+
+    for (size_t i = 0; i < METHOD_JOBS_MAX; i++)
+    {
+        if (active(&jobs->jobs[i]) && (next == NULL || reached(next, &jobs->jobs[i].due)))
+        {
+            next = &jobs->jobs[i].due;
+        }
+    }
+
+    if (next != NULL)
+    {
+        long ns = (long)(next->tv_sec - now->tv_sec) * NS_PER_SECOND + (next->tv_nsec - now->tv_nsec);
+        ns = ns > 0 ? ns : 1;
+        dx_timerOneShotSet(jobs->timer, &(struct timespec){ns / NS_PER_SECOND, ns % NS_PER_SECOND});
+    }
+}
+
+static void report(METHOD_JOBS *jobs, METHOD_JOB *job)
+{
+    if (job->state == job->reported_state &&
+        job->progress / METHOD_JOB_REPORT_PERCENT == job->reported_progress / METHOD_JOB_REPORT_PERCENT)
+    {
+        return;
+    }
+
+    job->reported_state = job->state;
+    job->reported_progress = job->progress;
+
+    if (jobs->report != NULL)
+    {
+        jobs->report(job);
+    }
+}
+
+const METHOD_JOB *method_jobs_start(METHOD_JOBS *jobs, const char *name, METHOD_JOB_STEP step)
+{
+    METHOD_JOB *job = NULL;
+    struct timespec now;
+
+    // A free slot, its ID is zero, or the job that finished longest ago
+    for (size_t i = 0; i < METHOD_JOBS_MAX; i++)
+    {
+        if (!active(&jobs->jobs[i]) && (job == NULL || jobs->jobs[i].id < job->id))
+        {
+            job = &jobs->jobs[i];
+        }
+    }
+
+    if (job == NULL)
+    {
+        jobs->rejected++;
+        return NULL;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    memset(job, 0, sizeof(*job));
+    // Zero marks a free slot
+    job->id = ++jobs->last_id != 0 ? jobs->last_id : ++jobs->last_id;
+    job->name = name;
+    job->step = step;
+    job->state = METHOD_JOB_QUEUED;
+    job->started = now;
+    job->due = now;
+    jobs->started++;
+
+    dx_Log_Debug("Job %u %s queued\n", job->id, job->name);
+    report(jobs, job);
+    arm_timer(jobs, &now);
+
+    return job;
+}
+
+void method_jobs_timer(METHOD_JOBS *jobs)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    for (size_t i = 0; i < METHOD_JOBS_MAX; i++)
+    {
+        METHOD_JOB *job = &jobs->jobs[i];
+
+        if (!active(job) || !reached(&now, &job->due))
+        {
+            continue;
+        }
+
+        job->elapsed_ms = (uint32_t)((now.tv_sec - job->started.tv_sec) * 1000 + (now.tv_nsec - job->started.tv_nsec) / 1000000);
+        job->next_step_ms = 0;
+        job->state = job->step(job);
+        job->step_count++;
+
+        switch (job->state)
+        {
+        case METHOD_JOB_RUNNING:
+            set_due(job, &now, job->next_step_ms);
+            break;
+        case METHOD_JOB_SUCCEEDED:
+            job->progress = 100;
+            jobs->succeeded++;
+            dx_Log_Debug("Job %u %s succeeded in %u ms: %s\n", job->id, job->name, job->elapsed_ms, job->result);
+            break;
+        default:
+            job->state = METHOD_JOB_FAILED;
+            jobs->failed++;
+            dx_Log_Debug("Job %u %s failed after %u ms: %s\n", job->id, job->name, job->elapsed_ms, job->result);
+            break;
+        }
+
+        report(jobs, job);
+    }
+
+    arm_timer(jobs, &now);
+}
+
+const char *method_jobs_state(METHOD_JOB_STATE state)
+{
+    return (unsigned)state < sizeof(states) / sizeof(states[0]) ? states[state] : "unknown";
+}
+
+static size_t job_status(const METHOD_JOB *job, char *buffer, size_t buffer_size)
+{
+    int length = snprintf(buffer, buffer_size, "{\"jobId\":%u,\"name\":\"%s\",\"state\":\"%s\",\"progress\":%u,\"elapsedMs\":%u,\"result\":\"%s\"}",
+                          job->id, job->name, method_jobs_state(job->state), job->progress, job->elapsed_ms, job->result);
+
+    return length > 0 && (size_t)length < buffer_size ? (size_t)length : 0;
+}
+
+size_t method_jobs_status(const METHOD_JOBS *jobs, uint32_t id, char *buffer, size_t buffer_size)
+{
+    size_t length = 0, written;
+
+    for (size_t i = 0; id != 0 && i < METHOD_JOBS_MAX; i++)
+    {
+        if (jobs->jobs[i].state != METHOD_JOB_FREE && jobs->jobs[i].id == id)
+        {
+            return job_status(&jobs->jobs[i], buffer, buffer_size);
+        }
+    }
+
+    if (id != 0 || buffer_size < 3)
+    {
+        return 0;
+    }
+
+    buffer[length++] = '[';
+
+    for (size_t i = 0; i < METHOD_JOBS_MAX; i++)
+    {
+        if (jobs->jobs[i].state == METHOD_JOB_FREE)
+        {
+            continue;
+        }
+
+        if (length > 1)
+        {
+            buffer[length++] = ',';
+        }
+
+        // Room kept for the separator and the closing bracket
+        if ((written = job_status(&jobs->jobs[i], buffer + length, buffer_size - length - 1)) == 0)
+        {
+            return 0;
+        }
+        length += written;
+    }
+
+    buffer[length++] = ']';
+    buffer[length] = '\0';
+
+    return length;
+}
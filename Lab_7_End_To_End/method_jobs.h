@@ -0,0 +1,93 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+#pragma once
+
+#include "dx_timer.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+// Jobs kept for polling, the oldest finished job is reused when a new one starts
+#define METHOD_JOBS_MAX 4
+// Longest result message, including the terminator. Results are written by the job steps and must not need JSON escaping.
+#define METHOD_JOB_RESULT_BYTES 64
+// Largest status document for one job
+#define METHOD_JOB_JSON_BYTES 192
+// Progress is reported each time it moves by this many percent, and on every state change
+#define METHOD_JOB_REPORT_PERCENT 10
+
+typedef enum
+{
+    METHOD_JOB_FREE,
+    METHOD_JOB_QUEUED,
+    METHOD_JOB_RUNNING,
+    METHOD_JOB_SUCCEEDED,
+    METHOD_JOB_FAILED
+} METHOD_JOB_STATE;
+
+typedef struct _method_job METHOD_JOB;
+
+/// <summary>
+/// One step of a job, run from the event loop. A step does a bounded amount of work, updates progress and result, and
+/// returns METHOD_JOB_RUNNING with next_step_ms set to run again, or the final state.
+/// </summary>
+typedef METHOD_JOB_STATE (*METHOD_JOB_STEP)(METHOD_JOB *job);
+
+struct _method_job
+{
+    uint32_t id; // zero is never used
+    const char *name;
+    METHOD_JOB_STEP step;
+    METHOD_JOB_STATE state;
+    unsigned step_count;   // steps run before this one
+    unsigned progress;     // percent
+    unsigned next_step_ms; // delay before the next step, set by a step that returns METHOD_JOB_RUNNING
+    uint32_t elapsed_ms;   // since the job started, updated before each step
+    struct timespec started; // CLOCK_MONOTONIC
+    struct timespec due;
+    METHOD_JOB_STATE reported_state;
+    unsigned reported_progress;
+    char result[METHOD_JOB_RESULT_BYTES];
+};
+
+typedef void (*METHOD_JOB_REPORT)(const METHOD_JOB *job);
+
+/// <summary>
+/// Direct methods that take longer than an event loop handler should, run as jobs. The method returns the job ID
+/// straight away, the job then runs one step per timer event so telemetry and device twin handling carry on between steps.
+/// </summary>
+typedef struct
+{
+    METHOD_JOB jobs[METHOD_JOBS_MAX];
+    uint32_t last_id;
+    DX_TIMER_BINDING *timer;  // one shot, its handler calls method_jobs_timer
+    METHOD_JOB_REPORT report; // job progress and state changes, NULL if not reported
+    // Since start
+    unsigned started;
+    unsigned succeeded;
+    unsigned failed;
+    unsigned rejected; // no free slot
+} METHOD_JOBS;
+
+/// <summary>
+/// Queue a job, its first step runs on the next timer event
+/// </summary>
+/// <returns>NULL if every slot holds a job that has not finished</returns>
+const METHOD_JOB *method_jobs_start(METHOD_JOBS *jobs, const char *name, METHOD_JOB_STEP step);
+
+/// <summary>
+/// Run a step of each job that is due, then arm the timer for the next one
+/// </summary>
+void method_jobs_timer(METHOD_JOBS *jobs);
+
+const char *method_jobs_state(METHOD_JOB_STATE state);
+
+/// <summary>
+/// Serialize the status of one job, {"jobId":n,"name":"..","state":"..","progress":n,"elapsedMs":n,"result":".."}, or
+/// with id zero a JSON array of every job kept
+/// </summary>
+/// <returns>Length written, zero if the job is not known or the buffer is too small</returns>
+size_t method_jobs_status(const METHOD_JOBS *jobs, uint32_t id, char *buffer, size_t buffer_size);
@@ -0,0 +1,119 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+#include "rt_trace_capture.h"
+
+#include <applibs/log.h>
+#include <stdio.h>
+#include <time.h>
+
+// Bytes of trace data per debug log line, keeps each line well under the log line limit
+#define TRACE_BYTES_PER_LINE 64
+
+static bool capture_in_progress = false;
+static uint32_t captured_bytes;
+static uint32_t trace_size;
+static struct timespec requested_at;
+
+static void request_chunk(DX_INTERCORE_BINDING *intercore_binding, uint32_t offset)
+{
+    INTERCORE_TRACE_BLOCK request = {.cmd = IC_TRACE_CHUNK, .offset = offset};
+    dx_intercorePublish(intercore_binding, &request, IC_TRACE_REQUEST_LENGTH);
+    clock_gettime(CLOCK_MONOTONIC, &requested_at);
+}
+
+static bool reply_overdue(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (now.tv_sec - requested_at.tv_sec) * 1000 + (now.tv_nsec - requested_at.tv_nsec) / 1000000 >= RT_TRACE_CAPTURE_TIMEOUT_MS;
+}
+
+static void log_trace_bytes(uint32_t total_size, uint32_t offset, const uint8_t *data, size_t length)
+{
+    char hex[TRACE_BYTES_PER_LINE * 2 + 1];
+
+    for (size_t i = 0; i < length; i++)
+    {
+        snprintf(&hex[i * 2], 3, "%02x", data[i]);
+    }
+    hex[length * 2] = '\0';
+
+    Log_Debug("RT_TRACE %u %u %s\n", total_size, offset, hex);
+}
+
+bool rt_trace_capture_start(DX_INTERCORE_BINDING *intercore_binding)
+{
+    // A lost chunk or reply would otherwise leave the capture in progress until restart
+    if (capture_in_progress && reply_overdue())
+    {
+        rt_trace_capture_cancel();
+    }
+
+    if (capture_in_progress)
+    {
+        return false;
+    }
+
+    capture_in_progress = true;
+    captured_bytes = 0;
+    trace_size = 0;
+    request_chunk(intercore_binding, 0);
+
+    return true;
+}
+
+void rt_trace_capture_chunk(DX_INTERCORE_BINDING *intercore_binding, const INTERCORE_TRACE_BLOCK *chunk, ssize_t message_length)
+{
+    if (!capture_in_progress || message_length < (ssize_t)IC_TRACE_REQUEST_LENGTH ||
+        message_length < (ssize_t)(IC_TRACE_REQUEST_LENGTH + chunk->length) || chunk->length > IC_TRACE_CHUNK_BYTES)
+    {
+        return;
+    }
+
+    trace_size = chunk->total_size;
+
+    if (chunk->total_size == 0)
+    {
+        Log_Debug("RT_TRACE not enabled, rebuild the real-time app with THREADX_EVENT_TRACE=ON\n");
+        capture_in_progress = false;
+        return;
+    }
+
+    for (uint32_t i = 0; i < chunk->length; i += TRACE_BYTES_PER_LINE)
+    {
+        size_t line_length = chunk->length - i < TRACE_BYTES_PER_LINE ? chunk->length - i : TRACE_BYTES_PER_LINE;
+        log_trace_bytes(chunk->total_size, chunk->offset + i, &chunk->data[i], line_length);
+    }
+
+    uint32_t next_offset = chunk->offset + chunk->length;
+    captured_bytes = next_offset;
+
+    if (chunk->length == 0 || next_offset >= chunk->total_size)
+    {
+        Log_Debug("RT_TRACE_END %u\n", chunk->total_size);
+        capture_in_progress = false;
+    }
+    else
+    {
+        request_chunk(intercore_binding, next_offset);
+    }
+}
+
+bool rt_trace_capture_status(uint32_t *captured, uint32_t *total_size)
+{
+    *captured = captured_bytes;
+    *total_size = trace_size;
+
+    return capture_in_progress;
+}
+
+void rt_trace_capture_cancel(void)
+{
+    if (capture_in_progress)
+    {
+        Log_Debug("RT_TRACE_CANCELLED %u\n", captured_bytes);
+        capture_in_progress = false;
+    }
+}
@@ -0,0 +1,37 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+#pragma once
+
+#include "dx_intercore.h"
+#include "../IntercoreContract/intercore_contract.h"
+
+#include <stdbool.h>
+
+// A capture whose real-time core has not answered the last chunk request for this long is abandoned
+#define RT_TRACE_CAPTURE_TIMEOUT_MS 30000
+
+/// <summary>
+/// Start reading the real-time core ThreadX trace buffer, one IC_TRACE_CHUNK request at a time.
+/// Chunks are written to the debug log as "RT_TRACE <total> <offset> <hex>" lines for the host tracex_decode tool.
+/// A capture still waiting for a reply after RT_TRACE_CAPTURE_TIMEOUT_MS is cancelled and a new one started.
+/// </summary>
+/// <returns>false if a capture is already in progress</returns>
+bool rt_trace_capture_start(DX_INTERCORE_BINDING *intercore_binding);
+
+/// <summary>
+/// Process an IC_TRACE_CHUNK reply from the real-time core and request the next chunk
+/// </summary>
+void rt_trace_capture_chunk(DX_INTERCORE_BINDING *intercore_binding, const INTERCORE_TRACE_BLOCK *chunk, ssize_t message_length);
+
+/// <summary>
+/// Bytes captured so far and the size of the trace buffer, zero until the first chunk arrives or if the real-time app
+/// was built without the trace
+/// </summary>
+/// <returns>true while a capture is in progress</returns>
+bool rt_trace_capture_status(uint32_t *captured, uint32_t *total_size);
+
+/// <summary>
+/// Give up on a capture the real-time core stopped answering, a reply that still arrives is ignored
+/// </summary>
+void rt_trace_capture_cancel(void);
@@ -0,0 +1,88 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+#include "telemetry_clock.h"
+
+#define NS_PER_SECOND 1000000000LL
+
+static int64_t timespec_ns(const struct timespec *time)
+{
+    return (int64_t)time->tv_sec * NS_PER_SECOND + time->tv_nsec;
+}
+
+static int64_t monotonic_ms(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return timespec_ns(&now) / 1000000;
+}
+
+void telemetry_clock_monotonic_to_utc(const struct timespec *monotonic, struct timespec *utc)
+{
+    struct timespec now_monotonic, now_utc;
+
+    clock_gettime(CLOCK_MONOTONIC, &now_monotonic);
+    clock_gettime(CLOCK_REALTIME, &now_utc);
+
+    int64_t ns = timespec_ns(monotonic) + timespec_ns(&now_utc) - timespec_ns(&now_monotonic);
+
+    utc->tv_sec = (time_t)(ns / NS_PER_SECOND);
+    utc->tv_nsec = (long)(ns % NS_PER_SECOND);
+}
+
+void telemetry_clock_request_sent(TELEMETRY_CLOCK *clock)
+{
+    clock->request_pending = true;
+    clock->request_ms = monotonic_ms();
+}
+
+void telemetry_clock_reply(TELEMETRY_CLOCK *clock, uint32_t reply_ms)
+{
+    int64_t round_trip_ms = monotonic_ms() - clock->request_ms;
+    bool matched = clock->request_pending;
+
+    clock->request_pending = false;
+
+    if (!matched || round_trip_ms > TELEMETRY_CLOCK_MAX_ROUND_TRIP_MS)
+    {
+        return;
+    }
+
+    // The reply was sent somewhere in the round trip, assume the middle. The counters wrap, so the offset is kept
+    // modulo 2^32.
+    TELEMETRY_CLOCK_EXCHANGE *exchange = &clock->exchanges[clock->next];
+    exchange->offset_ms = (uint32_t)(clock->request_ms + round_trip_ms / 2) - reply_ms;
+    exchange->round_trip_ms = (uint32_t)round_trip_ms;
+
+    clock->next = (clock->next + 1) % TELEMETRY_CLOCK_EXCHANGES;
+    clock->count = clock->count < TELEMETRY_CLOCK_EXCHANGES ? clock->count + 1 : clock->count;
+
+    // The shortest round trip bounds the error best, a reply delayed by a busy core is skipped
+    clock->best = clock->exchanges[0];
+    for (size_t i = 1; i < clock->count; i++)
+    {
+        if (clock->exchanges[i].round_trip_ms < clock->best.round_trip_ms)
+        {
+            clock->best = clock->exchanges[i];
+        }
+    }
+}
+
+bool telemetry_clock_rt_to_utc(const TELEMETRY_CLOCK *clock, uint32_t rt_ms, struct timespec *utc)
+{
+    if (clock->count == 0)
+    {
+        return false;
+    }
+
+    int64_t now_ms = monotonic_ms();
+    // signed, an estimate a few milliseconds off can put a fresh reading just after now
+    int32_t age_ms = (int32_t)((uint32_t)now_ms - (rt_ms + clock->best.offset_ms));
+    int64_t acquired_ms = now_ms - age_ms;
+
+    struct timespec monotonic = {.tv_sec = (time_t)(acquired_ms / 1000), .tv_nsec = (long)(acquired_ms % 1000) * 1000000};
+    telemetry_clock_monotonic_to_utc(&monotonic, utc);
+
+    return true;
+}
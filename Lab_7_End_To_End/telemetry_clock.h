@@ -0,0 +1,56 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+// Request and reply exchanges kept for the real-time core clock offset, the one with the shortest round trip is used
+#define TELEMETRY_CLOCK_EXCHANGES 8
+// A slower reply is not used for the offset, it is most likely not the reply to the last request
+#define TELEMETRY_CLOCK_MAX_ROUND_TRIP_MS 1000
+
+typedef struct
+{
+    uint32_t offset_ms;     // high-level CLOCK_MONOTONIC milliseconds minus real-time core milliseconds, modulo 2^32
+    uint32_t round_trip_ms; // the offset is within half of this
+} TELEMETRY_CLOCK_EXCHANGE;
+
+/// <summary>
+/// Offset between the real-time core millisecond counter and CLOCK_MONOTONIC, estimated NTP style from the time a
+/// request was sent, the real-time core time in its reply, and the time the reply arrived
+/// </summary>
+typedef struct
+{
+    bool request_pending;
+    int64_t request_ms;
+    TELEMETRY_CLOCK_EXCHANGE exchanges[TELEMETRY_CLOCK_EXCHANGES];
+    size_t next;
+    size_t count;
+    TELEMETRY_CLOCK_EXCHANGE best;
+} TELEMETRY_CLOCK;
+
+/// <summary>
+/// Convert a CLOCK_MONOTONIC time to UTC with the current offset between CLOCK_REALTIME and CLOCK_MONOTONIC, so a
+/// reading is placed correctly even if the system time was set after it was taken
+/// </summary>
+void telemetry_clock_monotonic_to_utc(const struct timespec *monotonic, struct timespec *utc);
+
+/// <summary>
+/// Call just before sending a request the real-time core replies to with its clock
+/// </summary>
+void telemetry_clock_request_sent(TELEMETRY_CLOCK *clock);
+
+/// <summary>
+/// Update the offset from a reply, reply_ms is the real-time core time when it sent the reply
+/// </summary>
+void telemetry_clock_reply(TELEMETRY_CLOCK *clock, uint32_t reply_ms);
+
+/// <summary>
+/// Convert a real-time core time in the last 24 days to UTC
+/// </summary>
+/// <returns>false until there has been an exchange to estimate the offset from</returns>
+bool telemetry_clock_rt_to_utc(const TELEMETRY_CLOCK *clock, uint32_t rt_ms, struct timespec *utc);
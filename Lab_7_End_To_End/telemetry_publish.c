@@ -0,0 +1,76 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+#include "telemetry_publish.h"
+
+#include "dx_utilities.h"
+
+#include <azureiot/iothub_device_client_ll.h>
+#include <azureiot/iothub_message.h>
+
+// The SDK confirmation context is the tracking slot, the tracker itself is kept here
+static TELEMETRY_HEALTH *confirm_health;
+
+static void send_confirmed(IOTHUB_CLIENT_CONFIRMATION_RESULT result, void *context)
+{
+    TELEMETRY_OUTCOME outcome = result == IOTHUB_CLIENT_CONFIRMATION_OK                ? TELEMETRY_OUTCOME_DELIVERED
+                                : result == IOTHUB_CLIENT_CONFIRMATION_MESSAGE_TIMEOUT ? TELEMETRY_OUTCOME_TIMEOUT
+                                                                                       : TELEMETRY_OUTCOME_FAILED;
+
+    if (confirm_health == NULL)
+    {
+        return;
+    }
+
+    uint32_t latency_ms = telemetry_health_confirmed(confirm_health, context, outcome);
+
+    if (outcome != TELEMETRY_OUTCOME_DELIVERED)
+    {
+        dx_Log_Debug("Telemetry message not delivered: %s after %u ms\n", MU_ENUM_TO_STRING(IOTHUB_CLIENT_CONFIRMATION_RESULT, result),
+                     latency_ms);
+    }
+}
+
+bool telemetry_publish(TELEMETRY_HEALTH *health, bool retry, const void *message, size_t length, DX_MESSAGE_PROPERTY **properties,
+                       size_t property_count, const DX_MESSAGE_CONTENT_PROPERTIES *content)
+{
+    IOTHUB_MESSAGE_HANDLE handle;
+    TELEMETRY_HEALTH_MESSAGE *tracked;
+    bool queued;
+
+    confirm_health = health;
+
+    if (!dx_isAzureConnected() || (handle = IoTHubMessage_CreateFromByteArray(message, length)) == NULL)
+    {
+        telemetry_health_not_sent(health, retry);
+        return false;
+    }
+
+    for (size_t i = 0; i < property_count; i++)
+    {
+        IoTHubMessage_SetProperty(handle, properties[i]->key, properties[i]->value);
+    }
+
+    if (content && content->contentEncoding)
+    {
+        IoTHubMessage_SetContentEncodingSystemProperty(handle, content->contentEncoding);
+    }
+
+    if (content && content->contentType)
+    {
+        IoTHubMessage_SetContentTypeSystemProperty(handle, content->contentType);
+    }
+
+    tracked = telemetry_health_enqueued(health, retry);
+    queued = IoTHubDeviceClient_LL_SendEventAsync(dx_azureClientHandleGet(), handle, send_confirmed, tracked) == IOTHUB_CLIENT_OK;
+
+    // the SDK keeps its own copy
+    IoTHubMessage_Destroy(handle);
+
+    if (!queued)
+    {
+        telemetry_health_confirmed(health, tracked, TELEMETRY_OUTCOME_NOT_SENT);
+    }
+
+    return queued;
+}
@@ -0,0 +1,19 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+#pragma once
+
+#include "dx_azure_iot.h"
+#include "telemetry_health.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/// <summary>
+/// Publish like dx_azurePublish, but with a confirmation callback so health sees every message from enqueue to
+/// confirmation. One health tracker is used for the whole app.
+/// </summary>
+/// <param name="retry">the message carries readings that failed to send before</param>
+/// <returns>true if the SDK queued the message, the outcome is recorded in health when it is confirmed</returns>
+bool telemetry_publish(TELEMETRY_HEALTH *health, bool retry, const void *message, size_t length, DX_MESSAGE_PROPERTY **properties,
+                       size_t property_count, const DX_MESSAGE_CONTENT_PROPERTIES *content);
@@ -0,0 +1,49 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+#include "telemetry_stats.h"
+
+#include <math.h>
+#include <string.h>
+
+void running_stats_add(RUNNING_STATS *stats, int value)
+{
+    if (stats->count == 0)
+    {
+        stats->min = stats->max = value;
+    }
+    else
+    {
+        stats->min = value < stats->min ? value : stats->min;
+        stats->max = value > stats->max ? value : stats->max;
+    }
+
+    // Welford's update, numerically stable for long windows
+    stats->count++;
+    double delta = value - stats->mean;
+    stats->mean += delta / stats->count;
+    stats->m2 += delta * (value - stats->mean);
+}
+
+int running_stats_mean(const RUNNING_STATS *stats)
+{
+    return (int)lround(stats->mean);
+}
+
+double running_stats_stddev(const RUNNING_STATS *stats)
+{
+    return stats->count > 1 ? sqrt(stats->m2 / (stats->count - 1)) : 0.0;
+}
+
+void telemetry_window_add(TELEMETRY_WINDOW *window, const struct timespec *acquired, int temperature, int pressure, int humidity)
+{
+    window->timestamp = *acquired;
+    running_stats_add(&window->temperature, temperature);
+    running_stats_add(&window->pressure, pressure);
+    running_stats_add(&window->humidity, humidity);
+}
+
+void telemetry_window_reset(TELEMETRY_WINDOW *window)
+{
+    memset(window, 0, sizeof(*window));
+}
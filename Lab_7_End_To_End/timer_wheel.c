@@ -0,0 +1,288 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+#include "timer_wheel.h"
+
+#include "dx_utilities.h"
+
+#define NS_PER_SECOND 1000000000L
+#define SLOT_MASK (TIMER_WHEEL_SLOTS - 1)
+
+// Ticks covered by one slot of the level
+static uint64_t slot_ticks(int level)
+{
+    return (uint64_t)1 << (TIMER_WHEEL_LEVEL_BITS * level);
+}
+
+static uint64_t elapsed_us(const TIMER_WHEEL *wheel)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint64_t)((int64_t)(now.tv_sec - wheel->origin.tv_sec) * 1000000 + (now.tv_nsec - wheel->origin.tv_nsec) / 1000);
+}
+
+static void unlink_timer(TIMER_WHEEL_TIMER *timer)
+{
+    if (!timer->pending)
+    {
+        return;
+    }
+
+    *timer->pprev = timer->next;
+    if (timer->next != NULL)
+    {
+        timer->next->pprev = timer->pprev;
+    }
+
+    timer->next = NULL;
+    timer->pprev = NULL;
+    timer->pending = false;
+}
+
+static void push(TIMER_WHEEL_TIMER **head, TIMER_WHEEL_TIMER *timer)
+{
+    timer->next = *head;
+    if (*head != NULL)
+    {
+        (*head)->pprev = &timer->next;
+    }
+
+    timer->pprev = head;
+    *head = timer;
+    timer->pending = true;
+}
+
+/// <summary>
+/// Move a whole list to a local head, so timers can be unlinked from it while it is walked
+/// </summary>
+static void take(TIMER_WHEEL_TIMER **slot, TIMER_WHEEL_TIMER **head)
+{
+    *head = *slot;
+    *slot = NULL;
+
+    if (*head != NULL)
+    {
+        (*head)->pprev = head;
+    }
+}
+
+/// <summary>
+/// File the timer in the lowest level whose span reaches its expiry
+/// </summary>
+static void insert(TIMER_WHEEL *wheel, TIMER_WHEEL_TIMER *timer)
+{
+    uint64_t delta = timer->expires - wheel->tick;
+    uint64_t expires = timer->expires;
+    int level = 0;
+
+    while (level < TIMER_WHEEL_LEVELS - 1 && delta >= slot_ticks(level + 1))
+    {
+        level++;
+    }
+
+    // Beyond the top level the timer waits in the furthest slot and is filed again when that slot cascades
+    if (delta >= slot_ticks(TIMER_WHEEL_LEVELS))
+    {
+        expires = wheel->tick + slot_ticks(TIMER_WHEEL_LEVELS) - 1;
+    }
+
+    push(&wheel->slots[level][(expires >> (TIMER_WHEEL_LEVEL_BITS * level)) & SLOT_MASK], timer);
+}
+
+/// <summary>
+/// Set the expiry tick from the deadline, never in a tick already processed
+/// </summary>
+static void schedule(TIMER_WHEEL *wheel, TIMER_WHEEL_TIMER *timer)
+{
+    timer->expires = (timer->deadline_ms + TIMER_WHEEL_TICK_MS - 1) / TIMER_WHEEL_TICK_MS;
+    timer->expires = timer->expires > wheel->tick ? timer->expires : wheel->tick + 1;
+
+    insert(wheel, timer);
+}
+
+/// <summary>
+/// Wake for the first timer that would otherwise run later than its slack allows, every timer due by then shares the
+/// wakeup. The registered timers are scanned rather than the slots, there are only a handful.
+/// </summary>
+static void arm(TIMER_WHEEL *wheel)
+{
+    uint64_t wake = UINT64_MAX;
+
+    if (wheel->running)
+    {
+        return;
+    }
+
+    for (size_t i = 0; i < wheel->timer_count; i++)
+    {
+        const TIMER_WHEEL_TIMER *timer = wheel->timers[i];
+        uint64_t latest = timer->expires + timer->slack_ms / TIMER_WHEEL_TICK_MS;
+
+        wake = timer->pending && latest < wake ? latest : wake;
+    }
+
+    if (wake == UINT64_MAX || wake == wheel->armed_tick)
+    {
+        return;
+    }
+
+    int64_t ns = ((int64_t)wake * TIMER_WHEEL_TICK_MS * 1000 - (int64_t)elapsed_us(wheel)) * 1000;
+    ns = ns > 0 ? ns : 1;
+
+    wheel->armed_tick = wake;
+    dx_timerOneShotSet(wheel->timer, &(struct timespec){ns / NS_PER_SECOND, ns % NS_PER_SECOND});
+}
+
+static void fire(TIMER_WHEEL *wheel, TIMER_WHEEL_TIMER *timer)
+{
+    uint64_t now_us = elapsed_us(wheel);
+    uint64_t deadline_us = timer->deadline_ms * 1000;
+    uint32_t jitter_us = now_us > deadline_us ? (now_us - deadline_us < UINT32_MAX ? (uint32_t)(now_us - deadline_us) : UINT32_MAX) : 0;
+
+    timer->fired++;
+    handler_profile_late(&timer->profile, jitter_us);
+    wheel->expirations++;
+    wheel->jitter_total_us += jitter_us;
+    wheel->jitter_max_us = jitter_us > wheel->jitter_max_us ? jitter_us : wheel->jitter_max_us;
+
+    // Rescheduled from the deadline so the period does not drift, before the handler so it can change or cancel it
+    if (timer->period_ms > 0)
+    {
+        uint64_t now_ms = now_us / 1000;
+
+        timer->deadline_ms += timer->period_ms;
+
+        if (timer->deadline_ms <= now_ms)
+        {
+            uint64_t behind = (now_ms - timer->deadline_ms) / timer->period_ms + 1;
+            timer->missed += (unsigned)behind;
+            timer->deadline_ms += behind * timer->period_ms;
+        }
+
+        schedule(wheel, timer);
+    }
+
+    handler_profile_begin(&timer->profile);
+    timer->handler(timer);
+    handler_profile_end(&timer->profile);
+}
+
+static void run_tick(TIMER_WHEEL *wheel)
+{
+    TIMER_WHEEL_TIMER *list, *timer;
+
+    // Higher levels first, a timer moved down may land in the slot cascaded next
+    for (int level = TIMER_WHEEL_LEVELS - 1; level > 0; level--)
+    {
+        if ((wheel->tick & (slot_ticks(level) - 1)) == 0)
+        {
+            take(&wheel->slots[level][(wheel->tick >> (TIMER_WHEEL_LEVEL_BITS * level)) & SLOT_MASK], &list);
+
+            while ((timer = list) != NULL)
+            {
+                unlink_timer(timer);
+                insert(wheel, timer);
+            }
+        }
+    }
+
+    // Handlers may change or cancel timers still on the list
+    take(&wheel->slots[0][wheel->tick & SLOT_MASK], &list);
+
+    while ((timer = list) != NULL)
+    {
+        unlink_timer(timer);
+        fire(wheel, timer);
+    }
+}
+
+void timer_wheel_start(TIMER_WHEEL *wheel, TIMER_WHEEL_TIMER *timers[], size_t timer_count)
+{
+    clock_gettime(CLOCK_MONOTONIC, &wheel->origin);
+    wheel->timers = timers;
+    wheel->timer_count = timer_count;
+    wheel->profile.name = wheel->timer->name;
+
+    for (size_t i = 0; i < timer_count; i++)
+    {
+        timers[i]->profile.name = timers[i]->name;
+
+        if (timers[i]->period_ms > 0)
+        {
+            timer_wheel_change(wheel, timers[i], timers[i]->period_ms);
+        }
+    }
+}
+
+void timer_wheel_run(TIMER_WHEEL *wheel)
+{
+    uint64_t now_us = elapsed_us(wheel);
+    uint64_t target = now_us / 1000 / TIMER_WHEEL_TICK_MS;
+    uint64_t armed_us = wheel->armed_tick * TIMER_WHEEL_TICK_MS * 1000;
+    unsigned expirations = wheel->expirations;
+
+    if (wheel->armed_tick != 0)
+    {
+        handler_profile_late(&wheel->profile, now_us > armed_us ? (uint32_t)(now_us - armed_us) : 0);
+    }
+
+    handler_profile_begin(&wheel->profile);
+    wheel->wakeups++;
+    wheel->armed_tick = 0;
+    wheel->running = true;
+
+    while (wheel->tick < target)
+    {
+        wheel->tick++;
+        run_tick(wheel);
+    }
+
+    if (wheel->expirations == expirations)
+    {
+        wheel->idle_wakeups++;
+    }
+
+    wheel->running = false;
+    arm(wheel);
+    handler_profile_end(&wheel->profile);
+}
+
+void timer_wheel_oneshot(TIMER_WHEEL *wheel, TIMER_WHEEL_TIMER *timer, uint32_t delay_ms)
+{
+    unlink_timer(timer);
+    timer->period_ms = 0;
+    timer->deadline_ms = elapsed_us(wheel) / 1000 + delay_ms;
+    schedule(wheel, timer);
+    arm(wheel);
+}
+
+void timer_wheel_change(TIMER_WHEEL *wheel, TIMER_WHEEL_TIMER *timer, uint32_t period_ms)
+{
+    unlink_timer(timer);
+    timer->period_ms = period_ms;
+
+    if (period_ms > 0)
+    {
+        timer->deadline_ms = elapsed_us(wheel) / 1000 + period_ms;
+        schedule(wheel, timer);
+    }
+
+    arm(wheel);
+}
+
+void timer_wheel_cancel(TIMER_WHEEL *wheel, TIMER_WHEEL_TIMER *timer)
+{
+    // The kernel timer may still wake for it, that wakeup is counted as idle
+    unlink_timer(timer);
+}
+
+unsigned timer_wheel_saved_wakeups(const TIMER_WHEEL *wheel)
+{
+    return wheel->expirations > wheel->wakeups ? wheel->expirations - wheel->wakeups : 0;
+}
+
+uint32_t timer_wheel_jitter_mean_us(const TIMER_WHEEL *wheel)
+{
+    return wheel->expirations > 0 ? (uint32_t)(wheel->jitter_total_us / wheel->expirations) : 0;
+}
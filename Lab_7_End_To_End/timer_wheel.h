@@ -0,0 +1,101 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+#pragma once
+
+#include "dx_timer.h"
+#include "handler_profile.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+// Resolution of the wheel, deadlines are rounded up to a tick
+#define TIMER_WHEEL_TICK_MS 10
+// Four levels of 64 slots cover 64^4 ticks, about 31 hours at 10 ms. Later deadlines are parked in the top level.
+#define TIMER_WHEEL_LEVEL_BITS 6
+#define TIMER_WHEEL_SLOTS (1 << TIMER_WHEEL_LEVEL_BITS)
+#define TIMER_WHEEL_LEVELS 4
+
+typedef struct _timer_wheel_timer TIMER_WHEEL_TIMER;
+
+typedef void (*TIMER_WHEEL_HANDLER)(TIMER_WHEEL_TIMER *timer);
+
+/// <summary>
+/// An application timer multiplexed on the wheel. Declared like a DX_TIMER_BINDING, a timer with a period is periodic
+/// from timer_wheel_start. The handler runs on the event loop, there is no timer event to consume.
+/// </summary>
+struct _timer_wheel_timer
+{
+    const char *name;
+    TIMER_WHEEL_HANDLER handler;
+    uint32_t period_ms; // zero for one shot
+    uint32_t slack_ms;  // may run this much late to share a wakeup with another timer
+    // Wheel state
+    bool pending;
+    uint64_t expires;     // tick
+    uint64_t deadline_ms; // since the wheel started
+    TIMER_WHEEL_TIMER *next;
+    TIMER_WHEEL_TIMER **pprev;
+    // Since start
+    unsigned fired;
+    unsigned missed;         // periods skipped because the event loop was busy
+    HANDLER_PROFILE profile; // handler run time and lateness against the deadline
+};
+
+/// <summary>
+/// Hierarchical timer wheel driving every application timer from one one-shot kernel timer, armed for the next tick
+/// with work. Timers due close together share a wakeup within their slack.
+/// </summary>
+typedef struct
+{
+    DX_TIMER_BINDING *timer; // one shot, its handler calls timer_wheel_run
+    TIMER_WHEEL_TIMER **timers;
+    size_t timer_count;
+    TIMER_WHEEL_TIMER *slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+    struct timespec origin; // CLOCK_MONOTONIC
+    uint64_t tick;          // last tick processed
+    uint64_t armed_tick;    // kernel timer deadline, zero when not armed
+    bool running;
+    // Since start
+    unsigned wakeups;
+    unsigned idle_wakeups; // only moved timers down a level
+    unsigned expirations;
+    uint64_t jitter_total_us;
+    uint32_t jitter_max_us;
+    HANDLER_PROFILE profile; // every wakeup including the timer handlers, late against the kernel timer deadline
+} TIMER_WHEEL;
+
+/// <summary>
+/// Start the wheel and the timers with a period, the first expiry is one period from now. The profiles are named
+/// after the timers.
+/// </summary>
+void timer_wheel_start(TIMER_WHEEL *wheel, TIMER_WHEEL_TIMER *timers[], size_t timer_count);
+
+/// <summary>
+/// Kernel timer handler, runs the timers that are due then arms the kernel timer for the next one
+/// </summary>
+void timer_wheel_run(TIMER_WHEEL *wheel);
+
+/// <summary>
+/// Run the timer once after delay_ms, as dx_timerOneShotSet. A periodic timer becomes one shot.
+/// </summary>
+void timer_wheel_oneshot(TIMER_WHEEL *wheel, TIMER_WHEEL_TIMER *timer, uint32_t delay_ms);
+
+/// <summary>
+/// Run the timer every period_ms from now, as dx_timerChange
+/// </summary>
+void timer_wheel_change(TIMER_WHEEL *wheel, TIMER_WHEEL_TIMER *timer, uint32_t period_ms);
+
+void timer_wheel_cancel(TIMER_WHEEL *wheel, TIMER_WHEEL_TIMER *timer);
+
+/// <summary>
+/// Kernel wakeups saved against one timer each, every expiration would have been a wakeup of its own
+/// </summary>
+unsigned timer_wheel_saved_wakeups(const TIMER_WHEEL *wheel);
+
+/// <summary>
+/// Mean lateness of the handlers against their deadlines, from tick rounding, coalescing and the event loop
+/// </summary>
+uint32_t timer_wheel_jitter_mean_us(const TIMER_WHEEL *wheel);
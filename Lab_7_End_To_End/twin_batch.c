@@ -0,0 +1,206 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+#include "twin_batch.h"
+
+#include "dx_azure_iot.h"
+#include "dx_utilities.h"
+
+#include <azureiot/iothub_device_client_ll.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+static char patch_buffer[TWIN_BATCH_JSON_BYTES];
+
+static void reported_state_callback(int status_code, void *context)
+{
+    TWIN_BATCH *batch = context;
+
+    if (status_code >= 200 && status_code < 300)
+    {
+        batch->patches_acked++;
+    }
+    else
+    {
+        batch->patches_failed++;
+        dx_Log_Debug("Twin patch failed with status %d\n", status_code);
+    }
+}
+
+/// <summary>
+/// snprintf at the end of the buffer
+/// </summary>
+/// <returns>New length, TWIN_BATCH_JSON_BYTES once it overflowed</returns>
+static size_t append(char *buffer, size_t length, const char *format, ...)
+{
+    va_list args;
+
+    if (length >= TWIN_BATCH_JSON_BYTES)
+    {
+        return TWIN_BATCH_JSON_BYTES;
+    }
+
+    va_start(args, format);
+    int written = vsnprintf(buffer + length, TWIN_BATCH_JSON_BYTES - length, format, args);
+    va_end(args);
+
+    return written < 0 ? TWIN_BATCH_JSON_BYTES : length + (size_t)written;
+}
+
+static size_t append_string(char *buffer, size_t length, const char *value)
+{
+    length = append(buffer, length, "\"");
+
+    for (const char *c = value; *c; c++)
+    {
+        if (*c == '"' || *c == '\\')
+        {
+            length = append(buffer, length, "\\%c", *c);
+        }
+        else if ((unsigned char)*c < 0x20)
+        {
+            length = append(buffer, length, "\\u%04x", (unsigned char)*c);
+        }
+        else
+        {
+            length = append(buffer, length, "%c", *c);
+        }
+    }
+
+    return append(buffer, length, "\"");
+}
+
+/// <summary>
+/// {"HvacTemperature":21,"HvacOperatingMode":"Cooling"}
+/// </summary>
+/// <returns>Length, zero if the patch does not fit</returns>
+static size_t serialize(const TWIN_BATCH *batch, char *buffer)
+{
+    size_t length = append(buffer, 0, "{");
+
+    for (size_t i = 0; i < batch->count; i++)
+    {
+        const TWIN_BATCH_PROPERTY *property = &batch->properties[i];
+
+        length = append(buffer, length, "%s\"%s\":", i > 0 ? "," : "", property->binding->propertyName);
+
+        switch (property->binding->twinType)
+        {
+        case DX_DEVICE_TWIN_BOOL:
+            length = append(buffer, length, "%s", property->value.b ? "true" : "false");
+            break;
+        case DX_DEVICE_TWIN_INT:
+            length = append(buffer, length, "%d", property->value.i);
+            break;
+        case DX_DEVICE_TWIN_FLOAT:
+            length = append(buffer, length, "%.9g", property->value.d);
+            break;
+        case DX_DEVICE_TWIN_DOUBLE:
+            length = append(buffer, length, "%.17g", property->value.d);
+            break;
+        default:
+            length = append_string(buffer, length, property->value.s);
+            break;
+        }
+    }
+
+    length = append(buffer, length, "}");
+
+    return length < TWIN_BATCH_JSON_BYTES ? length : 0;
+}
+
+bool twin_batch_add(TWIN_BATCH *batch, DX_DEVICE_TWIN_BINDING *binding, const void *value)
+{
+    size_t index = 0;
+
+    while (index < batch->count && batch->properties[index].binding != binding)
+    {
+        index++;
+    }
+
+    if (index == TWIN_BATCH_MAX_PROPERTIES)
+    {
+        return false;
+    }
+
+    TWIN_BATCH_PROPERTY *property = &batch->properties[index];
+
+    switch (binding->twinType)
+    {
+    case DX_DEVICE_TWIN_BOOL:
+        property->value.b = *(const bool *)value;
+        break;
+    case DX_DEVICE_TWIN_INT:
+        property->value.i = *(const int *)value;
+        break;
+    case DX_DEVICE_TWIN_FLOAT:
+        property->value.d = *(const float *)value;
+        break;
+    case DX_DEVICE_TWIN_DOUBLE:
+        property->value.d = *(const double *)value;
+        break;
+    case DX_DEVICE_TWIN_STRING:
+        if (strlen(value) >= sizeof(property->value.s))
+        {
+            return false;
+        }
+        strcpy(property->value.s, value);
+        break;
+    default:
+        return false;
+    }
+
+    if (index < batch->count)
+    {
+        batch->properties_coalesced++;
+    }
+    else
+    {
+        property->binding = binding;
+        batch->count++;
+    }
+
+    return true;
+}
+
+bool twin_batch_send(TWIN_BATCH *batch)
+{
+    size_t length;
+
+    if (batch->count == 0)
+    {
+        return true;
+    }
+
+    if (!dx_isAzureConnected())
+    {
+        return false;
+    }
+
+    if ((length = serialize(batch, patch_buffer)) == 0)
+    {
+        dx_Log_Debug("Twin patch larger than %d bytes, dropped\n", TWIN_BATCH_JSON_BYTES);
+        batch->count = 0;
+        return false;
+    }
+
+    if (IoTHubDeviceClient_LL_SendReportedState(dx_azureClientHandleGet(), (const unsigned char *)patch_buffer, length,
+                                                reported_state_callback, batch) != IOTHUB_CLIENT_OK)
+    {
+        return false;
+    }
+
+    batch->patches_sent++;
+    batch->properties_sent += (unsigned)batch->count;
+    batch->bytes_sent += length;
+
+    dx_Log_Debug("Twin patch: %zu properties, %zu bytes. Since start %u patches (%u acked, %u failed), %u properties, %u coalesced, "
+                 "%lu bytes\n",
+                 batch->count, length, batch->patches_sent, batch->patches_acked, batch->patches_failed, batch->properties_sent,
+                 batch->properties_coalesced, batch->bytes_sent);
+
+    batch->count = 0;
+
+    return true;
+}
@@ -0,0 +1,350 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+#include "twin_cache.h"
+
+#include "dx_utilities.h"
+
+#include <applibs/storage.h>
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+/*
+ * Mutable storage layout from offset, little endian
+ *
+ *   header   magic u32, version u16, record bytes u16, count u32
+ *   records  count x { name char[32], twin type u8, flags u8, version u32, value 64 bytes, reserved 9 bytes, crc8 u8 }
+ *
+ * The value is an i32 for int, u8 for bool, the IEEE 754 bits as u64 for float and double, and a terminated string
+ * otherwise. Each record is written on its own and carries its own check, so a power loss mid write loses at most that
+ * entry.
+ */
+#define CACHE_MAGIC 0x43415754 // "TWAC"
+#define CACHE_VERSION 1
+#define FLAG_VALID 0x01
+#define FLAG_DESIRED 0x02
+#define RECORD_TYPE 32
+#define RECORD_FLAGS 33
+#define RECORD_VERSION 34
+#define RECORD_VALUE 38
+
+static uint8_t crc8(const uint8_t *data, size_t length)
+{
+    // CRC-8, polynomial 0x07
+    uint8_t crc = 0;
+    for (size_t i = 0; i < length; i++)
+    {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; bit++)
+        {
+            crc = (uint8_t)(crc & 0x80 ? (crc << 1) ^ 0x07 : crc << 1);
+        }
+    }
+    return crc;
+}
+
+static void put_u16(uint8_t *out, uint16_t value)
+{
+    out[0] = (uint8_t)value;
+    out[1] = (uint8_t)(value >> 8);
+}
+
+static void put_u32(uint8_t *out, uint32_t value)
+{
+    put_u16(out, (uint16_t)value);
+    put_u16(out + 2, (uint16_t)(value >> 16));
+}
+
+static uint16_t get_u16(const uint8_t *in)
+{
+    return (uint16_t)(in[0] | in[1] << 8);
+}
+
+static uint32_t get_u32(const uint8_t *in)
+{
+    return get_u16(in) | (uint32_t)get_u16(in + 2) << 16;
+}
+
+static off_t record_offset(const TWIN_CACHE *cache, size_t index)
+{
+    return cache->offset + TWIN_CACHE_HEADER_BYTES + (off_t)index * TWIN_CACHE_RECORD_BYTES;
+}
+
+static TWIN_CACHE_ENTRY *find(TWIN_CACHE *cache, const DX_DEVICE_TWIN_BINDING *binding)
+{
+    for (size_t i = 0; i < cache->count; i++)
+    {
+        if (cache->entries[i].binding == binding)
+        {
+            return &cache->entries[i];
+        }
+    }
+    return NULL;
+}
+
+static void encode_record(const TWIN_CACHE_ENTRY *entry, uint8_t record[TWIN_CACHE_RECORD_BYTES])
+{
+    uint64_t bits;
+
+    memset(record, 0, TWIN_CACHE_RECORD_BYTES);
+    strncpy((char *)record, entry->binding->propertyName, TWIN_CACHE_NAME_BYTES - 1);
+    record[RECORD_TYPE] = (uint8_t)entry->binding->twinType;
+    record[RECORD_FLAGS] = (uint8_t)((entry->valid ? FLAG_VALID : 0) | (entry->desired ? FLAG_DESIRED : 0));
+    put_u32(&record[RECORD_VERSION], (uint32_t)entry->version);
+
+    switch (entry->binding->twinType)
+    {
+    case DX_DEVICE_TWIN_BOOL:
+        record[RECORD_VALUE] = entry->value.b;
+        break;
+    case DX_DEVICE_TWIN_INT:
+        put_u32(&record[RECORD_VALUE], (uint32_t)entry->value.i);
+        break;
+    case DX_DEVICE_TWIN_FLOAT:
+    case DX_DEVICE_TWIN_DOUBLE:
+        memcpy(&bits, &entry->value.d, sizeof(bits));
+        put_u32(&record[RECORD_VALUE], (uint32_t)bits);
+        put_u32(&record[RECORD_VALUE + 4], (uint32_t)(bits >> 32));
+        break;
+    default:
+        memcpy(&record[RECORD_VALUE], entry->value.s, TWIN_CACHE_STRING_BYTES);
+        break;
+    }
+
+    record[TWIN_CACHE_RECORD_BYTES - 1] = crc8(record, TWIN_CACHE_RECORD_BYTES - 1);
+}
+
+/// <summary>
+/// Restore an entry from a saved record with the same name, type and direction
+/// </summary>
+static bool decode_record(TWIN_CACHE_ENTRY *entry, const uint8_t record[TWIN_CACHE_RECORD_BYTES])
+{
+    uint64_t bits;
+    bool desired = record[RECORD_FLAGS] & FLAG_DESIRED;
+
+    if (!(record[RECORD_FLAGS] & FLAG_VALID) || record[RECORD_TYPE] != (uint8_t)entry->binding->twinType || desired != entry->desired)
+    {
+        return false;
+    }
+
+    switch (entry->binding->twinType)
+    {
+    case DX_DEVICE_TWIN_BOOL:
+        entry->value.b = record[RECORD_VALUE] != 0;
+        break;
+    case DX_DEVICE_TWIN_INT:
+        entry->value.i = (int32_t)get_u32(&record[RECORD_VALUE]);
+        break;
+    case DX_DEVICE_TWIN_FLOAT:
+    case DX_DEVICE_TWIN_DOUBLE:
+        bits = get_u32(&record[RECORD_VALUE]) | (uint64_t)get_u32(&record[RECORD_VALUE + 4]) << 32;
+        memcpy(&entry->value.d, &bits, sizeof(bits));
+        break;
+    default:
+        memcpy(entry->value.s, &record[RECORD_VALUE], TWIN_CACHE_STRING_BYTES);
+        entry->value.s[TWIN_CACHE_STRING_BYTES - 1] = '\0';
+        break;
+    }
+
+    entry->version = (int32_t)get_u32(&record[RECORD_VERSION]);
+    entry->valid = true;
+
+    return true;
+}
+
+static bool write_record(TWIN_CACHE *cache, size_t index)
+{
+    uint8_t record[TWIN_CACHE_RECORD_BYTES];
+
+    if (cache->fd == -1)
+    {
+        return false;
+    }
+
+    encode_record(&cache->entries[index], record);
+    cache->writes++;
+
+    return pwrite(cache->fd, record, sizeof(record), record_offset(cache, index)) == (ssize_t)sizeof(record) && fsync(cache->fd) == 0;
+}
+
+/// <summary>
+/// Rewrite the header and every record in the order of the entries
+/// </summary>
+static bool write_all(TWIN_CACHE *cache)
+{
+    uint8_t header[TWIN_CACHE_HEADER_BYTES];
+
+    for (size_t i = 0; i < cache->count; i++)
+    {
+        if (!write_record(cache, i))
+        {
+            return false;
+        }
+    }
+
+    put_u32(&header[0], CACHE_MAGIC);
+    put_u16(&header[4], CACHE_VERSION);
+    put_u16(&header[6], TWIN_CACHE_RECORD_BYTES);
+    put_u32(&header[8], (uint32_t)cache->count);
+
+    return pwrite(cache->fd, header, sizeof(header), cache->offset) == (ssize_t)sizeof(header) && fsync(cache->fd) == 0;
+}
+
+bool twin_cache_open(TWIN_CACHE *cache)
+{
+    uint8_t header[TWIN_CACHE_HEADER_BYTES];
+    uint8_t record[TWIN_CACHE_RECORD_BYTES];
+    uint32_t saved = 0;
+    bool in_order = false;
+
+    if ((cache->fd = Storage_OpenMutableFile()) == -1)
+    {
+        dx_Log_Debug("Twin cache not available: %s\n", strerror(errno));
+        return false;
+    }
+
+    if (pread(cache->fd, header, sizeof(header), cache->offset) == (ssize_t)sizeof(header) && get_u32(&header[0]) == CACHE_MAGIC &&
+        get_u16(&header[4]) == CACHE_VERSION && get_u16(&header[6]) == TWIN_CACHE_RECORD_BYTES)
+    {
+        saved = get_u32(&header[8]);
+        in_order = saved == cache->count;
+    }
+
+    // Entries are matched by name so bindings can be added, removed or reordered between releases
+    for (uint32_t i = 0; i < saved; i++)
+    {
+        if (pread(cache->fd, record, sizeof(record), record_offset(cache, i)) != (ssize_t)sizeof(record))
+        {
+            in_order = false;
+            break;
+        }
+
+        if (crc8(record, TWIN_CACHE_RECORD_BYTES - 1) != record[TWIN_CACHE_RECORD_BYTES - 1])
+        {
+            in_order = false;
+            continue;
+        }
+
+        record[TWIN_CACHE_NAME_BYTES - 1] = '\0';
+        in_order = in_order && strcmp((const char *)record, cache->entries[i].binding->propertyName) == 0;
+
+        for (size_t e = 0; e < cache->count; e++)
+        {
+            if (strcmp((const char *)record, cache->entries[e].binding->propertyName) == 0 && decode_record(&cache->entries[e], record))
+            {
+                cache->loaded++;
+            }
+        }
+    }
+
+    if (!in_order && !write_all(cache))
+    {
+        twin_cache_close(cache);
+        return false;
+    }
+
+    dx_Log_Debug("Twin cache: %u of %zu properties restored\n", cache->loaded, cache->count);
+
+    return true;
+}
+
+void twin_cache_close(TWIN_CACHE *cache)
+{
+    if (cache->fd != -1)
+    {
+        close(cache->fd);
+        cache->fd = -1;
+    }
+}
+
+const void *twin_cache_get(TWIN_CACHE *cache, const DX_DEVICE_TWIN_BINDING *binding)
+{
+    TWIN_CACHE_ENTRY *entry = find(cache, binding);
+
+    if (entry == NULL || !entry->valid)
+    {
+        return NULL;
+    }
+
+    return entry->binding->twinType == DX_DEVICE_TWIN_BOOL ? (const void *)&entry->value.b
+           : entry->binding->twinType == DX_DEVICE_TWIN_INT ? (const void *)&entry->value.i
+           : entry->binding->twinType == DX_DEVICE_TWIN_FLOAT || entry->binding->twinType == DX_DEVICE_TWIN_DOUBLE
+               ? (const void *)&entry->value.d
+               : (const void *)entry->value.s;
+}
+
+bool twin_cache_is_current(TWIN_CACHE *cache, const DX_DEVICE_TWIN_BINDING *binding)
+{
+    TWIN_CACHE_ENTRY *entry = find(cache, binding);
+
+    if (entry == NULL || !entry->desired)
+    {
+        return false;
+    }
+
+    if (entry->valid && entry->version == binding->propertyVersion)
+    {
+        cache->current++;
+        return true;
+    }
+
+    cache->changed++;
+    return false;
+}
+
+bool twin_cache_set(TWIN_CACHE *cache, const DX_DEVICE_TWIN_BINDING *binding, const void *value)
+{
+    TWIN_CACHE_ENTRY *entry = find(cache, binding);
+    TWIN_CACHE_ENTRY updated;
+    uint8_t saved[TWIN_CACHE_RECORD_BYTES], record[TWIN_CACHE_RECORD_BYTES];
+
+    if (entry == NULL)
+    {
+        return false;
+    }
+
+    updated = *entry;
+    updated.valid = true;
+    updated.version = entry->desired ? binding->propertyVersion : 0;
+
+    switch (binding->twinType)
+    {
+    case DX_DEVICE_TWIN_BOOL:
+        updated.value.b = *(const bool *)value;
+        break;
+    case DX_DEVICE_TWIN_INT:
+        updated.value.i = *(const int *)value;
+        break;
+    case DX_DEVICE_TWIN_FLOAT:
+        updated.value.d = *(const float *)value;
+        break;
+    case DX_DEVICE_TWIN_DOUBLE:
+        updated.value.d = *(const double *)value;
+        break;
+    case DX_DEVICE_TWIN_STRING:
+        if (strlen(value) >= TWIN_CACHE_STRING_BYTES)
+        {
+            return false;
+        }
+        memset(updated.value.s, 0, sizeof(updated.value.s));
+        strcpy(updated.value.s, value);
+        break;
+    default:
+        return false;
+    }
+
+    // Compare the encoded records, flash is only written for a real change
+    encode_record(entry, saved);
+    encode_record(&updated, record);
+
+    if (entry->valid && memcmp(saved, record, sizeof(record)) == 0)
+    {
+        return true;
+    }
+
+    *entry = updated;
+
+    return write_record(cache, (size_t)(entry - cache->entries));
+}
@@ -0,0 +1,77 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+#pragma once
+
+#include "dx_device_twins.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+// Mutable storage holds the cache header plus one record per entry, see twin_cache.c for the layout
+#define TWIN_CACHE_HEADER_BYTES 12
+#define TWIN_CACHE_RECORD_BYTES 112
+#define TWIN_CACHE_BYTES(entries) (TWIN_CACHE_HEADER_BYTES + (entries)*TWIN_CACHE_RECORD_BYTES)
+// Longest property name and string value, including the terminator
+#define TWIN_CACHE_NAME_BYTES 32
+#define TWIN_CACHE_STRING_BYTES 64
+
+typedef struct
+{
+    DX_DEVICE_TWIN_BINDING *binding;
+    bool desired; // desired properties are reconciled by version, reported properties by value
+    bool valid;
+    int version;
+    union
+    {
+        bool b;
+        int i;
+        double d; // float and double
+        char s[TWIN_CACHE_STRING_BYTES];
+    } value;
+} TWIN_CACHE_ENTRY;
+
+/// <summary>
+/// Last known device twin values kept in mutable storage, so the app can act on them at startup before IoT Hub sends
+/// the twin. The cache shares the mutable storage file with the telemetry store and lives at offset.
+/// </summary>
+typedef struct
+{
+    TWIN_CACHE_ENTRY *entries;
+    size_t count;
+    off_t offset;
+    int fd;
+    // Since start
+    unsigned loaded;   // entries restored from the previous run
+    unsigned current;  // desired values that arrived with the version already applied from the cache
+    unsigned changed;  // desired values that arrived with a different version
+    unsigned writes;   // records written to mutable storage
+} TWIN_CACHE;
+
+/// <summary>
+/// Open the cache and restore the entries saved by a previous run, matched by property name
+/// </summary>
+/// <returns>false if mutable storage is not available, the cache then only lives in memory</returns>
+bool twin_cache_open(TWIN_CACHE *cache);
+
+void twin_cache_close(TWIN_CACHE *cache);
+
+/// <summary>
+/// Cached value of a binding, in the type the binding declares
+/// </summary>
+/// <returns>NULL if the binding is not cached or nothing was saved yet</returns>
+const void *twin_cache_get(TWIN_CACHE *cache, const DX_DEVICE_TWIN_BINDING *binding);
+
+/// <summary>
+/// Reconcile a desired property from IoT Hub with the cache. Counts the outcome.
+/// </summary>
+/// <returns>true if the binding holds the version already applied from the cache, it need not be applied again</returns>
+bool twin_cache_is_current(TWIN_CACHE *cache, const DX_DEVICE_TWIN_BINDING *binding);
+
+/// <summary>
+/// Save a value, in the type the binding declares. Desired entries take the binding's propertyVersion. Mutable storage
+/// is only written when the value or version changed.
+/// </summary>
+/// <returns>false if the binding is not cached or the value could not be saved</returns>
+bool twin_cache_set(TWIN_CACHE *cache, const DX_DEVICE_TWIN_BINDING *binding, const void *value);
@@ -0,0 +1,60 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+#include "twin_hysteresis.h"
+
+#include <stdlib.h>
+
+static time_t monotonic_seconds(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec;
+}
+
+bool twin_hysteresis_check(TWIN_HYSTERESIS *hysteresis, int value)
+{
+    time_t now = monotonic_seconds();
+
+    hysteresis->checks++;
+
+    if (hysteresis->reported_valid)
+    {
+        if (value == hysteresis->reported)
+        {
+            hysteresis->differs = false;
+            hysteresis->held_band++;
+            return false;
+        }
+
+        if (!hysteresis->differs)
+        {
+            hysteresis->differs = true;
+            hysteresis->differs_monotonic = now;
+        }
+
+        // A reading flipping across a rounding boundary keeps coming back to the reported value, a step within the band
+        // that lasts the minimum interval is real and reported
+        if (abs(value - hysteresis->reported) <= hysteresis->band && now - hysteresis->differs_monotonic < hysteresis->min_interval_seconds)
+        {
+            hysteresis->held_band++;
+            return false;
+        }
+
+        // Held values are checked again next cycle against the same reference, so a lasting change is reported
+        // once the interval has passed
+        if (now - hysteresis->reported_monotonic < hysteresis->min_interval_seconds)
+        {
+            hysteresis->held_interval++;
+            return false;
+        }
+    }
+
+    hysteresis->reported_valid = true;
+    hysteresis->differs = false;
+    hysteresis->reported = value;
+    hysteresis->reported_monotonic = now;
+    hysteresis->reports++;
+
+    return true;
+}
@@ -0,0 +1,40 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+#pragma once
+
+#include "dx_device_twins.h"
+
+#include <stdbool.h>
+#include <time.h>
+
+/// <summary>
+/// Reporting state for one integer reported property. A value is reported once it moves more than band from the last
+/// reported value, and no sooner than min_interval_seconds after that report, so a reading flipping across a rounding
+/// boundary is not reported every cycle and each binding is written at most once per interval. A value within the band
+/// is reported once the reading has stayed off the reported value for min_interval_seconds, so a lasting small step is
+/// not held forever.
+/// </summary>
+typedef struct
+{
+    DX_DEVICE_TWIN_BINDING *binding;
+    int band;                 // changes up to this size are not reported, zero reports every change
+    int min_interval_seconds; // zero does not limit the rate
+    bool reported_valid;
+    int reported;
+    time_t reported_monotonic;
+    bool differs; // the readings have not returned to the reported value since differs_monotonic
+    time_t differs_monotonic;
+    // Since start
+    unsigned checks;
+    unsigned reports;
+    unsigned held_band;     // unchanged, or within the band for less than the minimum interval
+    unsigned held_interval; // past the band but too soon after the last report
+} TWIN_HYSTERESIS;
+
+/// <summary>
+/// Decide if value is reported, it becomes the new reference when it is
+/// </summary>
+/// <returns>true for the first value, or when it moved past the band or stayed off the reported value, and the minimum
+/// interval has passed</returns>
+bool twin_hysteresis_check(TWIN_HYSTERESIS *hysteresis, int value);